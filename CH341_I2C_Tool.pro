@@ -18,6 +18,8 @@ QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
+QT += concurrent
+
 CONFIG += c++17
 
 # You can make your code fail to compile if it uses deprecated APIs.
@@ -25,21 +27,103 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    asyncdevice.cpp \
+    blocktransfer.cpp \
+    byteparser.cpp \
+    ch341stream.cpp \
+    command.cpp \
+    commandcsv.cpp \
+    commandlibrary.cpp \
+    commandmodel.cpp \
     deviceselect.cpp \
+    devicepool.cpp \
+    deviceworker.cpp \
+    fixturedialog.cpp \
+    headlessrunner.cpp \
+    i2ctransport.cpp \
+    latencyhistogram.cpp \
     main.cpp \
-    mainwindow.cpp
+    mainwindow.cpp \
+    memorydialog.cpp \
+    registercache.cpp \
+    registercachedialog.cpp \
+    resultmodel.cpp \
+    retrypolicy.cpp \
+    samplering.cpp \
+    scandialog.cpp \
+    sequencedialog.cpp \
+    sequencerunner.cpp \
+    sequences.cpp \
+    simulatedtransport.cpp \
+    statsdialog.cpp \
+    streamscheduler.cpp \
+    tracelog.cpp \
+    tracereplay.cpp \
+    transactionstats.cpp
 
 HEADERS += \
+    asyncdevice.h \
+    blocktransfer.h \
+    byteparser.h \
+    ch341stream.h \
+    command.h \
+    commandcsv.h \
+    commandlibrary.h \
+    commandmodel.h \
     deviceselect.h \
-    mainwindow.h
+    devicepool.h \
+    deviceworker.h \
+    fixturedialog.h \
+    headlessrunner.h \
+    i2ctransport.h \
+    latencyhistogram.h \
+    mainwindow.h \
+    memorydialog.h \
+    registercache.h \
+    registercachedialog.h \
+    resultmodel.h \
+    retrypolicy.h \
+    samplering.h \
+    scandialog.h \
+    sequencedialog.h \
+    sequencerunner.h \
+    sequences.h \
+    simulatedtransport.h \
+    spscqueue.h \
+    statsdialog.h \
+    streamscheduler.h \
+    tracelog.h \
+    tracereplay.h \
+    transactionstats.h
 
 FORMS += \
     deviceselect.ui \
-    mainwindow.ui
+    fixturedialog.ui \
+    mainwindow.ui \
+    memorydialog.ui \
+    registercachedialog.ui \
+    scandialog.ui \
+    sequencedialog.ui \
+    statsdialog.ui
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
-win32: LIBS += -L$$PWD/./ -lCH341DLLA64
+win32 {
+    SOURCES += ch341transport.cpp
+    HEADERS += ch341transport.h
+    DEFINES += HAVE_CH341DLL
+    LIBS += -L$$PWD/./ -lCH341DLLA64
+}
+
+unix:!macx {
+    packagesExist(libusb-1.0) {
+        SOURCES += libusbtransport.cpp
+        HEADERS += libusbtransport.h
+        DEFINES += HAVE_LIBUSB
+        CONFIG += link_pkgconfig
+        PKGCONFIG += libusb-1.0
+    }
+}
@@ -0,0 +1,171 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "asyncdevice.h"
+
+#include <QThread>
+#include <QTimer>
+
+AsyncDevice::AsyncDevice(DeviceWorker* worker, QObject *parent)
+    : QObject(parent)
+{
+    this->setWorker(worker);
+}
+
+AsyncDevice::~AsyncDevice()
+{
+    this->expireAll("Cancelled");
+}
+
+void AsyncDevice::setWorker(DeviceWorker* worker)
+{
+    Q_ASSERT(QThread::currentThread() == this->thread());
+
+    if(this->worker)
+        disconnect(this->worker, nullptr, this, nullptr);
+
+    // Whatever the previous worker still had queued never finishes
+    this->expireAll("Device closed");
+    this->worker = worker;
+
+    if(!worker)
+        return;
+
+    connect(worker, &DeviceWorker::finished, this, &AsyncDevice::onDeviceResult);
+
+    // The worker goes away with its device, e.g. when the main window closes
+    connect(worker, &QObject::destroyed, this, [this]() { this->expireAll("Device closed"); });
+}
+
+QFuture<DeviceResult> AsyncDevice::submit(DeviceRequest request, std::chrono::milliseconds timeout)
+{
+    Pending pending = { std::make_shared<QPromise<DeviceResult>>(), std::make_shared<std::atomic<bool>>(false) };
+    pending.promise->start();
+
+    // Polled on the device thread, the promise is thread safe
+    request.owner = this;
+    request.cancelled = [promise = pending.promise, expired = pending.expired]() {
+        return expired->load() || promise->isCanceled();
+    };
+
+    QFuture<DeviceResult> future = pending.promise->future();
+
+    // The worker's queue takes a single producer, the thread this object lives in
+    if(QThread::currentThread() == this->thread())
+        this->enqueue(std::move(request), std::move(pending), timeout);
+    else {
+        QMetaObject::invokeMethod(this, [this, request, pending, timeout]() {
+            this->enqueue(request, pending, timeout);
+        }, Qt::QueuedConnection);
+    }
+
+    return future;
+}
+
+void AsyncDevice::enqueue(DeviceRequest request, Pending pending, std::chrono::milliseconds timeout)
+{
+    if(!this->worker) {
+        AsyncDevice::finish(pending, "Device closed");
+        return;
+    }
+
+    if(pending.promise->isCanceled()) { // While it was handed over
+        AsyncDevice::finish(pending, "Cancelled");
+        return;
+    }
+
+    quint64 id = this->worker->submit(std::move(request));
+
+    if(!id) {
+        AsyncDevice::finish(pending, "Too many queued commands");
+        return;
+    }
+
+    if(timeout.count() > 0)
+        QTimer::singleShot(timeout, this, [this, id]() { this->expire(id, "Timed out"); });
+
+    this->pending.emplace(id, std::move(pending));
+}
+
+QFuture<DeviceResult> AsyncDevice::transfer(const I2CTransaction& transaction, std::chrono::milliseconds timeout)
+{
+    DeviceRequest request;
+    request.transactions.push_back(transaction);
+
+    return this->submit(std::move(request), timeout);
+}
+
+QFuture<DeviceResult> AsyncDevice::transfer(const Command& command, std::chrono::milliseconds timeout)
+{
+    DeviceRequest request;
+    request.transactions.push_back(command.transaction());
+    request.names.append(command.name);
+
+    return this->submit(std::move(request), timeout);
+}
+
+QFuture<DeviceResult> AsyncDevice::transferBatch(std::vector<I2CTransaction> transactions, std::chrono::milliseconds timeout)
+{
+    DeviceRequest request;
+    request.kind = DeviceRequest::Batch;
+    request.transactions = std::move(transactions);
+
+    return this->submit(std::move(request), timeout);
+}
+
+void AsyncDevice::onDeviceResult(const DeviceResult& result)
+{
+    auto it = this->pending.find(result.id);
+
+    if(it == this->pending.end()) // Someone else's, or timed out already
+        return;
+
+    Pending pending = std::move(it->second);
+    this->pending.erase(it);
+
+    pending.promise->addResult(result); // Ignored if the future was cancelled
+    pending.promise->finish();
+}
+
+void AsyncDevice::expire(quint64 id, const QString& error)
+{
+    auto it = this->pending.find(id);
+
+    if(it == this->pending.end())
+        return;
+
+    Pending pending = std::move(it->second);
+    this->pending.erase(it);
+
+    pending.expired->store(true);
+    AsyncDevice::finish(pending, error);
+}
+
+void AsyncDevice::expireAll(const QString& error)
+{
+    while(!this->pending.empty())
+        this->expire(this->pending.begin()->first, error);
+}
+
+void AsyncDevice::finish(const Pending& pending, const QString& error)
+{
+    DeviceResult result;
+    result.cancelled = true;
+    result.error = error;
+
+    pending.promise->addResult(result); // Ignored if the future was cancelled
+    pending.promise->finish();
+}
@@ -0,0 +1,151 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef ASYNCDEVICE_H
+#define ASYNCDEVICE_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <vector>
+#include <QFuture>
+#include <QObject>
+#include <QPointer>
+#include <QPromise>
+
+#include "command.h"
+#include "deviceworker.h"
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#include <QFutureWatcher>
+#endif
+
+// Asynchronous access to the device thread for automation code. Every call
+// returns at once with a future that is finished on the thread this object
+// lives in (continuations attached with .then(this, ...) run there too), so
+// many requests can be outstanding while the caller keeps working. It has to
+// live on the thread that submits to the worker (the GUI thread); calls from
+// any other thread are handed over to it. The main window owns one, see
+// MainWindow::automation(), and points it at every new worker it starts.
+//
+// Cancelling a future, or its timeout running out, drops the request if it
+// has not started yet and stops memory transfers and sequences between
+// steps; a transfer already on the wire always completes. Such requests
+// finish with cancelled set and the error "Cancelled" or "Timed out".
+// Results of these requests carry owner, so other listeners of the worker
+// can tell them apart, and the worker's cancelPending() leaves them alone.
+class AsyncDevice : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AsyncDevice(DeviceWorker* worker = nullptr, QObject *parent = nullptr);
+    // Every outstanding future finishes as cancelled
+    ~AsyncDevice();
+
+    // Owning thread only. Requests from now on go to worker (none while it is
+    // null), the futures still waiting on the previous one finish with the
+    // error "Device closed".
+    void setWorker(DeviceWorker* worker);
+
+    // Thread safe. A timeout of 0 waits for as long as it takes.
+    QFuture<DeviceResult> submit(DeviceRequest request, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    QFuture<DeviceResult> transfer(const I2CTransaction& transaction, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    QFuture<DeviceResult> transfer(const Command& command, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+    QFuture<DeviceResult> transferBatch(std::vector<I2CTransaction> transactions,
+                                        std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
+
+    // Owning thread only
+    std::size_t outstanding() const { return this->pending.size(); }
+
+private slots:
+    void onDeviceResult(const DeviceResult& result);
+
+private:
+    struct Pending {
+        std::shared_ptr<QPromise<DeviceResult>> promise;
+        std::shared_ptr<std::atomic<bool>> expired;
+    };
+
+    QPointer<DeviceWorker> worker;
+    std::map<quint64, Pending> pending;
+
+    // Owning thread only, hands the request to the worker
+    void enqueue(DeviceRequest request, Pending pending, std::chrono::milliseconds timeout);
+    void expire(quint64 id, const QString& error);
+    void expireAll(const QString& error);
+    static void finish(const Pending& pending, const QString& error);
+};
+
+#if defined(__cpp_impl_coroutine)
+// C++20 coroutines can co_await the futures:
+//
+//   DeviceTask readId(AsyncDevice* device) {
+//       DeviceResult result = co_await device->transfer(command);
+//       ...
+//   }
+//
+// The coroutine resumes on the thread that awaited, through its event loop.
+// A future cancelled before it got a result resumes with cancelled set.
+struct DeviceAwaiter {
+    QFuture<DeviceResult> future;
+
+    bool await_ready() const { return this->future.isFinished(); }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        QFutureWatcher<DeviceResult>* watcher = new QFutureWatcher<DeviceResult>();
+
+        QObject::connect(watcher, &QFutureWatcher<DeviceResult>::finished, watcher, [watcher, handle]() {
+            watcher->deleteLater();
+            handle.resume();
+        });
+
+        watcher->setFuture(this->future);
+    }
+
+    DeviceResult await_resume() {
+        if(this->future.resultCount() != 0)
+            return this->future.result();
+
+        DeviceResult result;
+        result.cancelled = true;
+        result.error = "Cancelled";
+
+        return result;
+    }
+};
+
+inline DeviceAwaiter operator co_await(QFuture<DeviceResult> future)
+{
+    return { std::move(future) };
+}
+
+// Fire and forget coroutine, runs until its first co_await right away
+struct DeviceTask {
+    struct promise_type {
+        DeviceTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+#endif
+
+#endif // ASYNCDEVICE_H
@@ -0,0 +1,64 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Benchmark {
+
+namespace {
+
+volatile const void* sink = nullptr;
+
+}
+
+void keep(const void* pointer)
+{
+    sink = pointer;
+}
+
+Runner::Runner(const std::string& filter, double minTime, std::FILE* out)
+    : filter(filter)
+    , minTime(std::chrono::nanoseconds((long long)(minTime * 1e9)))
+    , out(out)
+{
+}
+
+bool Runner::selected(const std::string& name) const
+{
+    return this->filter.empty() || name.find(this->filter) != std::string::npos;
+}
+
+void Runner::report(const std::string& name, const char* unit, std::size_t items, std::uint64_t iterations,
+                    std::vector<double>& samples)
+{
+    std::sort(samples.begin(), samples.end());
+
+    double median = samples[samples.size() / 2];
+    double itemsPerSecond = median > 0 ? items * 1e9 / median : 0;
+
+    std::fprintf(this->out, "{\"name\":\"%s\",\"unit\":\"%s\",\"items\":%zu,\"iterations\":%llu,"
+                            "\"median_ns\":%.0f,\"min_ns\":%.0f,\"items_per_s\":%.0f}\n",
+                 name.c_str(), unit, items, (unsigned long long)iterations, std::round(median), std::round(samples.front()),
+                 std::round(itemsPerSecond));
+    std::fflush(this->out);
+
+    ++this->ran;
+}
+
+}
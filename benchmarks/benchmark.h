@@ -0,0 +1,103 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Minimal timing harness. Every benchmark is warmed up once, then run in
+// batches of at least minBatchTime until minTime has passed; the median batch
+// is reported. Output is one JSON object per line on stdout (schema below),
+// so runs can be diffed and tracked across releases:
+//
+//   {"schema":1,"suite":"ch341-i2c-tool","qt":"6.5.3"}
+//   {"name":"csv/parse/100k","unit":"row","items":100000,"iterations":14,"median_ns":35123456,"min_ns":34987001,"items_per_s":2847100}
+namespace Benchmark {
+
+// Keeps the optimizer from dropping a result nobody reads
+void keep(const void* pointer);
+
+template<typename T>
+inline void keep(const T& value)
+{
+    keep(static_cast<const void*>(&value));
+}
+
+class Runner
+{
+public:
+    Runner(const std::string& filter, double minTime, std::FILE* out = stdout);
+
+    // body runs one iteration processing items things of unit (bytes, rows, ...)
+    template<typename Body>
+    void run(const std::string& name, const char* unit, std::size_t items, Body&& body);
+
+    bool selected(const std::string& name) const;
+    std::size_t count() const { return this->ran; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::string filter;
+    std::chrono::nanoseconds minTime;
+    std::FILE* out;
+    std::size_t ran = 0;
+
+    void report(const std::string& name, const char* unit, std::size_t items, std::uint64_t iterations,
+                std::vector<double>& samples);
+};
+
+template<typename Body>
+void Runner::run(const std::string& name, const char* unit, std::size_t items, Body&& body)
+{
+    if(!this->selected(name))
+        return;
+
+    const std::chrono::nanoseconds minBatchTime = std::chrono::milliseconds(10);
+
+    // WARM UP, ALSO SIZES THE BATCHES
+    Clock::time_point start = Clock::now();
+    body();
+    std::chrono::nanoseconds once = std::max(std::chrono::nanoseconds(1), Clock::now() - start);
+
+    std::uint64_t batch = std::max<std::uint64_t>(1, minBatchTime / once);
+    std::uint64_t iterations = 0;
+    std::vector<double> samples;                // Nanoseconds per iteration of each batch
+
+    Clock::time_point end = Clock::now() + this->minTime;
+
+    do {
+        start = Clock::now();
+
+        for(std::uint64_t i = 0; i < batch; ++i)
+            body();
+
+        samples.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / batch);
+        iterations += batch;
+    } while(Clock::now() < end || samples.size() < 3);
+
+    this->report(name, unit, items, iterations, samples);
+}
+
+}
+
+#endif // BENCHMARK_H
@@ -0,0 +1,80 @@
+# This file is part of CH341-I2C-Tool
+# Copyright (C) 2023  Derek Meng
+
+# CH341-I2C-Tool is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# CH341-I2C-Tool is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+
+# You should have received a copy of the GNU Lesser General Public License
+# along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+# Microbenchmarks of the tool's hot paths, run against the simulated bus so
+# they need no hardware. Build in release mode:
+#
+#   qmake CONFIG+=release benchmarks.pro && make && ./ch341_benchmarks
+
+QT       += core
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = ch341_benchmarks
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    benchmark.cpp \
+    main.cpp \
+    ../blocktransfer.cpp \
+    ../byteparser.cpp \
+    ../ch341stream.cpp \
+    ../command.cpp \
+    ../commandcsv.cpp \
+    ../commandlibrary.cpp \
+    ../commandmodel.cpp \
+    ../deviceworker.cpp \
+    ../i2ctransport.cpp \
+    ../latencyhistogram.cpp \
+    ../registercache.cpp \
+    ../resultmodel.cpp \
+    ../retrypolicy.cpp \
+    ../samplering.cpp \
+    ../sequencerunner.cpp \
+    ../sequences.cpp \
+    ../simulatedtransport.cpp \
+    ../streamscheduler.cpp \
+    ../tracelog.cpp \
+    ../tracereplay.cpp \
+    ../transactionstats.cpp
+
+HEADERS += \
+    benchmark.h \
+    ../blocktransfer.h \
+    ../byteparser.h \
+    ../ch341stream.h \
+    ../command.h \
+    ../commandcsv.h \
+    ../commandlibrary.h \
+    ../commandmodel.h \
+    ../deviceworker.h \
+    ../i2ctransport.h \
+    ../latencyhistogram.h \
+    ../registercache.h \
+    ../resultmodel.h \
+    ../retrypolicy.h \
+    ../samplering.h \
+    ../sequencerunner.h \
+    ../sequences.h \
+    ../simulatedtransport.h \
+    ../spscqueue.h \
+    ../streamscheduler.h \
+    ../tracelog.h \
+    ../tracereplay.h \
+    ../transactionstats.h
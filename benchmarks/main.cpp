@@ -0,0 +1,619 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QThread>
+
+#include "asyncdevice.h"
+#include "benchmark.h"
+#include "byteparser.h"
+#include "commandcsv.h"
+#include "commandlibrary.h"
+#include "commandmodel.h"
+#include "deviceworker.h"
+#include "registercache.h"
+#include "resultmodel.h"
+#include "sequencerunner.h"
+#include "sequences.h"
+#include "simulatedtransport.h"
+#include "tracereplay.h"
+
+namespace {
+
+// Same library on every run, so results stay comparable
+std::vector<Command> makeCommands(std::size_t count)
+{
+    std::mt19937 random(341);
+    std::vector<Command> commands(count);
+
+    for(std::size_t i = 0; i < count; ++i) {
+        Command& command = commands[i];
+        command.name = QString("Sensor %1 register %2").arg((int)(i / 256)).arg((int)(i % 256), 3, 10, QChar('0'));
+        command.address = 0x48;
+        command.hasRegister = true;
+        command.write.push_back((unsigned char)(i % 256));
+
+        for(std::size_t j = random() % 4; j != 0; --j)
+            command.write.push_back((unsigned char)random());
+
+        command.readLength = command.write.size() == 1 ? 2 : 0;
+        command.speedMode = random() % 4;
+
+        if(i % 16 == 0)
+            command.tags.append("init");
+    }
+
+    std::shuffle(commands.begin(), commands.end(), random);
+
+    return commands;
+}
+
+std::vector<QString> pickNames(const std::vector<Command>& commands, std::size_t count)
+{
+    std::mt19937 random(12);
+    std::vector<QString> names(count);
+
+    for(QString& name : names)
+        name = commands[random() % commands.size()].name;
+
+    return names;
+}
+
+QString sizeName(std::size_t count)
+{
+    return count >= 1000 ? QString::number(count / 1000) + "k" : QString::number(count);
+}
+
+// WRITE DATA PARSING
+// The tool's original validator: whitespace separated binary tokens, padded
+// to 8 digits and converted one by one, kept to compare ByteParser against
+bool legacyWriteData(const std::string& tokens, std::vector<unsigned char>& bytes)
+{
+    std::istringstream iss(tokens);
+    std::vector<std::string> strBytes;
+    std::string token;
+
+    while(iss >> token) {
+        if(token.empty() || token.length() > 8 || token.find_first_not_of("01") != std::string::npos)
+            return false;
+
+        for(std::size_t i = token.length(); i < 8; ++i)
+            token = '0' + token;
+
+        strBytes.push_back(token);
+    }
+
+    for(std::string& byte : strBytes)
+        bytes.push_back((unsigned char)std::stoi(byte, NULL, 2));
+
+    return true;
+}
+
+void benchmarkParsing(Benchmark::Runner& runner)
+{
+    const std::size_t length = 1022; // Most a single command can write
+
+    std::string binary, hex;
+    for(std::size_t i = 0; i < length; ++i) {
+        binary += ByteParser::toBinary((unsigned)(i * 37 % 256), 8) + " ";
+        hex += "0x" + QString::number((int)(i * 37 % 256), 16).rightJustified(2, '0').toStdString() + " ";
+    }
+
+    QString binaryText = QString::fromStdString(binary), hexText = QString::fromStdString(hex);
+    std::vector<unsigned char> bytes;
+
+    runner.run("parse/write-data/legacy-binary", "byte", length, [&]() {
+        bytes.clear();
+        legacyWriteData(binary, bytes);
+        Benchmark::keep(bytes.data());
+    });
+
+    runner.run("parse/write-data/binary", "byte", length, [&]() {
+        bytes.clear();
+        ByteParser::parse(binaryText.utf16(), binaryText.size(), bytes);
+        Benchmark::keep(bytes.data());
+    });
+
+    runner.run("parse/write-data/hex", "byte", length, [&]() {
+        bytes.clear();
+        ByteParser::parse(hexText.utf16(), hexText.size(), bytes);
+        Benchmark::keep(bytes.data());
+    });
+}
+
+// COMMAND LIBRARY FILES
+void benchmarkLibraries(Benchmark::Runner& runner, const QString& directory)
+{
+    for(std::size_t count : { (std::size_t)1000, (std::size_t)100000 }) {
+        QString size = sizeName(count);
+        QString csvPath = directory + "/library-" + size + ".csv";
+        QString binaryPath = directory + "/library-" + size + "." + CommandLibrary::suffix;
+
+        CommandModel model;
+        model.setCommands(makeCommands(count));
+
+        runner.run(("csv/save/" + size).toStdString(), "row", count, [&]() {
+            CommandCsv::save(csvPath, model);
+        });
+
+        if(!CommandCsv::save(csvPath, model) || !CommandLibrary::write(binaryPath, model)) {
+            std::fprintf(stderr, "Failed to write the %s row libraries to %s\n", qPrintable(size), qPrintable(directory));
+            continue;
+        }
+
+        QFile file(csvPath);
+        file.open(QIODevice::ReadOnly);
+        QByteArray text = file.readAll();
+
+        runner.run(("csv/parse/" + size).toStdString(), "row", count, [&]() {
+            CommandCsv::LoadResult result;
+            CommandCsv::parse(text.constData(), text.size(), result);
+            Benchmark::keep(result.commands.data());
+        });
+
+        runner.run(("csv/load/" + size).toStdString(), "row", count, [&]() {
+            CommandCsv::LoadResult result;
+            CommandCsv::load(csvPath, result);
+            Benchmark::keep(result.commands.data());
+        });
+
+        runner.run(("library/write/" + size).toStdString(), "row", count, [&]() {
+            CommandLibrary::write(binaryPath, model);
+        });
+
+        runner.run(("library/open/" + size).toStdString(), "row", count, [&]() {
+            CommandLibrary library;
+            library.open(binaryPath);
+            Benchmark::keep(library);
+        });
+
+        CommandLibrary library;
+        library.open(binaryPath);
+        std::vector<QString> names = pickNames(makeCommands(count), 1000);
+
+        runner.run(("library/lookup/" + size).toStdString(), "lookup", names.size(), [&]() {
+            int found = 0;
+            for(const QString& name : names)
+                found += library.indexOf(name) >= 0;
+            Benchmark::keep(found);
+        });
+
+        // Replacing half of them and adding as many new ones, on top of the mapping
+        std::shared_ptr<CommandLibrary> mapped = std::make_shared<CommandLibrary>();
+        mapped->open(binaryPath);
+        std::vector<Command> edits = makeCommands(1000);
+
+        for(std::size_t i = 0; i < edits.size(); i += 2)
+            edits[i].name += " (edited)";
+
+        runner.run(("library/edit/" + size).toStdString(), "command", edits.size(), [&]() {
+            CommandModel model;
+            model.setLibrary(mapped);
+            for(const Command& command : edits)
+                model.insertOrReplace(command);
+            Benchmark::keep(model);
+        });
+    }
+}
+
+// COMMAND STORE
+void benchmarkCommands(Benchmark::Runner& runner)
+{
+    std::vector<Command> small = makeCommands(1000);
+
+    runner.run("commands/insert/1k", "command", small.size(), [&]() {
+        CommandModel model;
+        for(const Command& command : small)
+            model.insertOrReplace(command);
+        Benchmark::keep(model);
+    });
+
+    std::vector<Command> large = makeCommands(100000);
+
+    runner.run("commands/set/100k", "command", large.size(), [&]() {
+        CommandModel model;
+        model.setCommands(large);
+        Benchmark::keep(model);
+    });
+
+    CommandModel model;
+    model.setCommands(large);
+    std::vector<QString> names = pickNames(large, 1000);
+
+    runner.run("commands/find/100k", "lookup", names.size(), [&]() {
+        int found = 0;
+        for(const QString& name : names)
+            found += model.find(name).has_value();
+        Benchmark::keep(found);
+    });
+
+    runner.run("commands/expand-tag/100k", "command", large.size() / 16, [&]() {
+        std::vector<Command> tagged;
+        model.expand("#init", tagged);
+        Benchmark::keep(tagged.data());
+    });
+}
+
+// READ RESULT FORMATTING
+void benchmarkResults(Benchmark::Runner& runner)
+{
+    std::vector<unsigned char> data(1 << 20);
+    for(std::size_t i = 0; i < data.size(); ++i)
+        data[i] = (unsigned char)(i * 131);
+
+    runner.run("results/append/1MiB", "byte", data.size(), [&]() {
+        ResultModel model;
+        for(std::size_t offset = 0; offset < data.size(); offset += 256) {
+            model.beginSegment("Command");
+            model.append(data.data() + offset, 256);
+        }
+        Benchmark::keep(model);
+    });
+
+    ResultModel model;
+    model.beginSegment("Memory");
+    model.append(data.data(), data.size());
+
+    // What a view asks for to paint one screen of rows
+    const int pageRows = 40;
+    int row = 0;
+
+    runner.run("results/format/page", "cell", pageRows * ResultModel::ColumnCount, [&]() {
+        row = (row + 7919) % (model.rowCount() - pageRows);
+        for(int r = row; r < row + pageRows; ++r) {
+            for(int column = 0; column < ResultModel::ColumnCount; ++column) {
+                QVariant value = model.data(model.index(r, column));
+                Benchmark::keep(value);
+            }
+        }
+    });
+
+    runner.run("results/copy/1k-rows", "row", 1000, [&]() {
+        QString text = model.text(0, 999, 0, ResultModel::ColumnCount - 1);
+        Benchmark::keep(text);
+    });
+}
+
+// TRANSACTION DISPATCH AGAINST THE SIMULATED BUS (modeled time is not slept)
+void benchmarkDispatch(Benchmark::Runner& runner)
+{
+    SimulatedTiming timing;
+    timing.realTime = false;
+
+    SimulatedTransport* transport = static_cast<SimulatedTransport*>(I2CTransport::create(true));
+    transport->timing() = timing;
+    transport->open(0);
+
+    const unsigned char single[] = { 0x48 << 1, 0x10 };
+    unsigned char read[2];
+
+    runner.run("dispatch/stream/single", "transaction", 1, [&]() {
+        transport->streamI2C(sizeof(single), single, sizeof(read), read);
+        Benchmark::keep(read);
+    });
+
+    std::vector<I2CTransaction> transactions;
+    for(const Command& command : makeCommands(64))
+        transactions.push_back(command.transaction());
+
+    std::vector<I2CResult> results;
+
+    runner.run("dispatch/batch/64", "transaction", transactions.size(), [&]() {
+        transport->transferBatch(transactions, results);
+        Benchmark::keep(results.data());
+    });
+
+    StreamScheduler scheduler(transport);
+    ScheduleReport report;
+
+    runner.run("dispatch/scheduler/64-reordered", "transaction", transactions.size(), [&]() {
+        scheduler.runBatch(transactions, {}, true, results, report);
+        Benchmark::keep(results.data());
+    });
+
+    // AN INIT SCRIPT WRITING 64 CONSECUTIVE REGISTERS, ONE COMMAND EACH
+    std::vector<I2CTransaction> registerWrites;
+    for(unsigned char reg = 0; reg < 64; ++reg)
+        registerWrites.push_back({ 0x48, { reg, reg }, 0, 1 });
+
+    std::bitset<128> autoIncrement;
+    autoIncrement[0x48] = true;
+
+    runner.run("dispatch/scheduler/64-writes", "transaction", registerWrites.size(), [&]() {
+        scheduler.runBatch(registerWrites, {}, false, results, report);
+        Benchmark::keep(results.data());
+    });
+
+    runner.run("dispatch/scheduler/64-writes-merged", "transaction", registerWrites.size(), [&]() {
+        scheduler.runBatch(registerWrites, {}, false, results, report, autoIncrement);
+        Benchmark::keep(results.data());
+    });
+
+    // 64 SEPARATE TRANSFERS (one register read each at 750 kHz), modeled time
+    // slept so the USB round trips hidden by queueing show up in the timings
+    std::vector<CH341Transfer> transfers;
+    for(unsigned char reg = 0; reg < 64; ++reg) {
+        long speedMode = 3;
+        transfers.push_back(CH341StreamEncoder().encode({ { 0x48, { reg }, 16, 3 } }, speedMode).front());
+    }
+
+    std::vector<std::vector<unsigned char>> readBack(transfers.size());
+    std::vector<unsigned char*> readBuffers;
+    for(std::size_t i = 0; i < transfers.size(); ++i) {
+        readBack[i].resize(transfers[i].inLength);
+        readBuffers.push_back(readBack[i].data());
+    }
+
+    for(std::size_t depth : { 1, 4 }) {
+        SimulatedTransport* queued = static_cast<SimulatedTransport*>(transport->createSibling());
+        queued->timing().realTime = true;
+        queued->timing().queueDepth = depth;
+        queued->open(0);
+
+        runner.run("dispatch/queued/64-transfers-depth-" + std::to_string(depth), "transfer", transfers.size(), [&]() {
+            queued->writeReadQueued(transfers.data(), readBuffers.data(), transfers.size());
+            Benchmark::keep(readBack.data());
+        });
+
+        delete queued;
+    }
+
+    // THROUGH THE DEVICE THREAD, THE WAY THE GUI RUNS COMMANDS (statistics on)
+    QThread thread;
+    DeviceWorker* worker = new DeviceWorker(transport, std::make_shared<TransactionStats>());
+    worker->moveToThread(&thread);
+    QObject::connect(&thread, &QThread::finished, worker, &QObject::deleteLater);
+    thread.start();
+
+    QEventLoop loop;
+    QObject::connect(worker, &DeviceWorker::finished, &loop, &QEventLoop::quit);
+
+    DeviceRequest singleRequest;
+    singleRequest.transactions.push_back({ 0x48, { 0x10 }, 2, 1 });
+
+    runner.run("dispatch/worker/single", "transaction", 1, [&]() {
+        worker->submit(singleRequest);
+        loop.exec();
+    });
+
+    DeviceRequest batchRequest;
+    batchRequest.kind = DeviceRequest::Batch;
+    batchRequest.transactions = transactions;
+
+    runner.run("dispatch/worker/batch-64", "transaction", transactions.size(), [&]() {
+        worker->submit(batchRequest);
+        loop.exec();
+    });
+
+    // Future bookkeeping on top of dispatch/worker/single
+    AsyncDevice device(worker);
+    QEventLoop asyncLoop;
+
+    runner.run("dispatch/async/single", "transaction", 1, [&]() {
+        device.transfer(singleRequest.transactions.front()).then(&asyncLoop, [&asyncLoop](const DeviceResult&) { asyncLoop.quit(); });
+        asyncLoop.exec();
+    });
+
+    // An adapter that drops off the bus and is back at once: the failed transfer, reopening and running the request again
+    worker->setAutoReconnect(std::chrono::seconds(1));
+
+    runner.run("dispatch/worker/single-after-unplug", "transaction", 1, [&]() {
+        transport->unplug(std::chrono::nanoseconds(0));
+        worker->submit(singleRequest);
+        loop.exec();
+    });
+
+    thread.quit();
+    thread.wait();
+
+    delete transport;
+}
+
+void benchmarkSequences(Benchmark::Runner& runner)
+{
+    SimulatedTiming timing;
+    timing.realTime = false;
+
+    SimulatedTransport* transport = static_cast<SimulatedTransport*>(I2CTransport::create(true));
+    transport->timing() = timing;
+    transport->open(0);
+
+    const QString source =
+        "speed 400k\n"
+        "loop 64\n"
+        "  read 0x48 2 0x10\n"
+        "  assert [0] & 0x80 == 0\n"
+        "end\n";
+
+    CommandModel commands;
+    SequenceProgram program;
+
+    runner.run("sequence/compile", "line", 5, [&]() {
+        Sequences::compile(source, commands, program);
+        Benchmark::keep(program.code.data());
+    });
+
+    // Interpreter overhead on top of dispatch/stream/single
+    SequenceRunner sequence(transport);
+    std::vector<I2CResult> results;
+
+    runner.run("sequence/run/loop-64", "transaction", 64, [&]() {
+        sequence.run(program, results);
+        Benchmark::keep(results.data());
+    });
+
+    // AN EEPROM PAGE WRITE, THEN A READ ACK POLLING THROUGH ITS WRITE CYCLE
+    const I2CTransaction pageWrite = { 0x50, std::vector<unsigned char>(2 + 64, 0xA5), 0, 3 };
+    const I2CTransaction readBack = { 0x50, { 0x00, 0x00 }, 64, 3 };
+
+    RetryPolicy poll;
+    RetryPolicy::parse("poll 20ms", poll);
+
+    runner.run("retry/eeprom-write-poll", "transaction", 2, [&]() {
+        I2CResult result;
+        transport->runTransaction(pageWrite, result);
+        poll.run(transport, readBack, [&](I2CResult& attempt) { return transport->runTransaction(readBack, attempt); }, result);
+        Benchmark::keep(result.read.data());
+    });
+
+    delete transport;
+}
+
+void benchmarkRegisterCache(Benchmark::Runner& runner)
+{
+    RegisterCache::Device device;
+    device.address = 0x48;
+    device.cached.set();
+
+    RegisterCache cache;
+    cache.configure({ device });
+
+    std::vector<I2CTransaction> reads;
+    for(unsigned char reg = 0; reg < 64; ++reg)
+        reads.push_back({ 0x48, { reg }, 1, 1 });
+
+    // Fill the shadow once, every later plan is served without touching the bus
+    std::vector<I2CResult> results(reads.size());
+    for(I2CResult& result : results) {
+        result.acked = true;
+        result.batched = 1;
+        result.read = { 0x00 };
+    }
+
+    std::vector<std::size_t> origin;
+    std::vector<I2CResult> served;
+    cache.complete(cache.plan(reads, served, origin), origin, results);
+
+    runner.run("cache/plan/hit-64", "transaction", 64, [&]() {
+        std::vector<I2CTransaction> bus = cache.plan(reads, served, origin);
+        Benchmark::keep(bus.data());
+        Benchmark::keep(served.data());
+    });
+}
+
+void benchmarkTraces(Benchmark::Runner& runner, const QString& directory)
+{
+    SimulatedTiming timing;
+    timing.realTime = false;
+
+    SimulatedTransport* transport = static_cast<SimulatedTransport*>(I2CTransport::create(true));
+    transport->timing() = timing;
+    transport->open(0);
+
+    // Cost added to every transaction while recording
+    I2CTransaction transaction = { 0x48, { 0x10 }, 2, 1 };
+    I2CResult result = { true, { 0x12, 0x34 }, 1000, 1 };
+
+    TraceWriter appendTrace;
+    appendTrace.open(directory + "/append." + TraceWriter::suffix);
+
+    runner.run("trace/append", "transaction", 1, [&]() {
+        appendTrace.append(0, transaction, result);
+    });
+
+    appendTrace.close();
+
+    // 64 recorded commands, replayed as fast as possible
+    QString path = directory + "/replay." + TraceWriter::suffix;
+    std::vector<I2CTransaction> transactions;
+    std::vector<I2CResult> results;
+
+    for(const Command& command : makeCommands(64))
+        transactions.push_back(command.transaction());
+
+    transport->transferBatch(transactions, results);
+
+    {
+        TraceWriter trace;
+        trace.open(path);
+
+        for(std::size_t i = 0; i < transactions.size(); ++i)
+            trace.append(0, transactions[i], results[i]);
+    }
+
+    TraceReader trace;
+    trace.open(path);
+    TraceReplay replay(transport);
+
+    runner.run("trace/replay/64", "transaction", transactions.size(), [&]() {
+        replay.run(trace, TraceReplay::AsFastAsPossible);
+        Benchmark::keep(&replay.report());
+    });
+
+    delete transport;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks the CH341 I2C Tool's hot paths, one JSON line per benchmark.");
+    parser.addHelpOption();
+
+    QCommandLineOption filterOption({ "f", "filter" }, "Only run benchmarks whose name contains text.", "text");
+    QCommandLineOption timeOption({ "t", "min-time" }, "Seconds to run each benchmark for (default 0.5).", "seconds", "0.5");
+    parser.addOptions({ filterOption, timeOption });
+    parser.process(a);
+
+    bool ok;
+    double minTime = parser.value(timeOption).toDouble(&ok);
+
+    if(!ok || minTime < 0) {
+        std::fprintf(stderr, "Invalid time \"%s\"\n", qPrintable(parser.value(timeOption)));
+        return 2;
+    }
+
+    QTemporaryDir directory;
+
+    if(!directory.isValid()) {
+        std::fprintf(stderr, "Failed to create a temporary directory\n");
+        return 2;
+    }
+
+    std::printf("{\"schema\":1,\"suite\":\"ch341-i2c-tool\",\"qt\":\"%s\"}\n", qVersion());
+
+    Benchmark::Runner runner(parser.value(filterOption).toStdString(), minTime);
+
+    benchmarkParsing(runner);
+    benchmarkLibraries(runner, directory.path());
+    benchmarkCommands(runner);
+    benchmarkResults(runner);
+    benchmarkDispatch(runner);
+    benchmarkSequences(runner);
+    benchmarkRegisterCache(runner);
+    benchmarkTraces(runner, directory.path());
+
+    if(runner.count() == 0) {
+        std::fprintf(stderr, "No benchmark matches \"%s\"\n", qPrintable(parser.value(filterOption)));
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,243 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "blocktransfer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+
+#include "i2ctransport.h"
+
+namespace {
+
+// Read back of one round stays well within a 4096 byte transfer even with two
+// status bytes per 256 byte chunk (1 address byte memories)
+const std::size_t readRoundLength = 2048;
+
+// Largest chunk one memory transaction may cover starting at offset
+std::size_t chunkLength(const MemoryLayout& layout, std::size_t offset, std::size_t length, bool writing)
+{
+    if(writing)
+        length = std::min(length, layout.pageSize - offset % layout.pageSize);
+
+    if(layout.addressBytes == 1) // The device address changes every 256 bytes
+        length = std::min<std::size_t>(length, 256 - offset % 256);
+
+    return length;
+}
+
+}
+
+BlockTransfer::BlockTransfer(I2CTransport* transport, std::chrono::milliseconds ackTimeout)
+    : transport(transport), ackTimeout(ackTimeout)
+{
+}
+
+I2CTransaction BlockTransfer::addressed(const MemoryLayout& layout, std::size_t offset)
+{
+    I2CTransaction transaction = { layout.address, {}, 0, layout.speedMode };
+
+    if(layout.addressBytes == 1) {
+        transaction.address |= (offset >> 8) & 0x07;
+        transaction.write.push_back(offset & 0xFF);
+    }
+    else {
+        transaction.write.push_back((offset >> 8) & 0xFF);
+        transaction.write.push_back(offset & 0xFF);
+    }
+
+    return transaction;
+}
+
+BlockTransfer::Round BlockTransfer::encode(const MemoryLayout& layout, std::size_t offset, std::size_t length,
+                                           const unsigned char* data, long speedMode)
+{
+    Round round;
+    round.offset = offset;
+    round.length = length;
+
+    std::vector<I2CTransaction> transactions;
+
+    while(length != 0) {
+        std::size_t chunk = chunkLength(layout, offset, length, data != nullptr);
+        I2CTransaction transaction = BlockTransfer::addressed(layout, offset);
+
+        if(data)
+            transaction.write.insert(transaction.write.end(), data, data + chunk);
+        else
+            transaction.readLength = chunk;
+
+        transactions.push_back(std::move(transaction));
+
+        offset += chunk;
+        length -= chunk;
+
+        if(data)
+            data += chunk;
+    }
+
+    round.transfers = CH341StreamEncoder().encode(transactions, speedMode);
+    round.speedMode = speedMode;
+
+    return round;
+}
+
+bool BlockTransfer::read(const MemoryLayout& layout, std::size_t offset, std::size_t length, unsigned char* buffer,
+                         const Progress& progress)
+{
+    return this->run(layout, offset, length, nullptr, buffer, progress);
+}
+
+bool BlockTransfer::write(const MemoryLayout& layout, std::size_t offset, const unsigned char* data, std::size_t length,
+                          const Progress& progress)
+{
+    return this->run(layout, offset, length, data, nullptr, progress);
+}
+
+bool BlockTransfer::run(const MemoryLayout& layout, std::size_t offset, std::size_t length,
+                        const unsigned char* data, unsigned char* buffer, const Progress& progress)
+{
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start = Clock::now();
+
+    this->lastError.clear();
+    this->state = BlockProgress();
+    this->state.total = length;
+
+    if(layout.addressBytes != 1 && layout.addressBytes != 2) {
+        this->lastError = "Memory addressing must be 1 or 2 bytes";
+        return false;
+    }
+
+    if(data && layout.pageSize == 0) {
+        this->lastError = "Page size must not be 0";
+        return false;
+    }
+
+    // A round is one page for writes, and up to readRoundLength bytes for reads
+    auto roundLength = [&](std::size_t at, std::size_t remaining) {
+        return data ? chunkLength(layout, at, remaining, true) : std::min(remaining, readRoundLength);
+    };
+
+    auto encodeNext = [&](std::size_t at, long speedMode) {
+        std::size_t remaining = length - (at - offset);
+        const unsigned char* roundData = data ? data + (at - offset) : nullptr;
+
+        return std::async(std::launch::async, &BlockTransfer::encode, layout, at, roundLength(at, remaining),
+                          roundData, speedMode);
+    };
+
+    std::future<Round> next;
+    if(length != 0)
+        next = encodeNext(offset, this->transport->currentStreamMode());
+
+    std::vector<I2CResult> results;
+
+    while(next.valid()) {
+        Round round = next.get();
+
+        // ENCODE THE NEXT ROUND WHILE THIS ONE IS ON THE WIRE
+        std::size_t end = round.offset + round.length;
+        if(end < offset + length)
+            next = encodeNext(end, round.speedMode);
+
+        // RUN THIS ROUND, RESENDING IT WHILE THE MEMORY NACKS (WRITE CYCLE IN PROGRESS)
+        Clock::time_point firstAttempt = Clock::now();
+
+        for(;;) {
+            results.clear();
+
+            bool acked = true;
+            for(const CH341Transfer& transfer : round.transfers) {
+                if(!this->transport->runTransfer(transfer, round.speedMode, results)) {
+                    this->lastError = "Failed to transfer memory block";
+                    return false;
+                }
+            }
+
+            for(const I2CResult& result : results)
+                acked = acked && result.acked;
+
+            if(acked)
+                break;
+
+            if(Clock::now() - firstAttempt > this->ackTimeout) {
+                this->lastError = "Memory did not acknowledge";
+                return false;
+            }
+
+            ++this->state.ackPolls;
+        }
+
+        // THE LAST PAGE IS ONLY WRITTEN ONCE ITS WRITE CYCLE IS OVER
+        if(data && end == offset + length && !this->waitWriteCycle(layout, end - 1))
+            return false;
+
+        if(buffer) {
+            unsigned char* out = buffer + (round.offset - offset);
+
+            for(const I2CResult& result : results) {
+                std::memcpy(out, result.read.data(), result.read.size());
+                out += result.read.size();
+            }
+        }
+
+        this->state.done += round.length;
+        this->state.elapsed = Clock::now() - start;
+
+        if(progress && !progress(this->state)) {
+            this->lastError = "Cancelled";
+            return false;
+        }
+    }
+
+    this->state.elapsed = Clock::now() - start;
+
+    return true;
+}
+
+bool BlockTransfer::waitWriteCycle(const MemoryLayout& layout, std::size_t offset)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // An empty write to the memory's address, only acknowledged once the write cycle is over
+    long speedMode = this->transport->currentStreamMode();
+    std::vector<CH341Transfer> probe = CH341StreamEncoder().encode({ { BlockTransfer::addressed(layout, offset).address, {}, 0,
+                                                                       layout.speedMode } }, speedMode);
+    std::vector<I2CResult> results;
+    Clock::time_point firstAttempt = Clock::now();
+
+    for(;;) {
+        results.clear();
+
+        if(!this->transport->runTransfer(probe.front(), speedMode, results)) {
+            this->lastError = "Failed to transfer memory block";
+            return false;
+        }
+
+        if(!results.empty() && results.front().acked)
+            return true;
+
+        if(Clock::now() - firstAttempt > this->ackTimeout) {
+            this->lastError = "Memory did not finish its write cycle";
+            return false;
+        }
+
+        ++this->state.ackPolls;
+    }
+}
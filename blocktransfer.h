@@ -0,0 +1,95 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef BLOCKTRANSFER_H
+#define BLOCKTRANSFER_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ch341stream.h"
+
+class I2CTransport;
+
+// 24Cxx style memory. With 1 address byte, address bits 8-10 go into the low
+// bits of the device address (24C04-24C16).
+struct MemoryLayout {
+    unsigned char address = 0x50;       // 7 bit address
+    int addressBytes = 2;               // 1 or 2
+    std::size_t pageSize = 128;         // Writes never cross a page boundary
+    unsigned long speedMode = 1;
+};
+
+struct BlockProgress {
+    std::size_t done = 0;               // Bytes
+    std::size_t total = 0;
+    std::size_t ackPolls = 0;           // Transfers repeated because the memory was still busy
+    std::chrono::nanoseconds elapsed{0};
+
+    double bytesPerSecond() const { return this->elapsed.count() ? this->done * 1e9 / this->elapsed.count() : 0; }
+};
+
+// Reads and writes memory ranges of any size. Reads go out in chunks of
+// roughly a full USB transfer, writes one page at a time. While one transfer
+// is on the wire the next one is encoded on a helper thread. A NACKed
+// transfer is resent (ACK polling) until the memory finishes its write cycle
+// or ackTimeout runs out. A write only completes once the memory acknowledges
+// its address again after the last page, so it is ready for whatever comes next.
+class BlockTransfer
+{
+public:
+    // Called after every transfer, return false to abort
+    using Progress = std::function<bool(const BlockProgress&)>;
+
+    explicit BlockTransfer(I2CTransport* transport,
+                           std::chrono::milliseconds ackTimeout = std::chrono::milliseconds(100));
+
+    bool read(const MemoryLayout& layout, std::size_t offset, std::size_t length, unsigned char* buffer,
+              const Progress& progress = Progress());
+    bool write(const MemoryLayout& layout, std::size_t offset, const unsigned char* data, std::size_t length,
+               const Progress& progress = Progress());
+
+    const std::string& error() const { return this->lastError; }
+    const BlockProgress& report() const { return this->state; }
+
+    // The memory transaction addressing offset, without any data/read length
+    static I2CTransaction addressed(const MemoryLayout& layout, std::size_t offset);
+
+private:
+    struct Round {
+        std::size_t offset = 0;
+        std::size_t length = 0;
+        std::vector<CH341Transfer> transfers;
+        long speedMode = -1;            // Mode the transfers leave the device in
+    };
+
+    I2CTransport* transport;
+    std::chrono::milliseconds ackTimeout;
+    std::string lastError;
+    BlockProgress state;
+
+    bool run(const MemoryLayout& layout, std::size_t offset, std::size_t length,
+             const unsigned char* data, unsigned char* buffer, const Progress& progress);
+    // Probes the memory holding offset until it acknowledges (write cycle over) or ackTimeout runs out
+    bool waitWriteCycle(const MemoryLayout& layout, std::size_t offset);
+    static Round encode(const MemoryLayout& layout, std::size_t offset, std::size_t length,
+                        const unsigned char* data, long speedMode);
+};
+
+#endif // BLOCKTRANSFER_H
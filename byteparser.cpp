@@ -0,0 +1,43 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "byteparser.h"
+
+std::string ByteParser::toBinary(unsigned value, int digits)
+{
+    std::string text(digits, '0');
+
+    for(int i = digits - 1; i >= 0; --i, value >>= 1)
+        text[i] = '0' + (value & 1);
+
+    return text;
+}
+
+std::string ByteParser::toBinary(const unsigned char* bytes, std::size_t length)
+{
+    std::string text;
+    text.reserve(length * 9);
+
+    for(std::size_t i = 0; i < length; ++i) {
+        if(i != 0)
+            text += ' ';
+
+        for(int bit = 7; bit >= 0; --bit)
+            text += '0' + ((bytes[i] >> bit) & 1);
+    }
+
+    return text;
+}
@@ -0,0 +1,153 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef BYTEPARSER_H
+#define BYTEPARSER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Byte input as typed by the user. Tokens are separated by whitespace or
+// commas and may be written as
+//   bare binary   101, 00000101   (the tool's original notation)
+//   0b binary     0b101
+//   0x hex        0x05
+//   0d decimal    0d5
+// Everything runs in a single pass over the text without allocating per
+// token, and works on both char and char16_t (QString::utf16()) text.
+namespace ByteParser {
+
+struct Error {
+    std::size_t position = 0;           // Offending token in the text
+    std::size_t length = 0;
+};
+
+template<typename Char>
+inline bool isSpace(Char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+template<typename Char>
+inline bool isSeparator(Char c)
+{
+    return isSpace(c) || c == ',';
+}
+
+template<typename Char>
+inline int digitValue(Char c)
+{
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return -1;
+}
+
+// Parses exactly one token, false if it is malformed or above max
+template<typename Char>
+bool parseValue(const Char* text, std::size_t length, unsigned max, unsigned& value)
+{
+    unsigned base = 2;
+    std::size_t i = 0;
+
+    if(length > 2 && text[0] == '0') {
+        switch(text[1]) {
+            case 'x': case 'X': base = 16; i = 2; break;
+            case 'd': case 'D': base = 10; i = 2; break;
+            case 'b': case 'B': base = 2;  i = 2; break;
+        }
+    }
+
+    if(i == length)
+        return false;
+
+    value = 0;
+
+    for(; i < length; ++i) {
+        int digit = digitValue(text[i]);
+
+        if(digit < 0 || digit >= (int)base)
+            return false;
+
+        value = value * base + digit;
+
+        if(value > max)
+            return false;
+    }
+
+    return true;
+}
+
+// Same as parseValue, but ignores surrounding whitespace
+template<typename Char>
+bool parseValueTrimmed(const Char* text, std::size_t length, unsigned max, unsigned& value)
+{
+    while(length != 0 && isSpace(text[length - 1]))
+        --length;
+
+    std::size_t start = 0;
+    while(start < length && isSpace(text[start]))
+        ++start;
+
+    return parseValue(text + start, length - start, max, value);
+}
+
+// Appends every byte in the text to out. On failure out holds the bytes
+// before the offending token and error (if given) points at it.
+template<typename Char>
+bool parse(const Char* text, std::size_t length, std::vector<unsigned char>& out, Error* error = nullptr)
+{
+    out.reserve(out.size() + (length + 1) / 2); // Upper bound, single digit tokens
+
+    std::size_t i = 0;
+
+    for(;;) {
+        while(i < length && isSeparator(text[i]))
+            ++i;
+
+        if(i == length)
+            return true;
+
+        std::size_t start = i;
+        while(i < length && !isSeparator(text[i]))
+            ++i;
+
+        unsigned value;
+        if(!parseValue(text + start, i - start, 0xFF, value)) {
+            if(error) {
+                error->position = start;
+                error->length = i - start;
+            }
+
+            return false;
+        }
+
+        out.push_back((unsigned char)value);
+    }
+}
+
+// Zero padded binary, the form commands are stored in
+std::string toBinary(unsigned value, int digits);
+std::string toBinary(const unsigned char* bytes, std::size_t length);
+
+}
+
+#endif // BYTEPARSER_H
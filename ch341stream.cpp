@@ -0,0 +1,232 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ch341stream.h"
+
+#include <algorithm>
+
+namespace {
+
+const std::size_t maxCommandLength = 63;
+
+// Appends stream commands to a transfer, starting a new packet whenever the
+// next command (or its read back) would not fit into the current one
+class TransferBuilder
+{
+public:
+    explicit TransferBuilder(CH341Transfer& transfer) : transfer(&transfer) {}
+
+    void restart(CH341Transfer& transfer) {
+        this->transfer = &transfer;
+        this->packetIn = 0;
+    }
+
+    struct Mark {
+        std::size_t outLength, inLength, inPackets, slices, packetIn;
+    };
+
+    Mark mark() const {
+        return { this->transfer->out.size(), this->transfer->inLength, this->transfer->inPackets,
+                 this->transfer->slices.size(), this->packetIn };
+    }
+
+    void rollback(const Mark& mark) {
+        this->transfer->out.resize(mark.outLength);
+        this->transfer->inLength = mark.inLength;
+        this->transfer->inPackets = mark.inPackets;
+        this->transfer->slices.resize(mark.slices);
+        this->packetIn = mark.packetIn;
+    }
+
+    void command(unsigned char command) {
+        this->reserve(1, 0);
+        this->transfer->out.push_back(command);
+    }
+
+    // Writes a single byte and returns the offset of its ACK status in the read back
+    std::size_t writeChecked(unsigned char byte) {
+        this->reserve(2, 1);
+        this->transfer->out.push_back(CH341_STM_OUT);
+        this->transfer->out.push_back(byte);
+
+        return this->transfer->inLength++;
+    }
+
+    void write(const unsigned char* data, std::size_t length) {
+        while(length != 0) {
+            this->reserve(2, 0);
+
+            std::size_t count = std::min({ length, CH341_PACKET_LENGTH - this->position() - 1, maxCommandLength });
+
+            this->transfer->out.push_back(CH341_STM_OUT | count);
+            this->transfer->out.insert(this->transfer->out.end(), data, data + count);
+
+            data += count;
+            length -= count;
+        }
+    }
+
+    // Returns the offset of the read data in the read back
+    std::size_t read(std::size_t length) {
+        std::size_t offset = this->transfer->inLength;
+        std::size_t acked = length - 1; // The last byte is NACKed to end the read
+
+        while(acked != 0) {
+            this->reserve(1, 1);
+
+            std::size_t count = std::min({ acked, CH341_PACKET_LENGTH - this->packetIn + 1, maxCommandLength });
+
+            this->transfer->out.push_back(CH341_STM_IN | count);
+            this->packetIn += count - 1;
+            this->transfer->inLength += count;
+
+            acked -= count;
+        }
+
+        this->reserve(1, 1);
+        this->transfer->out.push_back(CH341_STM_IN);
+        ++this->transfer->inLength;
+
+        return offset;
+    }
+
+    void finish() {
+        if(this->position() != 0)
+            this->transfer->out.push_back(CH341_STM_END);
+    }
+
+private:
+    CH341Transfer* transfer;
+    std::size_t packetIn = 0; // Read back bytes produced by the current packet
+
+    std::size_t position() const { return this->transfer->out.size() % CH341_PACKET_LENGTH; }
+
+    void reserve(std::size_t outBytes, std::size_t inBytes) {
+        if(this->position() != 0 && (this->position() + outBytes > CH341_PACKET_LENGTH ||
+                                     this->packetIn + inBytes > CH341_PACKET_LENGTH)) {
+            // END, then pad out the rest of the packet
+            this->transfer->out.resize(this->transfer->out.size() + CH341_PACKET_LENGTH - this->position(), CH341_STM_END);
+        }
+
+        if(this->position() == 0) {
+            this->transfer->out.push_back(CH341_CMD_I2C_STREAM);
+            this->packetIn = 0;
+        }
+
+        if(inBytes != 0 && this->packetIn == 0)
+            ++this->transfer->inPackets;
+
+        this->packetIn += inBytes;
+    }
+};
+
+void encodeTransaction(TransferBuilder& builder, CH341Transfer& transfer, const I2CTransaction& transaction,
+                       std::size_t index, long& speedMode)
+{
+    if(speedMode != (long)transaction.speedMode) {
+        builder.command(CH341_STM_SET | (transaction.speedMode & 0x03));
+        speedMode = transaction.speedMode;
+    }
+
+    CH341Slice slice = { index, 0, 0, 0, transaction.readLength };
+    bool writing = !transaction.write.empty() || transaction.readLength == 0;
+
+    builder.command(CH341_STM_STA);
+
+    if(writing) {
+        slice.statusOffset = builder.writeChecked(transaction.address << 1);
+        ++slice.statusCount;
+
+        builder.write(transaction.write.data(), transaction.write.size());
+    }
+
+    if(transaction.readLength != 0) {
+        if(writing)
+            builder.command(CH341_STM_STA); // Repeated START
+
+        std::size_t statusOffset = builder.writeChecked((transaction.address << 1) | 1);
+        if(slice.statusCount++ == 0)
+            slice.statusOffset = statusOffset;
+
+        slice.readOffset = builder.read(transaction.readLength);
+    }
+
+    builder.command(CH341_STM_STO);
+
+    transfer.slices.push_back(slice);
+}
+
+}
+
+CH341StreamEncoder::CH341StreamEncoder(std::size_t maxTransferLength)
+    : maxTransferLength(maxTransferLength)
+{
+}
+
+std::vector<CH341Transfer> CH341StreamEncoder::encode(const std::vector<I2CTransaction>& transactions, long& speedMode) const
+{
+    std::vector<CH341Transfer> transfers(1);
+    TransferBuilder builder(transfers.back());
+
+    for(std::size_t i = 0; i < transactions.size(); ++i) {
+        TransferBuilder::Mark mark = builder.mark();
+        long previousSpeedMode = speedMode;
+
+        encodeTransaction(builder, transfers.back(), transactions[i], i, speedMode);
+
+        const CH341Transfer& transfer = transfers.back();
+        if((transfer.out.size() < this->maxTransferLength && transfer.inLength <= this->maxTransferLength) || mark.slices == 0)
+            continue;
+
+        // Did not fit, move the whole transaction into a new transfer
+        builder.rollback(mark);
+        builder.finish();
+        speedMode = previousSpeedMode;
+
+        transfers.emplace_back();
+        builder.restart(transfers.back());
+
+        encodeTransaction(builder, transfers.back(), transactions[i], i, speedMode);
+    }
+
+    builder.finish();
+
+    if(transfers.back().slices.empty())
+        transfers.pop_back();
+
+    return transfers;
+}
+
+void CH341StreamEncoder::decode(const CH341Transfer& transfer, const unsigned char* in, std::vector<I2CResult>& results)
+{
+    for(const CH341Slice& slice : transfer.slices) {
+        if(results.size() <= slice.transaction)
+            results.resize(slice.transaction + 1);
+
+        I2CResult& result = results[slice.transaction];
+
+        // The read address status (if any) directly precedes the read data
+        result.acked = true;
+        for(std::size_t i = 0; i < slice.statusCount; ++i) {
+            std::size_t offset = i == 0 ? slice.statusOffset : slice.readOffset - 1;
+
+            if(in[offset] & CH341_STATUS_NACK)
+                result.acked = false;
+        }
+
+        result.read.assign(in + slice.readOffset, in + slice.readOffset + slice.readLength);
+    }
+}
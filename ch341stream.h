@@ -0,0 +1,98 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef CH341STREAM_H
+#define CH341STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CH341 I2C STREAM PROTOCOL
+// Every 32 byte USB packet starts with CH341_CMD_I2C_STREAM followed by stream
+// commands. A command never crosses a packet boundary, CH341_STM_END (or the
+// end of the packet) terminates it.
+const unsigned char CH341_CMD_I2C_STREAM = 0xAA;
+
+const unsigned char CH341_STM_STA = 0x74; // START
+const unsigned char CH341_STM_STO = 0x75; // STOP
+const unsigned char CH341_STM_OUT = 0x80; // | length (1-63): write bytes. Zero length writes one byte and returns its ACK status
+const unsigned char CH341_STM_IN  = 0xC0; // | length (1-63): read ACKed bytes. Zero length reads one NACKed byte
+const unsigned char CH341_STM_SET = 0x60; // | speed mode (0-3)
+const unsigned char CH341_STM_US  = 0x40; // | microseconds (0-15): delay
+const unsigned char CH341_STM_END = 0x00;
+
+const unsigned char CH341_STATUS_NACK = 0x80; // Set in an ACK status byte when the byte was not acknowledged
+
+const std::size_t CH341_PACKET_LENGTH = 32;
+const std::size_t CH341_MAX_TRANSFER_LENGTH = 4096; // CH341DLL mMAX_BUFFER_LENGTH
+
+struct I2CTransaction {
+    unsigned char address;              // 7 bit address
+    std::vector<unsigned char> write;   // Bytes written after the address, including any register address
+    std::size_t readLength;
+    unsigned long speedMode;
+
+    // Bytes clocked over the bus, address bytes included
+    std::size_t busBytes() const {
+        bool writing = !this->write.empty() || this->readLength == 0;
+        return (writing ? 1 + this->write.size() : 0) + (this->readLength != 0 ? 1 + this->readLength : 0);
+    }
+};
+
+struct I2CResult {
+    bool acked;
+    std::vector<unsigned char> read;
+    std::int64_t elapsed = 0;           // Nanoseconds of the USB call that carried the transaction
+    std::size_t batched = 0;            // Transactions carried by that call, 0 if it never ran
+    std::size_t retries = 0;            // Attempts after the first one, see RetryPolicy
+    std::int64_t waited = 0;            // Nanoseconds from the first attempt until the last one started
+};
+
+// Where a transaction's ACK status bytes and read data land in a transfer's read buffer
+struct CH341Slice {
+    std::size_t transaction;
+    std::size_t statusOffset, statusCount;
+    std::size_t readOffset, readLength;
+};
+
+// One USB bulk OUT transfer along with the length of the read back it produces
+struct CH341Transfer {
+    std::vector<unsigned char> out;
+    std::size_t inLength = 0;
+    std::size_t inPackets = 0;          // Number of OUT packets that produce read back data
+    std::vector<CH341Slice> slices;
+};
+
+class CH341StreamEncoder
+{
+public:
+    explicit CH341StreamEncoder(std::size_t maxTransferLength = CH341_MAX_TRANSFER_LENGTH);
+
+    // Packs the transactions into as few transfers as possible. speedMode is
+    // the mode the device is currently in (-1 if unknown); a STM_SET is only
+    // emitted when a transaction needs a different one. It is updated to the
+    // mode the device is left in.
+    std::vector<CH341Transfer> encode(const std::vector<I2CTransaction>& transactions, long& speedMode) const;
+
+    // Splits a transfer's read back into per transaction results
+    static void decode(const CH341Transfer& transfer, const unsigned char* in, std::vector<I2CResult>& results);
+
+private:
+    std::size_t maxTransferLength;
+};
+
+#endif // CH341STREAM_H
@@ -0,0 +1,112 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "ch341transport.h"
+
+#include <windows.h>
+
+#include "CH341DLL_EN.H"
+
+CH341Transport::~CH341Transport()
+{
+    this->close();
+}
+
+bool CH341Transport::open(unsigned long deviceNum)
+{
+    this->close();
+
+    HANDLE result = CH341OpenDevice(deviceNum);
+
+    if((INT64)result < 0)
+        return false;
+
+    // The device path holds the USB port the adapter is plugged into
+    const char* path = (const char*)CH341GetDeviceName(deviceNum);
+
+    this->device = deviceNum;
+    this->devicePath = path ? path : "";
+    this->opened = true;
+    this->streamMode = -1;
+
+    return true;
+}
+
+void CH341Transport::close()
+{
+    if(!this->opened)
+        return;
+
+    CH341CloseDevice(this->device);
+    this->opened = false;
+    this->streamMode = -1;
+}
+
+std::string CH341Transport::locationOf(unsigned long deviceNum) const
+{
+    // Answered from the device list, without a handle
+    const char* path = (const char*)CH341GetDeviceName(deviceNum);
+
+    return path ? path : "";
+}
+
+bool CH341Transport::isAttached() const
+{
+    // Reading the chip version fails once the handle went stale
+    return this->opened && CH341GetVerIC(this->device) != 0;
+}
+
+bool CH341Transport::setStream(unsigned long speedMode)
+{
+    bool result = CH341SetStream(this->device, speedMode & 0x03);
+    this->streamMode = result ? (long)(speedMode & 0x03) : -1;
+
+    return result;
+}
+
+bool CH341Transport::streamI2C(std::size_t writeLength, const unsigned char* writeBuffer,
+                               std::size_t readLength, unsigned char* readBuffer)
+{
+    return CH341StreamI2C(this->device, (ULONG)writeLength, (PVOID)writeBuffer, (ULONG)readLength, readBuffer);
+}
+
+bool CH341Transport::writeRead(const CH341Transfer& transfer, unsigned char* readBuffer)
+{
+    if(transfer.inLength == 0) {
+        ULONG length = (ULONG)transfer.out.size();
+
+        return CH341WriteData(this->device, (PVOID)transfer.out.data(), &length) && length == transfer.out.size();
+    }
+
+    // Every packet with IN commands is answered by one read back packet
+    ULONG length = 0;
+
+    if(!CH341WriteRead(this->device, (ULONG)transfer.out.size(), (PVOID)transfer.out.data(),
+                       CH341_PACKET_LENGTH, (ULONG)transfer.inPackets, &length, readBuffer))
+        return false;
+
+    return length == transfer.inLength;
+}
+
+unsigned long CH341Transport::driverVersion() const
+{
+    return CH341GetDrvVersion();
+}
+
+unsigned long CH341Transport::libraryVersion() const
+{
+    return CH341GetVersion();
+}
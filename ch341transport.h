@@ -0,0 +1,45 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef CH341TRANSPORT_H
+#define CH341TRANSPORT_H
+
+#include "i2ctransport.h"
+
+// Transport backed by the vendor CH341DLL (Windows only)
+class CH341Transport : public I2CTransport
+{
+public:
+    ~CH341Transport();
+
+    const char* name() const override { return "CH341DLL"; }
+    I2CTransport* createSibling() const override { return new CH341Transport; }
+
+    bool open(unsigned long deviceNum) override;
+    void close() override;
+    std::string locationOf(unsigned long deviceNum) const override;
+    bool isAttached() const override;
+
+    bool setStream(unsigned long speedMode) override;
+    bool streamI2C(std::size_t writeLength, const unsigned char* writeBuffer,
+                   std::size_t readLength, unsigned char* readBuffer) override;
+    bool writeRead(const CH341Transfer& transfer, unsigned char* readBuffer) override;
+
+    unsigned long driverVersion() const override;
+    unsigned long libraryVersion() const override;
+};
+
+#endif // CH341TRANSPORT_H
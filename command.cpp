@@ -0,0 +1,49 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "command.h"
+
+#include "byteparser.h"
+
+std::string Command::addressText() const
+{
+    return ByteParser::toBinary(this->address, 7);
+}
+
+std::string Command::registerText() const
+{
+    return this->hasRegister ? ByteParser::toBinary(this->registerAddress(), 8) : std::string();
+}
+
+std::string Command::dataText() const
+{
+    return ByteParser::toBinary(this->data(), this->dataLength());
+}
+
+QStringList Command::splitTags(const QString& text)
+{
+    QStringList tags;
+
+    for(QString tag : QString(text).replace(',', ' ').split(' ', Qt::SkipEmptyParts)) {
+        if(tag.startsWith('#'))
+            tag.remove(0, 1);
+
+        if(!tag.isEmpty() && !tags.contains(tag, Qt::CaseInsensitive))
+            tags.append(tag);
+    }
+
+    return tags;
+}
@@ -0,0 +1,55 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <string>
+#include <vector>
+#include <QString>
+#include <QStringList>
+
+#include "ch341stream.h"
+#include "retrypolicy.h"
+
+// A saved command, kept in the form it goes onto the bus in. The textual
+// (binary digit) form is only produced for display and CSV files.
+struct Command {
+    QString name;
+    unsigned char address = 0;              // 7 bit address
+    bool hasRegister = false;
+    std::vector<unsigned char> write;       // Register address (if any) followed by the data
+    int readLength = 0;
+    unsigned long speedMode = 1;
+    QStringList tags;
+    RetryPolicy retry;                      // When the command runs on its own or in a sequence
+
+    unsigned char registerAddress() const { return this->hasRegister ? this->write[0] : 0; }
+    const unsigned char* data() const { return this->write.data() + this->hasRegister; }
+    std::size_t dataLength() const { return this->write.size() - this->hasRegister; }
+
+    I2CTransaction transaction() const { return { this->address, this->write, (std::size_t)this->readLength, this->speedMode }; }
+
+    // Zero padded binary, as entered in the main window and stored in CSV files
+    std::string addressText() const;
+    std::string registerText() const;       // Empty without a register
+    std::string dataText() const;
+
+    // Space separated, a leading '#' is dropped and commas are not allowed (they would end the CSV field)
+    static QStringList splitTags(const QString& text);
+};
+
+#endif // COMMAND_H
@@ -0,0 +1,412 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "commandcsv.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <thread>
+#include <QFile>
+
+#include "byteparser.h"
+#include "commandmodel.h"
+
+namespace CommandCsv {
+
+const char* const titleLine = "Command Name,Device Address (7 bits),Register Address,\"Write Data (space separated, <1023 bytes including register address)\",Read Length (<1024 bytes),Speed Mode (0-3),Tags (space separated),Retry (e.g. poll 10ms)";
+
+}
+
+namespace {
+
+const std::size_t fieldCount = 8;           // The last two (tags, retry) are optional
+const std::size_t rowsPerChunk = 4096;
+
+struct Row {
+    const char* begin;
+    const char* end;
+};
+
+struct Field {
+    const char* data = nullptr;
+    std::size_t length = 0;
+    std::string unquoted;                   // Backing store of quoted fields with doubled quotes
+
+    bool empty() const { return this->length == 0; }
+};
+
+struct Parsed {
+    Command command;
+    std::size_t row;
+};
+
+struct Chunk {
+    std::vector<Parsed> commands;
+    std::vector<CommandCsv::Rejected> rejected;
+};
+
+// Row boundaries are line breaks outside of quotes. Empty lines are skipped.
+std::vector<Row> splitRows(const char* text, const char* end)
+{
+    std::vector<Row> rows;
+    const char* begin = text;
+    bool quoted = false;
+
+    for(const char* c = text; c != end; ++c) {
+        if(*c == '"')
+            quoted = !quoted;               // A doubled quote toggles twice
+        else if(*c == '\n' && !quoted) {
+            const char* rowEnd = c != begin && c[-1] == '\r' ? c - 1 : c;
+
+            if(rowEnd != begin)
+                rows.push_back({ begin, rowEnd });
+
+            begin = c + 1;
+        }
+    }
+
+    if(end != begin && !(end - begin == 1 && *begin == '\r'))
+        rows.push_back({ begin, end });
+
+    return rows;
+}
+
+// Returns the number of fields found, fields past the last are left untouched
+std::size_t splitFields(const Row& row, Field* fields, std::size_t maxFields)
+{
+    const char* c = row.begin;
+    std::size_t count = 0;
+
+    while(count < maxFields) {
+        Field& field = fields[count++];
+
+        if(c != row.end && *c == '"') {
+            const char* start = ++c;
+            bool escaped = false;
+
+            while(c != row.end) {
+                if(*c == '"') {
+                    if(c + 1 != row.end && c[1] == '"') {
+                        escaped = true;
+                        c += 2;
+                        continue;
+                    }
+
+                    break;
+                }
+
+                ++c;
+            }
+
+            if(escaped) {
+                field.unquoted.clear();
+
+                for(const char* q = start; q != c; ++q) {
+                    field.unquoted += *q;
+
+                    if(*q == '"')
+                        ++q;
+                }
+
+                field.data = field.unquoted.data();
+                field.length = field.unquoted.size();
+            }
+            else {
+                field.data = start;
+                field.length = c - start;
+            }
+
+            if(c != row.end)
+                ++c;                        // Closing quote, anything up to the comma is ignored
+
+            while(c != row.end && *c != ',')
+                ++c;
+        }
+        else {
+            const char* start = c;
+
+            while(c != row.end && *c != ',')
+                ++c;
+
+            field.data = start;
+            field.length = c - start;
+        }
+
+        if(c == row.end)
+            break;
+
+        ++c;                                // Comma
+    }
+
+    return count;
+}
+
+bool isBlank(const Field& field)
+{
+    return std::all_of(field.data, field.data + field.length, [](char c) { return ByteParser::isSpace(c); });
+}
+
+bool parseDecimal(const Field& field, unsigned max, unsigned& value)
+{
+    const char* c = field.data;
+    const char* end = field.data + field.length;
+
+    while(c != end && ByteParser::isSpace(*c))
+        ++c;
+    while(end != c && ByteParser::isSpace(end[-1]))
+        --end;
+
+    if(c == end)
+        return false;
+
+    value = 0;
+
+    for(; c != end; ++c) {
+        if(*c < '0' || *c > '9')
+            return false;
+
+        value = value * 10 + (*c - '0');
+
+        if(value > max)
+            return false;
+    }
+
+    return true;
+}
+
+// Same rules as adding a command by hand
+bool parseCommand(const Row& row, Field* fields, Command& command)
+{
+    std::size_t count = splitFields(row, fields, fieldCount);
+
+    if(count < fieldCount - 2 || fields[0].empty())
+        return false;
+
+    command.name = QString::fromUtf8(fields[0].data, fields[0].length);
+
+    unsigned address;
+    if(!ByteParser::parseValueTrimmed(fields[1].data, fields[1].length, 0x7F, address))
+        return false;
+
+    unsigned reg = 0;
+    bool hasReg = !isBlank(fields[2]);
+    if(hasReg && !ByteParser::parseValueTrimmed(fields[2].data, fields[2].length, 0xFF, reg))
+        return false;
+
+    command.write.clear();
+    if(hasReg)
+        command.write.push_back(reg);
+
+    if(!ByteParser::parse(fields[3].data, fields[3].length, command.write) || command.write.size() > 1022)
+        return false;
+
+    unsigned readLength, speedMode;
+    if(!parseDecimal(fields[4], 1023, readLength) || !parseDecimal(fields[5], 3, speedMode))
+        return false;
+
+    if(command.write.empty() && readLength == 0)
+        return false;
+
+    command.address = address;
+    command.hasRegister = hasReg;
+    command.readLength = (int)readLength;
+    command.speedMode = speedMode;
+    command.tags = count >= fieldCount - 1 ? Command::splitTags(QString::fromUtf8(fields[6].data, fields[6].length)) : QStringList();
+
+    if(count == fieldCount)
+        return RetryPolicy::parse(QString::fromUtf8(fields[7].data, fields[7].length), command.retry);
+
+    command.retry = RetryPolicy();
+
+    return true;
+}
+
+void parseChunk(const std::vector<Row>& rows, std::size_t first, std::size_t last, Chunk& chunk)
+{
+    Field fields[fieldCount];
+
+    for(std::size_t i = first; i < last; ++i) {
+        Command command;
+
+        if(parseCommand(rows[i], fields, command))
+            chunk.commands.push_back({ std::move(command), i + 1 });
+        else {
+            // Report whatever the name field holds, even for rows too broken to parse
+            splitFields(rows[i], fields, 1);
+            chunk.rejected.push_back({ i + 1, QString::fromUtf8(fields[0].data, fields[0].length) });
+        }
+    }
+}
+
+}
+
+namespace CommandCsv {
+
+bool parse(const char* text, std::size_t length, LoadResult& result, const Progress& progress)
+{
+    const char* end = text + length;
+
+    if(length >= 3 && std::equal(text, text + 3, "\xEF\xBB\xBF")) // UTF-8 byte order mark
+        text += 3;
+
+    // ROW BOUNDARIES
+    std::vector<Row> rows = splitRows(text, end);
+
+    if(!rows.empty())
+        rows.erase(rows.begin()); // Title line
+
+    result.rows = rows.size();
+
+    // PARSE CHUNKS OF ROWS ON EVERY CORE
+    std::size_t chunkCount = (rows.size() + rowsPerChunk - 1) / rowsPerChunk;
+    std::vector<Chunk> chunks(chunkCount);
+    std::atomic<std::size_t> nextChunk{0};
+    std::atomic<std::size_t> rowsDone{0};
+    std::atomic<bool> cancelled{false};
+
+    auto work = [&]() {
+        for(std::size_t i = nextChunk++; i < chunkCount && !cancelled; i = nextChunk++) {
+            std::size_t first = i * rowsPerChunk;
+            std::size_t last = std::min(first + rowsPerChunk, rows.size());
+
+            parseChunk(rows, first, last, chunks[i]);
+            rowsDone += last - first;
+        }
+    };
+
+    std::size_t threadCount = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()), chunkCount);
+    std::vector<std::future<void>> workers;
+
+    for(std::size_t i = progress ? 0 : 1; i < threadCount; ++i) // With progress this thread only reports it
+        workers.push_back(std::async(std::launch::async, work));
+
+    if(progress) {
+        for(std::future<void>& worker : workers) {
+            while(worker.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready) {
+                if(!progress(rowsDone, rows.size()))
+                    cancelled = true;
+            }
+        }
+    }
+    else
+        work();
+
+    for(std::future<void>& worker : workers)
+        worker.wait();
+
+    if(cancelled || (progress && !progress(rows.size(), rows.size())))
+        return false;
+
+    // MERGE, THE FIRST ROW OF A NAME WINS
+    std::vector<Parsed> parsed;
+    parsed.reserve(rows.size());
+
+    for(Chunk& chunk : chunks) {
+        std::move(chunk.commands.begin(), chunk.commands.end(), std::back_inserter(parsed));
+        std::move(chunk.rejected.begin(), chunk.rejected.end(), std::back_inserter(result.rejected));
+    }
+
+    std::stable_sort(parsed.begin(), parsed.end(),
+                     [](const Parsed& left, const Parsed& right) { return left.command.name < right.command.name; });
+
+    result.commands.clear();
+    result.commands.reserve(parsed.size());
+
+    for(Parsed& entry : parsed) {
+        if(!result.commands.empty() && result.commands.back().name == entry.command.name)
+            result.rejected.push_back({ entry.row, entry.command.name });
+        else
+            result.commands.push_back(std::move(entry.command));
+    }
+
+    std::sort(result.rejected.begin(), result.rejected.end(),
+              [](const Rejected& left, const Rejected& right) { return left.row < right.row; });
+
+    return true;
+}
+
+bool load(const QString& path, LoadResult& result, const Progress& progress)
+{
+    QFile file(path);
+
+    if(!file.open(QIODevice::ReadOnly)) {
+        result.error = file.errorString();
+        return false;
+    }
+
+    if(file.size() == 0)
+        return parse(nullptr, 0, result, progress);
+
+    // Mapped, so pages are only read in as the parser gets to them
+    const uchar* data = file.map(0, file.size());
+
+    if(data)
+        return parse(reinterpret_cast<const char*>(data), file.size(), result, progress);
+
+    QByteArray contents = file.readAll(); // Not mappable (e.g. a pipe)
+
+    return parse(contents.constData(), contents.size(), result, progress);
+}
+
+bool save(const QString& path, const CommandModel& commands)
+{
+    std::ofstream file(std::filesystem::path(path.toStdU16String()));
+
+    if(!file.is_open())
+        return false;
+
+    file << titleLine;
+
+    for(std::size_t row = 0; row < commands.size(); ++row) {
+        Command command = commands.command(row);
+        file << "\n";
+
+        std::string name = command.name.toStdString();
+
+        if(name.find_first_of(",\"\r\n") != std::string::npos) { // Quoted, with any quotes doubled
+            std::string temp = "\"";
+
+            for(char c : name) {
+                temp += c;
+
+                if(c == '"')
+                    temp += '"';
+            }
+
+            name = temp + '"';
+        }
+
+        file << name << ",";
+        file << command.addressText() << ",";
+        file << command.registerText() << ",";
+        file << command.dataText() << ",";
+        file << command.readLength << ",";
+        file << command.speedMode << ",";
+        file << command.tags.join(" ").toStdString() << ",";
+        file << command.retry.text().toStdString();
+    }
+
+    file.close();
+
+    return !file.fail();
+}
+
+}
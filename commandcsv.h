@@ -0,0 +1,64 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef COMMANDCSV_H
+#define COMMANDCSV_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <QString>
+
+#include "command.h"
+
+class CommandModel;
+
+// Command libraries as CSV files (RFC 4180: fields containing commas, quotes
+// or line breaks are quoted, quotes inside them doubled). Columns are name,
+// device address, register, write data, read length, speed mode and an
+// optional tags column.
+//
+// Loading maps the file instead of reading it, finds the row boundaries in
+// one pass and then parses and validates the rows in chunks on all cores.
+// Nothing in here touches the GUI, so it can run in the background.
+namespace CommandCsv {
+
+extern const char* const titleLine;
+
+struct Rejected {
+    std::size_t row;                    // 1 based data row, not counting the title line
+    QString name;
+};
+
+struct LoadResult {
+    std::vector<Command> commands;      // Sorted by name
+    std::vector<Rejected> rejected;     // Invalid rows and repeated names, in file order
+    std::size_t rows = 0;
+    QString error;                      // Set if the file could not be read at all
+};
+
+// Called now and then with the rows parsed so far, return false to cancel
+using Progress = std::function<bool(std::size_t done, std::size_t total)>;
+
+// False if the file could not be read or loading was cancelled
+bool load(const QString& path, LoadResult& result, const Progress& progress = Progress());
+bool parse(const char* text, std::size_t length, LoadResult& result, const Progress& progress = Progress());
+
+bool save(const QString& path, const CommandModel& commands);
+
+}
+
+#endif // COMMANDCSV_H
@@ -0,0 +1,255 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "commandlibrary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <QSaveFile>
+
+#include "commandmodel.h"
+
+const char* const CommandLibrary::suffix = "ch341lib";
+
+namespace {
+
+const char magic[8] = { 'C', 'H', '3', '4', '1', 'L', 'I', 'B' };
+
+const std::size_t headerLength = 40;
+const std::size_t recordLength = 40;            // Records written by this version
+const std::size_t firstRecordLength = 24;       // Records of the first release, without retry policies
+
+enum RecordFlag { HasRegister = 0x01 };
+
+std::uint16_t get16(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+std::uint32_t get32(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((std::uint32_t)p[3] << 24);
+}
+
+void put16(unsigned char* p, std::uint16_t value)
+{
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+void put32(unsigned char* p, std::uint32_t value)
+{
+    for(int i = 0; i < 4; ++i)
+        p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+bool fail(QString* error, const QString& message)
+{
+    if(error)
+        *error = message;
+
+    return false;
+}
+
+}
+
+bool CommandLibrary::open(const QString& path, QString* error)
+{
+    this->file.setFileName(path);
+
+    if(!this->file.open(QIODevice::ReadOnly))
+        return fail(error, this->file.errorString());
+
+    this->length = this->file.size();
+    this->data = this->length >= headerLength ? this->file.map(0, this->length) : nullptr;
+
+    if(!this->data || !std::equal(magic, magic + sizeof(magic), this->data))
+        return fail(error, "Not a command library");
+
+    if(get16(this->data + 8) != version)
+        return fail(error, "Unsupported command library version " + QString::number(get16(this->data + 8)));
+
+    this->recordSize = get16(this->data + 10);
+    this->count = get32(this->data + 12);
+    this->recordsOffset = get32(this->data + 16);
+    this->stringsOffset = get32(this->data + 20);
+    this->stringsLength = get32(this->data + 24);
+    this->payloadOffset = get32(this->data + 28);
+    this->payloadLength = get32(this->data + 32);
+
+    // Only the table bounds are checked up front, offsets inside records are checked as they are read
+    if(this->recordSize < firstRecordLength || this->recordsOffset + (unsigned long long)this->count * this->recordSize > this->length ||
+       this->stringsOffset + (unsigned long long)this->stringsLength > this->length ||
+       this->payloadOffset + (unsigned long long)this->payloadLength > this->length) {
+        this->count = 0;
+        return fail(error, "Command library is truncated");
+    }
+
+    return true;
+}
+
+QString CommandLibrary::string(std::size_t offset, std::size_t length) const
+{
+    if(offset + length > this->stringsLength)
+        return QString();
+
+    return QString::fromUtf8(reinterpret_cast<const char*>(this->data + this->stringsOffset + offset), length);
+}
+
+QString CommandLibrary::name(std::size_t row) const
+{
+    const unsigned char* record = this->record(row);
+
+    return this->string(get32(record), get16(record + 12));
+}
+
+QStringList CommandLibrary::tags(std::size_t row) const
+{
+    const unsigned char* record = this->record(row);
+
+    return this->string(get32(record + 4), get16(record + 14)).split(' ', Qt::SkipEmptyParts);
+}
+
+Command CommandLibrary::command(std::size_t row) const
+{
+    const unsigned char* record = this->record(row);
+
+    std::size_t dataOffset = get32(record + 8);
+    std::size_t dataLength = get16(record + 16);
+
+    if(dataOffset + dataLength > this->payloadLength)
+        dataLength = 0;
+
+    const unsigned char* bytes = this->data + this->payloadOffset + dataOffset;
+
+    Command command;
+    command.name = this->name(row);
+    command.address = record[20] & 0x7F;
+    command.hasRegister = record[22] & HasRegister;
+
+    command.write.reserve(command.hasRegister + dataLength);
+    if(command.hasRegister)
+        command.write.push_back(record[21]);
+    command.write.insert(command.write.end(), bytes, bytes + dataLength);
+
+    command.readLength = get16(record + 18);
+    command.speedMode = record[23] & 0x03;
+    command.tags = this->tags(row);
+
+    if(this->recordSize >= recordLength && record[24] <= RetryPolicy::Backoff) {
+        command.retry.mode = (RetryPolicy::Mode)record[24];
+        command.retry.attempts = get16(record + 26);
+        command.retry.limit = std::chrono::microseconds(get32(record + 28));
+        command.retry.delay = std::chrono::microseconds(get32(record + 32));
+        command.retry.maxDelay = std::chrono::microseconds(get32(record + 36));
+    }
+
+    return command;
+}
+
+int CommandLibrary::indexOf(const QString& name) const
+{
+    std::size_t row = this->lowerBound(name);
+
+    return row < this->count && this->name(row) == name ? (int)row : -1;
+}
+
+std::size_t CommandLibrary::lowerBound(const QString& name) const
+{
+    std::size_t first = 0, last = this->count;
+
+    while(first < last) {
+        std::size_t middle = first + (last - first) / 2;
+
+        if(this->name(middle) < name)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    return first;
+}
+
+bool CommandLibrary::write(const QString& path, const CommandModel& commands, QString* error)
+{
+    std::vector<unsigned char> records(commands.size() * recordLength);
+    QByteArray strings;
+    std::vector<unsigned char> payload;
+
+    for(std::size_t row = 0; row < commands.size(); ++row) {
+        Command command = commands.command(row);
+        unsigned char* record = records.data() + row * recordLength;
+
+        QByteArray name = command.name.toUtf8();
+        QByteArray tags = command.tags.join(" ").toUtf8();
+        std::size_t dataOffset = payload.size();
+
+        payload.insert(payload.end(), command.data(), command.data() + command.dataLength());
+
+        if(name.size() > 0xFFFF || tags.size() > 0xFFFF)
+            return fail(error, "Name or tags of \"" + command.name + "\" are too long");
+
+        put32(record, strings.size());
+        put16(record + 12, name.size());
+        strings += name;
+
+        put32(record + 4, strings.size());
+        put16(record + 14, tags.size());
+        strings += tags;
+
+        put32(record + 8, dataOffset);
+        put16(record + 16, payload.size() - dataOffset);
+        put16(record + 18, command.readLength);
+
+        record[20] = command.address;
+        record[21] = command.registerAddress();
+        record[22] = command.hasRegister ? HasRegister : 0;
+        record[23] = command.speedMode & 0x03;
+
+        record[24] = command.retry.mode;
+        put16(record + 26, (std::uint16_t)command.retry.attempts);
+        put32(record + 28, (std::uint32_t)command.retry.limit.count());
+        put32(record + 32, (std::uint32_t)command.retry.delay.count());
+        put32(record + 36, (std::uint32_t)command.retry.maxDelay.count());
+    }
+
+    unsigned char header[headerLength] = {};
+    std::memcpy(header, magic, sizeof(magic));
+    put16(header + 8, version);
+    put16(header + 10, recordLength);
+    put32(header + 12, commands.size());
+    put32(header + 16, headerLength);
+    put32(header + 20, headerLength + records.size());
+    put32(header + 24, strings.size());
+    put32(header + 28, headerLength + records.size() + strings.size());
+    put32(header + 32, payload.size());
+
+    // Written next to the target and renamed over it, so a library that is still mapped stays intact
+    QSaveFile file(path);
+
+    if(!file.open(QIODevice::WriteOnly))
+        return fail(error, file.errorString());
+
+    file.write(reinterpret_cast<const char*>(header), headerLength);
+    file.write(reinterpret_cast<const char*>(records.data()), records.size());
+    file.write(strings);
+    file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+
+    if(!file.commit())
+        return fail(error, file.errorString());
+
+    return true;
+}
@@ -0,0 +1,84 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef COMMANDLIBRARY_H
+#define COMMANDLIBRARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <QFile>
+#include <QString>
+
+#include "command.h"
+
+class CommandModel;
+
+// Precompiled command library (*.ch341lib). The file is mapped and read in
+// place: opening it only checks the header, and every lookup reads straight
+// from the mapping. All numbers are little endian.
+//
+//   Header   magic "CH341LIB", version, record size, record count and the
+//            offset/length of the three sections below
+//   Records  one fixed size record per command, sorted by name (QString
+//            order), so the record table doubles as the name index:
+//              name offset/length, tags offset/length  (string table)
+//              data offset/length                      (payload)
+//              read length, device address, register, flags, speed mode
+//              retry mode, attempts, limit, delay, max delay (microseconds)
+//   Strings  UTF-8 names and space separated tags
+//   Payload  write data bytes, already encoded
+//
+// Readers accept records longer than they know about, so fields can be
+// appended to a record without bumping the version.
+class CommandLibrary
+{
+public:
+    static const char* const suffix;
+    static const std::uint16_t version = 1;
+
+    CommandLibrary() = default;
+    CommandLibrary(const CommandLibrary&) = delete;
+    CommandLibrary& operator=(const CommandLibrary&) = delete;
+
+    bool open(const QString& path, QString* error = nullptr);
+    QString path() const { return this->file.fileName(); }
+
+    std::size_t size() const { return this->count; }
+    QString name(std::size_t row) const;
+    QStringList tags(std::size_t row) const;
+    Command command(std::size_t row) const;
+    int indexOf(const QString& name) const;     // -1 if there is no such command
+    std::size_t lowerBound(const QString& name) const; // First row not ordered before name
+
+    static bool write(const QString& path, const CommandModel& commands, QString* error = nullptr);
+
+private:
+    QFile file;
+    const unsigned char* data = nullptr;
+    std::size_t length = 0;
+
+    std::size_t count = 0;
+    std::size_t recordSize = 0;
+    std::size_t recordsOffset = 0;
+    std::size_t stringsOffset = 0, stringsLength = 0;
+    std::size_t payloadOffset = 0, payloadLength = 0;
+
+    const unsigned char* record(std::size_t row) const { return this->data + this->recordsOffset + row * this->recordSize; }
+    QString string(std::size_t offset, std::size_t length) const;
+};
+
+#endif // COMMANDLIBRARY_H
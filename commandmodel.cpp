@@ -0,0 +1,438 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "commandmodel.h"
+
+#include <algorithm>
+
+namespace {
+
+const int unknownScore = -2;                    // Not worked out yet, see CommandFilterModel::score()
+
+}
+
+// COMMAND MODEL
+CommandModel::CommandModel(QObject* parent)
+    : QAbstractListModel(parent)
+{
+}
+
+int CommandModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : (int)this->size();
+}
+
+QVariant CommandModel::data(const QModelIndex& index, int role) const
+{
+    if(!index.isValid() || index.row() >= (int)this->size())
+        return QVariant();
+
+    switch(role) {
+        case Qt::DisplayRole:
+        case Qt::EditRole:
+            return this->name(index.row());
+
+        case Qt::ToolTipRole: {
+            QStringList tags = this->tags(index.row());
+            return tags.isEmpty() ? QVariant() : QVariant("#" + tags.join(" #"));
+        }
+
+        case TagsRole:
+            return this->tags(index.row());
+    }
+
+    return QVariant();
+}
+
+QString CommandModel::baseName(std::size_t base) const
+{
+    return this->library ? this->library->name(base) : this->commands[base].name;
+}
+
+std::size_t CommandModel::baseLowerBound(const QString& name) const
+{
+    if(this->library)
+        return this->library->lowerBound(name);
+
+    return std::lower_bound(this->commands.begin(), this->commands.end(), name,
+                            [](const Command& command, const QString& name) { return command.name < name; }) - this->commands.begin();
+}
+
+bool CommandModel::isHidden(std::size_t base) const
+{
+    return std::binary_search(this->hidden.begin(), this->hidden.end(), base);
+}
+
+std::size_t CommandModel::visibleBelow(std::size_t base) const
+{
+    return base - (std::lower_bound(this->hidden.begin(), this->hidden.end(), base) - this->hidden.begin());
+}
+
+std::size_t CommandModel::rowOfAdded(std::size_t edit) const
+{
+    return edit + this->visibleBelow(this->baseLowerBound(this->added[edit].name));
+}
+
+bool CommandModel::locate(std::size_t row, std::size_t& at) const
+{
+    // Edits showing before row, their rows are ascending
+    std::size_t first = 0, last = this->added.size();
+
+    while(first < last) {
+        std::size_t middle = first + (last - first) / 2;
+
+        if(this->rowOfAdded(middle) < row)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    if(first < this->added.size() && this->rowOfAdded(first) == row) {
+        at = first;
+        return true;
+    }
+
+    // The visible-th base row left showing. hidden[i] - i base rows are showing
+    // before hidden[i], so skip every hidden row with no more than that before it.
+    std::size_t visible = row - first;
+    std::size_t skipped = 0;
+    last = this->hidden.size();
+
+    while(skipped < last) {
+        std::size_t middle = skipped + (last - skipped) / 2;
+
+        if(this->hidden[middle] - middle <= visible)
+            skipped = middle + 1;
+        else
+            last = middle;
+    }
+
+    at = visible + skipped;
+    return false;
+}
+
+QString CommandModel::name(std::size_t row) const
+{
+    std::size_t at;
+    return this->locate(row, at) ? this->added[at].name : this->baseName(at);
+}
+
+QStringList CommandModel::tags(std::size_t row) const
+{
+    std::size_t at;
+
+    if(this->locate(row, at))
+        return this->added[at].tags;
+
+    return this->library ? this->library->tags(at) : this->commands[at].tags;
+}
+
+Command CommandModel::command(std::size_t row) const
+{
+    std::size_t at;
+
+    if(this->locate(row, at))
+        return this->added[at];
+
+    return this->library ? this->library->command(at) : this->commands[at];
+}
+
+std::vector<Command>::const_iterator CommandModel::lowerBound(const QString& name) const
+{
+    return std::lower_bound(this->added.begin(), this->added.end(), name,
+                            [](const Command& command, const QString& name) { return command.name < name; });
+}
+
+int CommandModel::indexOf(const QString& name) const
+{
+    auto it = this->lowerBound(name);
+    std::size_t edit = it - this->added.begin();
+
+    if(it != this->added.end() && it->name == name)
+        return (int)this->rowOfAdded(edit);
+
+    std::size_t base = this->baseLowerBound(name);
+
+    if(base == this->baseSize() || this->baseName(base) != name || this->isHidden(base))
+        return -1;
+
+    return (int)(this->visibleBelow(base) + edit);
+}
+
+std::optional<Command> CommandModel::find(const QString& name) const
+{
+    int row = this->indexOf(name);
+
+    if(row == -1)
+        return std::nullopt;
+
+    return this->command(row);
+}
+
+int CommandModel::insertOrReplace(const Command& command)
+{
+    auto it = this->lowerBound(command.name);
+    std::size_t edit = it - this->added.begin();
+
+    if(it != this->added.end() && it->name == command.name) {
+        int row = (int)this->rowOfAdded(edit);
+
+        this->added[edit] = command;
+        emit dataChanged(this->index(row), this->index(row));
+
+        return row;
+    }
+
+    std::size_t base = this->baseLowerBound(command.name);
+    int row = (int)(this->visibleBelow(base) + edit);
+
+    if(base < this->baseSize() && this->baseName(base) == command.name && !this->isHidden(base)) {
+        // The edit takes the place of the base row, same row for the views
+        this->hidden.insert(std::lower_bound(this->hidden.begin(), this->hidden.end(), base), base);
+        this->added.insert(this->added.begin() + edit, command);
+        emit dataChanged(this->index(row), this->index(row));
+
+        return row;
+    }
+
+    this->beginInsertRows(QModelIndex(), row, row);
+    this->added.insert(this->added.begin() + edit, command);
+    this->endInsertRows();
+
+    return row;
+}
+
+bool CommandModel::remove(const QString& name)
+{
+    auto it = this->lowerBound(name);
+    std::size_t edit = it - this->added.begin();
+
+    if(it != this->added.end() && it->name == name) {
+        int row = (int)this->rowOfAdded(edit);
+
+        this->beginRemoveRows(QModelIndex(), row, row);
+        this->added.erase(this->added.begin() + edit);
+        this->endRemoveRows();
+
+        return true;
+    }
+
+    std::size_t base = this->baseLowerBound(name);
+
+    if(base == this->baseSize() || this->baseName(base) != name || this->isHidden(base))
+        return false;
+
+    int row = (int)(this->visibleBelow(base) + edit);
+
+    this->beginRemoveRows(QModelIndex(), row, row);
+    this->hidden.insert(std::lower_bound(this->hidden.begin(), this->hidden.end(), base), base);
+    this->endRemoveRows();
+
+    return true;
+}
+
+void CommandModel::clear()
+{
+    this->setCommands({});
+}
+
+void CommandModel::setCommands(std::vector<Command> commands)
+{
+    auto byName = [](const Command& left, const Command& right) { return left.name < right.name; };
+
+    if(!std::is_sorted(commands.begin(), commands.end(), byName))
+        std::stable_sort(commands.begin(), commands.end(), byName);
+
+    commands.erase(std::unique(commands.begin(), commands.end(),
+                               [](const Command& left, const Command& right) { return left.name == right.name; }),
+                   commands.end());
+
+    this->beginResetModel();
+    this->commands = std::move(commands);
+    this->library.reset();
+    this->added.clear();
+    this->hidden.clear();
+    this->endResetModel();
+}
+
+void CommandModel::setLibrary(std::shared_ptr<const CommandLibrary> library)
+{
+    this->beginResetModel();
+    this->commands.clear();
+    this->library = std::move(library);
+    this->added.clear();
+    this->hidden.clear();
+    this->endResetModel();
+}
+
+void CommandModel::detach()
+{
+    if(!this->library && this->added.empty() && this->hidden.empty())
+        return;
+
+    // Same rows in the same order, so the views need not hear about it
+    std::vector<Command> commands;
+    commands.reserve(this->size());
+
+    for(std::size_t row = 0; row < this->size(); ++row)
+        commands.push_back(this->command(row));
+
+    this->commands = std::move(commands);
+    this->library.reset();
+    this->added.clear();
+    this->hidden.clear();
+}
+
+std::vector<Command> CommandModel::tagged(const QString& tag) const
+{
+    std::vector<Command> result;
+
+    for(std::size_t row = 0; row < this->size(); ++row) {
+        if(this->tags(row).contains(tag, Qt::CaseInsensitive))
+            result.push_back(this->command(row));
+    }
+
+    return result;
+}
+
+bool CommandModel::expand(const QString& line, std::vector<Command>& commands) const
+{
+    if(line.startsWith('#')) {
+        std::vector<Command> group = this->tagged(line.mid(1));
+        commands.insert(commands.end(), std::make_move_iterator(group.begin()), std::make_move_iterator(group.end()));
+
+        return !group.empty();
+    }
+
+    std::optional<Command> command = this->find(line);
+
+    if(command)
+        commands.push_back(std::move(*command));
+
+    return command.has_value();
+}
+
+// COMMAND FILTER MODEL
+CommandFilterModel::CommandFilterModel(QObject* parent)
+    : QSortFilterProxyModel(parent)
+{
+    this->setDynamicSortFilter(true);
+    this->sort(0);
+}
+
+void CommandFilterModel::setSourceModel(QAbstractItemModel* sourceModel)
+{
+    if(this->sourceModel())
+        disconnect(this->sourceModel(), nullptr, this, nullptr);
+
+    this->scores.clear();
+
+    // Dropped before the rows move, the proxy sorts again right after
+    if(sourceModel) {
+        auto forget = [this]() { this->scores.clear(); };
+
+        connect(sourceModel, &QAbstractItemModel::rowsAboutToBeInserted, this, forget);
+        connect(sourceModel, &QAbstractItemModel::rowsAboutToBeRemoved, this, forget);
+        connect(sourceModel, &QAbstractItemModel::modelAboutToBeReset, this, forget);
+        connect(sourceModel, &QAbstractItemModel::layoutAboutToBeChanged, this, forget);
+        connect(sourceModel, &QAbstractItemModel::dataChanged, this, forget);
+    }
+
+    QSortFilterProxyModel::setSourceModel(sourceModel);
+}
+
+void CommandFilterModel::setPattern(const QString& pattern)
+{
+    if(pattern == this->searchPattern)
+        return;
+
+    this->searchPattern = pattern;
+    this->scores.clear();
+    this->invalidate();
+}
+
+int CommandFilterModel::cachedScore(int sourceRow) const
+{
+    std::size_t rows = this->sourceModel()->rowCount();
+
+    if(this->scores.size() != rows)
+        this->scores.assign(rows, unknownScore);
+
+    int& cached = this->scores[sourceRow];
+
+    if(cached == unknownScore)
+        cached = score(this->sourceModel()->index(sourceRow, 0).data().toString(), this->searchPattern);
+
+    return cached;
+}
+
+int CommandFilterModel::score(const QString& name, const QString& pattern)
+{
+    if(pattern.isEmpty() || name.startsWith(pattern, Qt::CaseInsensitive))
+        return 0;
+
+    int position = name.indexOf(pattern, 0, Qt::CaseInsensitive);
+    if(position != -1)
+        return 1 + position;
+
+    // Scattered match, the tighter the better
+    int first = -1;
+    int i = 0;
+
+    for(QChar c : pattern) {
+        c = c.toLower();
+
+        while(i < name.size() && name[i].toLower() != c)
+            ++i;
+
+        if(i == name.size())
+            return -1;
+
+        if(first == -1)
+            first = i;
+
+        ++i;
+    }
+
+    return 0x10000 + (i - first);
+}
+
+bool CommandFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const
+{
+    QModelIndex index = this->sourceModel()->index(sourceRow, 0, sourceParent);
+
+    if(this->searchPattern.startsWith('#')) {
+        QString tag = this->searchPattern.mid(1);
+        const QStringList tags = index.data(CommandModel::TagsRole).toStringList();
+
+        return std::any_of(tags.begin(), tags.end(), [&tag](const QString& t) { return t.startsWith(tag, Qt::CaseInsensitive); });
+    }
+
+    return this->cachedScore(sourceRow) != -1;
+}
+
+bool CommandFilterModel::lessThan(const QModelIndex& left, const QModelIndex& right) const
+{
+    if(!this->searchPattern.startsWith('#')) {
+        int leftScore = this->cachedScore(left.row());
+        int rightScore = this->cachedScore(right.row());
+
+        if(leftScore != rightScore)
+            return leftScore < rightScore;
+    }
+
+    return left.row() < right.row(); // Library order
+}
@@ -0,0 +1,124 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef COMMANDMODEL_H
+#define COMMANDMODEL_H
+
+#include <memory>
+#include <optional>
+#include <vector>
+#include <QAbstractListModel>
+#include <QSortFilterProxyModel>
+
+#include "command.h"
+#include "commandlibrary.h"
+
+// The command library, kept sorted by name. Lookups are binary searches and
+// every change is reported to the views as the single row it touches, so the
+// drop-down never has to be refilled item by item.
+//
+// The model can also sit directly on a mapped binary library, in which case
+// nothing is loaded until a row is asked for. Edits never copy the rows they
+// sit on (mapped or not): added and replaced commands go into a small sorted
+// overlay, and the rows they replace or remove are hidden, so an edit costs a
+// few binary searches and a move within the overlay.
+class CommandModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Role { TagsRole = Qt::UserRole };
+
+    explicit CommandModel(QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    std::optional<Command> find(const QString& name) const;
+    int indexOf(const QString& name) const;     // -1 if there is no such command
+
+    // Returns the row of the command
+    int insertOrReplace(const Command& command);
+    bool remove(const QString& name);
+    void clear();
+    // Replaces the whole library in one reset, the first of equally named commands is kept
+    void setCommands(std::vector<Command> commands);
+    void setLibrary(std::shared_ptr<const CommandLibrary> library);
+    // Copies a mapped library and the edits on it into the model, after this the file is no longer used
+    void detach();
+
+    // Commands carrying the tag, in library order
+    std::vector<Command> tagged(const QString& tag) const;
+    // Appends the command named on a batch line, or every command of a "#tag" line. False if there are none.
+    bool expand(const QString& line, std::vector<Command>& commands) const;
+
+    Command command(std::size_t row) const;
+    std::size_t size() const { return this->baseSize() - this->hidden.size() + this->added.size(); }
+
+private:
+    // The base rows come from library if set, otherwise from commands
+    std::vector<Command> commands;
+    std::shared_ptr<const CommandLibrary> library;
+    std::vector<Command> added;                 // Edits, sorted by name, none named like a visible base row
+    std::vector<std::size_t> hidden;            // Base rows removed or replaced by an edit, ascending
+
+    std::size_t baseSize() const { return this->library ? this->library->size() : this->commands.size(); }
+    QString baseName(std::size_t base) const;
+    std::size_t baseLowerBound(const QString& name) const;
+    bool isHidden(std::size_t base) const;
+    // Base rows before base that are not hidden
+    std::size_t visibleBelow(std::size_t base) const;
+    std::size_t rowOfAdded(std::size_t edit) const;
+    // True if row shows the edit added[at], false if it shows the base row at
+    bool locate(std::size_t row, std::size_t& at) const;
+
+    std::vector<Command>::const_iterator lowerBound(const QString& name) const;
+    QString name(std::size_t row) const;
+    QStringList tags(std::size_t row) const;
+};
+
+// Narrows the library down to the names matching a search pattern. Letters of
+// the pattern have to appear in the name in order (case insensitive), names
+// starting with the pattern come first, then names containing it, then the
+// scattered matches. A pattern starting with '#' lists the commands tagged
+// with the rest of it instead. Scores are worked out once per source row and
+// pattern, not again on every comparison of the sort.
+class CommandFilterModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+
+public:
+    explicit CommandFilterModel(QObject* parent = nullptr);
+
+    void setSourceModel(QAbstractItemModel* sourceModel) override;
+    void setPattern(const QString& pattern);
+    const QString& pattern() const { return this->searchPattern; }
+
+    // Lower is better, -1 if the name does not match at all
+    static int score(const QString& name, const QString& pattern);
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex& sourceParent) const override;
+    bool lessThan(const QModelIndex& left, const QModelIndex& right) const override;
+
+private:
+    QString searchPattern;
+    mutable std::vector<int> scores;            // Per source row, unknownScore until asked for
+
+    int cachedScore(int sourceRow) const;
+};
+
+#endif // COMMANDMODEL_H
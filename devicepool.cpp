@@ -0,0 +1,129 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "devicepool.h"
+
+#include <algorithm>
+
+#include "i2ctransport.h"
+
+DevicePool::DevicePool(const I2CTransport* prototype, std::shared_ptr<TransactionStats> stats, QObject* parent)
+    : QObject(parent), prototype(prototype), stats(std::move(stats))
+{
+}
+
+DevicePool::~DevicePool()
+{
+    this->close();
+}
+
+bool DevicePool::open(unsigned long deviceNum, QString* error)
+{
+    for(const std::unique_ptr<Adapter>& adapter : this->adapters) {
+        if(adapter->deviceNum == deviceNum) {
+            if(error)
+                *error = "Device #" + QString::number(deviceNum) + " is already open";
+
+            return false;
+        }
+    }
+
+    std::unique_ptr<Adapter> adapter = std::make_unique<Adapter>();
+    adapter->transport.reset(this->prototype->createSibling());
+
+    if(!adapter->transport->open(deviceNum)) {
+        if(error)
+            *error = "Failed to open CH341 device #" + QString::number(deviceNum);
+
+        return false;
+    }
+
+    int index = (int)this->adapters.size();
+    adapter->deviceNum = deviceNum;
+
+    adapter->worker = new DeviceWorker(adapter->transport.get(), this->stats);
+    adapter->worker->moveToThread(&adapter->thread);
+
+    connect(&adapter->thread, &QThread::finished, adapter->worker, &QObject::deleteLater);
+    connect(adapter->worker, &DeviceWorker::finished, this, [this, index](const DeviceResult& result) { emit finished(index, result); });
+    connect(adapter->worker, &DeviceWorker::disconnected, this, [this, index]() { emit disconnected(index); });
+    connect(adapter->worker, &DeviceWorker::reconnected, this, [this, index](const ReconnectReport& report) {
+        if(report.ok)
+            this->adapters[index]->deviceNum = report.reopenedAs;
+
+        emit reconnected(index, report);
+    });
+
+    adapter->worker->setAutoReconnect(this->reconnectTimeout);
+
+    adapter->thread.start();
+    this->adapters.push_back(std::move(adapter));
+
+    return true;
+}
+
+void DevicePool::close()
+{
+    // Stop every thread before waiting on any of them, so closing takes as long as the slowest adapter
+    for(const std::unique_ptr<Adapter>& adapter : this->adapters) {
+        adapter->worker->cancelPending();
+        adapter->thread.requestInterruption();
+        adapter->thread.quit();
+    }
+
+    for(const std::unique_ptr<Adapter>& adapter : this->adapters) {
+        adapter->thread.wait();
+        adapter->transport->close();
+    }
+
+    this->adapters.clear();
+}
+
+void DevicePool::setAutoReconnect(std::chrono::milliseconds timeout)
+{
+    this->reconnectTimeout = timeout;
+
+    for(const std::unique_ptr<Adapter>& adapter : this->adapters)
+        adapter->worker->setAutoReconnect(timeout);
+}
+
+unsigned long DevicePool::deviceNum(std::size_t adapter) const
+{
+    return this->adapters[adapter]->deviceNum;
+}
+
+bool DevicePool::parseDevices(const QString& text, std::vector<unsigned long>& devices)
+{
+    devices.clear();
+
+    for(const QString& part : text.split(',', Qt::SkipEmptyParts)) {
+        QStringList range = part.split('-');
+        bool firstOk, lastOk = true;
+
+        unsigned long first = range[0].trimmed().toULong(&firstOk);
+        unsigned long last = range.size() == 2 ? range[1].trimmed().toULong(&lastOk) : first;
+
+        if(!firstOk || !lastOk || range.size() > 2 || last < first || last - first >= 256)
+            return false;
+
+        for(unsigned long device = first; device <= last; ++device) {
+            if(std::find(devices.begin(), devices.end(), device) == devices.end())
+                devices.push_back(device);
+        }
+    }
+
+    return !devices.empty();
+}
@@ -0,0 +1,75 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DEVICEPOOL_H
+#define DEVICEPOOL_H
+
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <QObject>
+#include <QThread>
+
+#include "deviceworker.h"
+
+class I2CTransport;
+
+// Several CH341 adapters driven at once, each by its own DeviceWorker on its
+// own thread, so a fixture takes as long as its slowest adapter rather than
+// the sum of all of them.
+class DevicePool : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Adapters get transports of the same kind as prototype, and record their transactions into stats (if given)
+    explicit DevicePool(const I2CTransport* prototype, std::shared_ptr<TransactionStats> stats = nullptr, QObject* parent = nullptr);
+    ~DevicePool();
+
+    bool open(unsigned long deviceNum, QString* error = nullptr);
+    void close();
+
+    std::size_t size() const { return this->adapters.size(); }
+    // The number it is open under now, following automatic reconnects
+    unsigned long deviceNum(std::size_t adapter) const;
+    DeviceWorker* worker(std::size_t adapter) const { return this->adapters[adapter]->worker; }
+
+    // Applies to the adapters open now and opened later, see DeviceWorker::setAutoReconnect()
+    void setAutoReconnect(std::chrono::milliseconds timeout);
+
+    // Parses a device list like "0-3, 6" into device numbers, in order and without repeats
+    static bool parseDevices(const QString& text, std::vector<unsigned long>& devices);
+
+signals:
+    void finished(int adapter, const DeviceResult& result);
+    void disconnected(int adapter);
+    void reconnected(int adapter, const ReconnectReport& report);
+
+private:
+    struct Adapter {
+        std::unique_ptr<I2CTransport> transport;
+        QThread thread;
+        DeviceWorker* worker = nullptr;
+        unsigned long deviceNum = 0;            // Our copy, the transport's own changes on the adapter's thread
+    };
+
+    const I2CTransport* prototype;
+    std::shared_ptr<TransactionStats> stats;
+    std::vector<std::unique_ptr<Adapter>> adapters;
+    std::chrono::milliseconds reconnectTimeout{0};
+};
+
+#endif // DEVICEPOOL_H
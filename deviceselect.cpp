@@ -19,11 +19,12 @@
 
 #include <QMessageBox>
 
-#include "CH341DLL_EN.H"
+#include "i2ctransport.h"
 
-DeviceSelect::DeviceSelect(QWidget *parent) :
+DeviceSelect::DeviceSelect(I2CTransport* transport, QWidget *parent) :
     QDialog(parent),
-    ui(new Ui::DeviceSelect)
+    ui(new Ui::DeviceSelect),
+    transport(transport)
 {
     ui->setupUi(this);
     this->setWindowTitle("CH341 Device Select");
@@ -38,12 +39,11 @@ void DeviceSelect::on_pushButton_clicked()
 {
     this->deviceNum = ui->spinBox->value();
 
-    qDebug() << "CH341 LIBRARY VERSION:" << CH341GetVersion();
+    qDebug() << "TRANSPORT:" << this->transport->name();
+    qDebug() << "CH341 LIBRARY VERSION:" << this->transport->libraryVersion();
     qDebug().nospace() << "OPENING CH341 DEVICE #" << this->deviceNum;
 
-    HANDLE result = CH341OpenDevice(this->deviceNum);
-
-    if((INT64)result < 0) {
+    if(!this->transport->open(this->deviceNum)) {
         qDebug().nospace() << "FAILED TO OPEN CH341 DEVICE #" << this->deviceNum << "!\n";
         QMessageBox::critical(this, " ", "Failed to open CH341 device #" + QString::number(this->deviceNum) + "!");
 
@@ -51,7 +51,7 @@ void DeviceSelect::on_pushButton_clicked()
     }
     else {
         qDebug().nospace() << "OPENED CH341 DEVICE #" << this->deviceNum << "!";
-        qDebug() << "CH341 DRIVER VERSION:" << CH341GetDrvVersion() << "\n";
+        qDebug() << "CH341 DRIVER VERSION:" << this->transport->driverVersion() << "\n";
 
         this->close();
     }
@@ -18,7 +18,8 @@
 #define DEVICESELECT_H
 
 #include <QDialog>
-#include <windows.h>
+
+class I2CTransport;
 
 namespace Ui {
 class DeviceSelect;
@@ -29,7 +30,7 @@ class DeviceSelect : public QDialog
     Q_OBJECT
 
 public:
-    explicit DeviceSelect(QWidget *parent = nullptr);
+    explicit DeviceSelect(I2CTransport* transport, QWidget *parent = nullptr);
     ~DeviceSelect();
 
     int deviceNum = -1;
@@ -39,6 +40,7 @@ private slots:
 
 private:
     Ui::DeviceSelect *ui;
+    I2CTransport* transport;
 };
 
 #endif // DEVICESELECT_H
@@ -0,0 +1,666 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "deviceworker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <QThread>
+#include <QTimer>
+
+#include "i2ctransport.h"
+
+namespace {
+
+const int maxPollFailures = 16;                 // In a row, before the device is assumed gone
+const qint64 pollReportInterval = 250000000;    // Nanoseconds
+const qint64 memoryReportInterval = 100000000;  // Nanoseconds
+const unsigned long reconnectInterval = 250;    // Milliseconds between attempts to reopen a lost adapter
+const int maxResumes = 3;                       // Reconnects a single request may go through
+
+}
+
+DeviceWorker::DeviceWorker(I2CTransport* transport, std::shared_ptr<TransactionStats> stats,
+                           std::shared_ptr<RegisterCache> cache)
+    : device(transport)
+    , scheduler(transport)
+    , sequencer(transport)
+    , recorder(std::move(stats))
+    , cache(std::move(cache))
+    , pollTimer(new QTimer(this))
+{
+    qRegisterMetaType<DeviceResult>("DeviceResult");
+    qRegisterMetaType<PollStats>("PollStats");
+    qRegisterMetaType<BlockProgress>("BlockProgress");
+    qRegisterMetaType<ReconnectReport>("ReconnectReport");
+
+    this->pollTimer->setSingleShot(true);
+    this->pollTimer->setTimerType(Qt::PreciseTimer);
+    connect(this->pollTimer, &QTimer::timeout, this, &DeviceWorker::pollTick);
+}
+
+quint64 DeviceWorker::submit(DeviceRequest request)
+{
+    request.id = this->nextId;
+
+    if(!this->queue.push(std::move(request)))
+        return 0;
+
+    ++this->nextId;
+    ++this->pendingCount;
+
+    if(!this->drainScheduled.exchange(true))
+        QMetaObject::invokeMethod(this, "drain", Qt::QueuedConnection);
+
+    return this->nextId - 1;
+}
+
+void DeviceWorker::cancelPending()
+{
+    this->cancelledUpTo.store(this->nextId - 1);
+}
+
+bool DeviceWorker::isCancelled(const DeviceRequest& request) const
+{
+    return (!request.owner && request.id <= this->cancelledUpTo.load()) || (request.cancelled && request.cancelled());
+}
+
+void DeviceWorker::drain()
+{
+    this->drainScheduled.store(false);
+
+    DeviceRequest request;
+    while(this->queue.pop(request)) {
+        DeviceResult result;
+        result.id = request.id;
+        result.kind = request.kind;
+        result.offset = request.offset;
+        result.names = std::move(request.names);
+        result.owner = request.owner;
+
+        if(this->isCancelled(request)) {
+            result.cancelled = true;
+            result.error = "Cancelled";
+        }
+        else {
+            this->execute(request, result);
+
+            // LOST THE ADAPTER, PICK THE REQUEST UP WHERE IT STOPPED ONCE IT IS BACK
+            while(!result.ok && !result.cancelled && !result.nacked && result.resumed < maxResumes &&
+                  this->reconnect([&]() { return this->isCancelled(request); })) {
+                ++result.resumed;
+                this->resume(request, result);
+            }
+
+            if(this->device->currentStreamMode() >= 0)
+                this->lastSpeedMode = this->device->currentStreamMode();
+
+            this->record(request, result);
+        }
+
+        --this->pendingCount;
+        emit finished(result);
+    }
+}
+
+void DeviceWorker::execute(DeviceRequest& request, DeviceResult& result)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    if(this->cache && this->cache->isEnabled()) {
+        if((request.kind == DeviceRequest::Single && !request.retry.isEnabled()) || request.kind == DeviceRequest::Batch) {
+            this->executeCached(request, result);
+            result.elapsed = timer.nsecsElapsed();
+            return;
+        }
+
+        // Everything else reaches the bus directly, so deferred register writes go first
+        result.ok = this->flushCache(result.schedule);
+
+        if(!result.ok || request.kind == DeviceRequest::CacheFlush) {
+            if(!result.ok)
+                result.error = "Failed to write back cached registers";
+
+            result.elapsed = timer.nsecsElapsed();
+            return;
+        }
+    }
+
+    if(request.kind == DeviceRequest::MemoryRead || request.kind == DeviceRequest::MemoryWrite) {
+        BlockTransfer block(this->device);
+        qint64 reported = 0;
+
+        // Carries on after the bytes done before a reconnect, if any, and reports the whole range
+        BlockProgress before = result.memory;
+        std::size_t done = before.done;
+
+        auto overall = [&before](BlockProgress state) {
+            state.done += before.done;
+            state.total += before.done;
+            state.ackPolls += before.ackPolls;
+            state.elapsed += before.elapsed;
+
+            return state;
+        };
+
+        auto progress = [&](const BlockProgress& state) {
+            if(this->isCancelled(request))
+                return false;
+
+            if(timer.nsecsElapsed() - reported >= memoryReportInterval) {
+                reported = timer.nsecsElapsed();
+                emit memoryProgress(request.id, overall(state));
+            }
+
+            return true;
+        };
+
+        if(request.kind == DeviceRequest::MemoryRead) {
+            result.results.resize(1);
+            result.results.front().read.resize(request.length);
+
+            result.ok = block.read(request.memory, request.offset + done, request.length - done,
+                                   result.results.front().read.data() + done, progress);
+            result.results.front().acked = result.ok;
+        }
+        else
+            result.ok = block.write(request.memory, request.offset + done, request.data.data() + done,
+                                    request.data.size() - done, progress);
+
+        result.memory = overall(block.report());
+
+        if(this->cache && request.kind == DeviceRequest::MemoryWrite && request.length != 0) {
+            unsigned char first = BlockTransfer::addressed(request.memory, request.offset).address;
+            unsigned char last = BlockTransfer::addressed(request.memory, request.offset + request.length - 1).address;
+
+            for(unsigned address = first; address <= last; ++address)
+                this->cache->invalidate(address);
+        }
+
+        if(!result.ok && this->isCancelled(request)) {
+            result.cancelled = true;
+            result.error = "Cancelled";
+        }
+        else if(!result.ok)
+            result.error = QString::fromStdString(block.error());
+    }
+    else if(request.kind == DeviceRequest::Sequence) {
+        const SequenceProgram& program = *request.sequence;
+        SequenceRunner& runner = this->sequencer;
+
+        SequenceRunner::Observer observer;
+        if(this->recorder.isEnabled() || this->trace) {
+            observer = [&](std::size_t transaction, const I2CResult& transactionResult) {
+                this->recorder.record(this->device->deviceNum(), program.transactions[transaction], transactionResult,
+                                      program.names[(qsizetype)transaction]);
+
+                if(this->trace)
+                    this->trace->append(this->device->deviceNum(), program.transactions[transaction], transactionResult);
+            };
+        }
+
+        auto cancelled = [&]() { return this->isCancelled(request); };
+
+        if(result.resumed != 0 && runner.canResume())
+            result.ok = runner.resume(program, result.results, observer, cancelled);
+        else
+            result.ok = runner.run(program, result.results, observer, cancelled);
+        result.sequence = runner.report();
+        result.names = program.labels;
+
+        if(this->cache) {
+            for(const I2CTransaction& transaction : program.transactions)
+                this->cache->forget(transaction);
+        }
+
+        if(!result.ok && cancelled()) {
+            result.cancelled = true;
+            result.error = "Cancelled";
+        }
+        else if(!result.ok)
+            result.error = runner.error();
+    }
+    else if(request.kind == DeviceRequest::Batch || request.kind == DeviceRequest::Scan) {
+        result.ok = this->scheduler.runBatch(request.transactions, request.barriers, request.reorder,
+                                             result.results, result.schedule, request.autoIncrement);
+        this->traceAll(request.transactions, result.results);
+
+        if(!result.ok)
+            result.error = request.kind == DeviceRequest::Scan ? "Failed to scan bus" : "Failed to run batch";
+    }
+    else if(request.kind == DeviceRequest::CacheFlush)
+        result.ok = true; // The cache is off, nothing was deferred
+    else if(!request.transactions.empty()) {
+        I2CTransaction& transaction = request.transactions.front();
+
+        if(!this->scheduler.setSpeed(transaction.speedMode, &result.schedule)) {
+            result.error = "Failed to set bus speed";
+            result.elapsed = timer.nsecsElapsed();
+            return;
+        }
+
+        // As a stream transfer, so a NACK (retried if the request says so) is told apart from a USB failure
+        I2CResult transactionResult;
+
+        bool transferred = request.retry.run(this->device, transaction, [&](I2CResult& attempt) {
+            ++result.schedule.transfers;
+            return this->device->runTransaction(transaction, attempt);
+        }, transactionResult, [&]() { return this->isCancelled(request); });
+
+        result.ok = transferred && transactionResult.acked;
+        result.nacked = transferred && !transactionResult.acked;
+
+        if(!transferred)
+            result.error = "Failed to run command";
+        else if(result.nacked)
+            result.error = "No ACK from device";
+
+        if(this->cache) // Went around the cache, which may hold the register it wrote
+            this->cache->forget(transaction);
+
+        result.results.push_back(std::move(transactionResult));
+        this->traceAll(request.transactions, result.results);
+    }
+
+    result.elapsed = timer.nsecsElapsed();
+}
+
+void DeviceWorker::resume(DeviceRequest& request, DeviceResult& result)
+{
+    qint64 elapsed = result.elapsed;
+    result.error.clear();
+
+    switch(request.kind) {
+        case DeviceRequest::Batch:
+        case DeviceRequest::Scan:
+            this->resumeBatch(request, result);
+            break;
+
+        case DeviceRequest::MemoryRead:
+        case DeviceRequest::MemoryWrite:
+        case DeviceRequest::Sequence:
+            this->execute(request, result); // They go on from result.memory and the sequencer respectively
+            break;
+
+        default: // A single transaction or a cache flush, both start over
+            result.results.clear();
+            this->execute(request, result);
+            break;
+    }
+
+    result.elapsed += elapsed;
+}
+
+void DeviceWorker::resumeBatch(DeviceRequest& request, DeviceResult& result)
+{
+    // Only the transactions without an ACK go out again, the acknowledged ones (also those served by the
+    // register cache) must not reach the bus twice. Those in the failed transfer may or may not have run.
+    DeviceRequest rest = request;
+    std::vector<std::size_t> index;
+
+    rest.transactions.clear();
+    rest.barriers.clear();
+
+    for(std::size_t i = 0; i < request.transactions.size(); ++i) {
+        const I2CResult* done = i < result.results.size() ? &result.results[i] : nullptr;
+
+        if(!done || !done->acked) {
+            index.push_back(i);
+            rest.transactions.push_back(request.transactions[i]);
+        }
+    }
+
+    for(std::size_t barrier : request.barriers) {
+        std::size_t at = std::lower_bound(index.begin(), index.end(), barrier) - index.begin();
+
+        if(rest.barriers.empty() || rest.barriers.back() != at)
+            rest.barriers.push_back(at);
+    }
+
+    DeviceResult part;
+    part.kind = result.kind;
+    part.schedule = result.schedule;
+
+    this->execute(rest, part);
+
+    result.results.resize(request.transactions.size());
+    for(std::size_t i = 0; i < index.size() && i < part.results.size(); ++i)
+        result.results[index[i]] = std::move(part.results[i]);
+
+    result.ok = part.ok;
+    result.error = part.error;
+    result.schedule = part.schedule;
+    result.cached += part.cached;
+    result.elapsed = part.elapsed;
+}
+
+void DeviceWorker::executeCached(DeviceRequest& request, DeviceResult& result)
+{
+    std::vector<std::size_t> origin;
+    std::vector<I2CTransaction> bus = this->cache->plan(request.transactions, result.results, origin, &result.cached);
+
+    result.ok = true;
+
+    if(!bus.empty()) {
+        // A barrier now stands before the first bus transaction at or after it, flush writes
+        // belonging to the transaction they precede
+        std::vector<std::size_t> owner(bus.size());
+        std::size_t next = request.transactions.size();
+
+        for(std::size_t i = bus.size(); i-- != 0;) {
+            if(origin[i] != RegisterCache::fromCache)
+                next = origin[i];
+
+            owner[i] = next;
+        }
+
+        std::vector<std::size_t> barriers;
+        for(std::size_t barrier : request.barriers)
+            barriers.push_back(std::lower_bound(owner.begin(), owner.end(), barrier) - owner.begin());
+
+        std::vector<I2CResult> busResults;
+        result.ok = this->scheduler.runBatch(bus, barriers, request.reorder, busResults, result.schedule, request.autoIncrement);
+
+        this->cache->complete(bus, origin, busResults);
+        this->traceAll(bus, busResults);
+
+        for(std::size_t i = 0; i < bus.size() && i < busResults.size(); ++i) {
+            if(origin[i] != RegisterCache::fromCache)
+                result.results[origin[i]] = std::move(busResults[i]);
+            else if(!busResults[i].acked || busResults[i].batched == 0)
+                result.ok = false;
+        }
+    }
+
+    if(request.kind == DeviceRequest::Single) {
+        result.nacked = result.ok && !result.results.empty() && !result.results.front().acked;
+        result.ok = result.ok && !result.results.empty() && !result.nacked;
+
+        if(result.nacked)
+            result.error = "No ACK from device";
+        else if(!result.ok)
+            result.error = "Failed to run command";
+    }
+    else if(!result.ok)
+        result.error = "Failed to run batch";
+}
+
+bool DeviceWorker::flushCache(ScheduleReport& report)
+{
+    std::vector<std::size_t> origin;
+    std::vector<I2CTransaction> bus = this->cache->flush(origin);
+
+    if(bus.empty())
+        return true;
+
+    std::vector<I2CResult> results;
+    bool ok = this->scheduler.runBatch(bus, {}, false, results, report);
+
+    this->cache->complete(bus, origin, results);
+    this->traceAll(bus, results);
+
+    for(const I2CResult& result : results)
+        ok = ok && result.acked && result.batched != 0;
+
+    return ok;
+}
+
+void DeviceWorker::record(const DeviceRequest& request, const DeviceResult& result)
+{
+    // Single commands and batches only, scans NACK by design, memory transfers have their own report and
+    // sequences record every transaction as it runs
+    if(!this->recorder.isEnabled() || (request.kind != DeviceRequest::Single && request.kind != DeviceRequest::Batch))
+        return;
+
+    for(std::size_t i = 0; i < result.results.size() && i < request.transactions.size(); ++i)
+        this->recorder.record(this->device->deviceNum(), request.transactions[i], result.results[i],
+                              i < (std::size_t)result.names.size() ? result.names[(qsizetype)i] : QString());
+}
+
+void DeviceWorker::traceAll(const std::vector<I2CTransaction>& transactions, const std::vector<I2CResult>& results)
+{
+    if(!this->trace)
+        return;
+
+    for(std::size_t i = 0; i < transactions.size() && i < results.size(); ++i)
+        this->trace->append(this->device->deviceNum(), transactions[i], results[i]);
+}
+
+bool DeviceWorker::reconnect(const std::function<bool()>& cancelled)
+{
+    qint64 timeout = this->reconnectTimeout.load();
+
+    if(timeout <= 0 || this->reconnectFailed || this->device->isAttached())
+        return false;
+
+    ReconnectReport report;
+    report.deviceNum = this->device->deviceNum();
+    report.location = QString::fromStdString(this->device->location());
+
+    emit disconnected(report.deviceNum);
+
+    QElapsedTimer clock;
+    clock.start();
+
+    // Also gives up when the thread is asked to stop
+    while(!(cancelled && cancelled()) && !QThread::currentThread()->isInterruptionRequested()) {
+        ++report.attempts;
+
+        if(this->device->reopen(this->lastSpeedMode)) {
+            report.ok = true;
+            break;
+        }
+
+        if(clock.elapsed() >= timeout)
+            break;
+
+        QThread::msleep(reconnectInterval);
+    }
+
+    report.reopenedAs = this->device->deviceNum();
+    report.driverVersion = report.ok ? this->device->driverVersion() : 0;
+    report.downtime = clock.nsecsElapsed();
+    this->reconnectFailed = !report.ok && clock.elapsed() >= timeout; // Not if cancelled
+
+    // Targets powered by the adapter lost their registers with it: write back what was
+    // deferred and read everything else from the bus again
+    if(report.ok && this->cache && this->cache->isEnabled()) {
+        ScheduleReport flushed;
+        this->flushCache(flushed);
+        this->cache->invalidate();
+    }
+
+    emit reconnected(report);
+
+    return report.ok;
+}
+
+void DeviceWorker::startPolling(const I2CTransaction& transaction, double rate, std::shared_ptr<SampleRing> samples)
+{
+    QMetaObject::invokeMethod(this, [this, transaction, rate, samples]() {
+        this->beginPoll(transaction, rate, samples);
+    }, Qt::QueuedConnection);
+}
+
+void DeviceWorker::stopPolling()
+{
+    QMetaObject::invokeMethod(this, [this]() { this->endPoll(); }, Qt::QueuedConnection);
+}
+
+void DeviceWorker::setAutoReconnect(std::chrono::milliseconds timeout)
+{
+    this->reconnectTimeout.store(timeout.count());
+}
+
+void DeviceWorker::startTrace(std::shared_ptr<TraceWriter> trace)
+{
+    QMetaObject::invokeMethod(this, [this, trace]() { this->trace = trace; }, Qt::QueuedConnection);
+}
+
+void DeviceWorker::stopTrace()
+{
+    QMetaObject::invokeMethod(this, [this]() { this->trace.reset(); }, Qt::QueuedConnection);
+}
+
+void DeviceWorker::beginPoll(const I2CTransaction& transaction, double rate, std::shared_ptr<SampleRing> samples)
+{
+    this->endPoll();
+
+    // Samples bypass the register cache, so nothing it deferred may be left behind them
+    if(this->cache && this->cache->isEnabled()) {
+        ScheduleReport report;
+        this->flushCache(report);
+        this->cache->forget(transaction);
+    }
+
+    Poll& poll = this->poll;
+    poll = Poll();
+    poll.samples = std::move(samples);
+    poll.speedMode = transaction.speedMode;
+    poll.readLength = std::min<std::size_t>(transaction.readLength, poll.samples->sampleLength());
+    poll.transaction = transaction;
+    poll.transaction.readLength = poll.readLength;
+    poll.period = std::max<qint64>(1, std::llround(1e9 / rate));
+
+    poll.stats.running = true;
+    poll.stats.targetRate = rate;
+
+    poll.clock.start();
+    this->pollTick();
+}
+
+void DeviceWorker::endPoll(const QString& error)
+{
+    if(!this->poll.samples)
+        return;
+
+    this->pollTimer->stop();
+
+    this->poll.stats.error = error;
+    this->reportPoll(this->poll.clock.nsecsElapsed());
+    this->poll.stats.running = false;
+    emit pollStatus(this->poll.stats);
+
+    this->poll.samples.reset();
+}
+
+void DeviceWorker::pollTick()
+{
+    Poll& poll = this->poll;
+
+    if(!poll.samples)
+        return;
+
+    qint64 now = poll.clock.nsecsElapsed();
+
+    if(now < poll.deadline) { // Woke up early
+        if(poll.deadline - now >= 1000000) {
+            this->schedulePoll(now);
+            return;
+        }
+
+        // Less than the timer resolution left, sleep it out in one go
+        QThread::usleep((unsigned long)((poll.deadline - now + 999) / 1000));
+        now = std::max(poll.clock.nsecsElapsed(), poll.deadline);
+    }
+
+    // TAKE THE SAMPLE
+    double lateness = (now - poll.deadline) / 1000.0;
+    double delta = lateness - poll.latenessMean;
+
+    poll.latenessMean += delta / (poll.stats.samples + 1);
+    poll.latenessM2 += delta * (lateness - poll.latenessMean);
+    poll.stats.maxLateness = std::max(poll.stats.maxLateness, lateness);
+
+    // As a stream transfer, so a NACK is told apart from a failed USB transfer
+    I2CResult result = { false, {}, 0, 0 };
+    bool transferred = this->scheduler.setSpeed(poll.speedMode) &&
+                       this->device->runTransaction(poll.transaction, result);
+    bool acked = transferred && result.acked;
+
+    unsigned char* sample = poll.samples->nextData();
+    std::copy_n(result.read.begin(), std::min(result.read.size(), poll.readLength), sample);
+
+    if(this->trace) {
+        result.acked = acked;
+        this->trace->append(this->device->deviceNum(), poll.transaction, result);
+    }
+
+    poll.samples->commit(now, acked);
+    ++poll.stats.samples;
+
+    if(acked) {
+        poll.failures = 0;
+        this->lastSpeedMode = poll.speedMode;
+    }
+    else {
+        if(transferred)
+            ++poll.stats.nacks;
+
+        // Sampling carries on once the adapter is back, the deadlines passed meanwhile count as missed
+        if(!transferred && !this->device->isAttached() && this->reconnectTimeout.load() > 0) {
+            if(!this->reconnect(nullptr)) {
+                this->endPoll("Lost the device");
+                return;
+            }
+        }
+        else if(++poll.failures == maxPollFailures) {
+            this->endPoll("Failed to run command");
+            return;
+        }
+    }
+
+    // NEXT DEADLINE, skipping (not bursting through) the ones already overrun
+    qint64 after = poll.clock.nsecsElapsed();
+    poll.deadline += poll.period;
+
+    if(after >= poll.deadline + poll.period) {
+        qint64 missed = (after - poll.deadline) / poll.period;
+
+        poll.deadline += missed * poll.period;
+        poll.stats.missed += missed;
+    }
+
+    if(after - poll.reported >= pollReportInterval) {
+        this->reportPoll(after);
+        emit pollStatus(poll.stats);
+    }
+
+    this->schedulePoll(after);
+}
+
+void DeviceWorker::schedulePoll(qint64 now)
+{
+    // Timers only resolve milliseconds, the fraction left when it fires is slept by pollTick
+    qint64 remaining = this->poll.deadline - now;
+
+    this->pollTimer->start((int)std::max<qint64>(0, remaining / 1000000));
+}
+
+void DeviceWorker::reportPoll(qint64 now)
+{
+    Poll& poll = this->poll;
+
+    if(now > poll.reported)
+        poll.stats.rate = (poll.stats.samples - poll.reportedSamples) * 1e9 / (now - poll.reported);
+
+    if(poll.stats.samples > 1)
+        poll.stats.jitter = std::sqrt(poll.latenessM2 / (poll.stats.samples - 1));
+
+    poll.reported = now;
+    poll.reportedSamples = poll.stats.samples;
+}
@@ -0,0 +1,231 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef DEVICEWORKER_H
+#define DEVICEWORKER_H
+
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QStringList>
+
+#include "blocktransfer.h"
+#include "ch341stream.h"
+#include "registercache.h"
+#include "retrypolicy.h"
+#include "samplering.h"
+#include "sequencerunner.h"
+#include "spscqueue.h"
+#include "tracelog.h"
+#include "streamscheduler.h"
+#include "transactionstats.h"
+
+class I2CTransport;
+class QTimer;
+
+struct DeviceRequest {
+    enum Kind {
+        Single,                                 // One transaction through setStream + streamI2C
+        Batch,                                  // Transactions packed into stream transfers
+        Scan,                                   // Batch of address probes
+        MemoryRead,                             // length bytes of memory from offset
+        MemoryWrite,                            // data into memory at offset
+        Sequence,                               // Compiled sequence, interpreted on the device thread
+        CacheFlush                              // Writes out the register writes the cache deferred
+    };
+
+    quint64 id = 0;
+    Kind kind = Single;
+    bool reorder = false;                       // Let the scheduler group batch commands by speed mode
+    std::vector<std::size_t> barriers;          // Batch indices commands may not be reordered (or merged) across
+    std::bitset<128> autoIncrement;             // Devices whose consecutive batch register writes are merged into bursts
+    std::vector<I2CTransaction> transactions;
+    QStringList names;                          // Passed through to the result for display
+    RetryPolicy retry;                          // Single only, such requests bypass the register cache
+
+    MemoryLayout memory;
+    std::size_t offset = 0;
+    std::size_t length = 0;
+    std::vector<unsigned char> data;
+
+    std::shared_ptr<const SequenceProgram> sequence;
+
+    std::function<bool()> cancelled;            // Thread safe, polled before the request starts and while memory transfers and sequences run
+    const void* owner = nullptr;                // Submitter tag, passed through to the result
+};
+
+struct DeviceResult {
+    quint64 id = 0;
+    DeviceRequest::Kind kind = DeviceRequest::Single;
+    bool ok = false;
+    bool cancelled = false;
+    QString error;
+    std::vector<I2CResult> results;
+    QStringList names;
+    const void* owner = nullptr;
+    ScheduleReport schedule;
+    BlockProgress memory;                       // Memory reads/writes only, the read data is in results
+    SequenceReport sequence;                    // Sequences only, results holds the last run of every transaction
+    std::size_t offset = 0;
+    qint64 elapsed = 0;                         // Nanoseconds spent in the transport
+    std::size_t cached = 0;                     // Transactions served from (or deferred by) the register cache
+    bool nacked = false;                        // Single only: the transfer went through but the device did not ACK
+    int resumed = 0;                            // Times the request was picked up again where it stopped after the adapter was reopened
+};
+
+struct ReconnectReport {
+    bool ok = false;
+    unsigned long deviceNum = 0;                // Before the adapter dropped off the bus
+    unsigned long reopenedAs = 0;               // Device number it came back under
+    unsigned long driverVersion = 0;            // Of the reopened adapter, read on the device thread
+    QString location;                           // See I2CTransport::location(), the same before and after
+    int attempts = 0;
+    qint64 downtime = 0;                        // Nanoseconds from noticing it was gone until it answered again (or was given up on)
+};
+
+Q_DECLARE_METATYPE(DeviceResult)
+Q_DECLARE_METATYPE(BlockProgress)
+Q_DECLARE_METATYPE(ReconnectReport)
+
+struct PollStats {
+    bool running = false;
+    QString error;                              // Why polling stopped on its own
+    quint64 samples = 0;
+    quint64 nacks = 0;
+    quint64 missed = 0;                         // Deadlines skipped because the previous sample overran them
+    double targetRate = 0;                      // Hz
+    double rate = 0;                            // Hz, achieved since the last report
+    double jitter = 0;                          // Standard deviation of the start lateness, microseconds
+    double maxLateness = 0;                     // Microseconds
+};
+
+Q_DECLARE_METATYPE(PollStats)
+
+// Owns the transport once started and runs every request on its own thread.
+// Requests come in through a lock-free queue filled by the GUI thread, results
+// go back through the (queued) finished signal. Every command and batch
+// transaction is recorded into stats, if given, and into the trace while one
+// is set (everything but memory transfers). With automatic reconnects on, a
+// request failing because the adapter dropped off the bus waits for it to be
+// reopened and then goes on where it stopped, so nothing queued is lost and
+// nothing acknowledged is sent twice.
+class DeviceWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DeviceWorker(I2CTransport* transport, std::shared_ptr<TransactionStats> stats = nullptr,
+                          std::shared_ptr<RegisterCache> cache = nullptr);
+
+    I2CTransport* transport() const { return this->device; }
+
+    // GUI thread only. Returns the request id, or 0 if the queue is full.
+    quint64 submit(DeviceRequest request);
+    // GUI thread only. Every request submitted so far without an owner that has not started yet
+    // finishes as cancelled, the owners of the others cancel them themselves.
+    void cancelPending();
+    int pending() const { return this->pendingCount.load(); }
+
+    // Thread safe. Runs transaction at rate Hz in between requests and stores
+    // every sample in samples until stopPolling() (or too many failures).
+    void startPolling(const I2CTransaction& transaction, double rate, std::shared_ptr<SampleRing> samples);
+    void stopPolling();
+
+    // Thread safe. Appends every transaction from now on to trace, until stopTrace().
+    void startTrace(std::shared_ptr<TraceWriter> trace);
+    void stopTrace();
+
+    // Thread safe. How long to keep trying to reopen an adapter that dropped
+    // off the bus before failing the request, zero turns reconnecting off.
+    void setAutoReconnect(std::chrono::milliseconds timeout);
+
+signals:
+    void finished(const DeviceResult& result);
+    // Sent several times a second while a memory read/write runs
+    void memoryProgress(quint64 id, const BlockProgress& progress);
+    // Sent a few times a second while polling, and once more when it stops
+    void pollStatus(const PollStats& stats);
+    // Sent when a failed transfer turns out to be a lost adapter, then once it is back or given up on
+    void disconnected(unsigned long deviceNum);
+    void reconnected(const ReconnectReport& report);
+
+private slots:
+    void drain();
+    void pollTick();
+
+private:
+    I2CTransport* device;
+    StreamScheduler scheduler;
+    SequenceRunner sequencer;                   // Kept between requests so an interrupted sequence can resume
+    TransactionRecorder recorder;
+    std::shared_ptr<RegisterCache> cache;
+    std::shared_ptr<TraceWriter> trace;         // Device thread only
+    SpscQueue<DeviceRequest, 256> queue;
+
+    quint64 nextId = 1;
+    std::atomic<quint64> cancelledUpTo{0};
+    std::atomic<bool> drainScheduled{false};
+    std::atomic<int> pendingCount{0};
+    std::atomic<qint64> reconnectTimeout{0};    // Milliseconds
+
+    // Device thread only
+    long lastSpeedMode = -1;                    // Last mode the adapter was known to be in, restored after a reconnect
+    bool reconnectFailed = false;               // Not tried again once given up on, the user has to reconnect
+
+    // Device thread only
+    struct Poll {
+        std::shared_ptr<SampleRing> samples;
+        I2CTransaction transaction = { 0, {}, 0, 0 }; // Read length capped to the sample length, for the trace
+        unsigned long speedMode = 0;
+        std::size_t readLength = 0;
+
+        QElapsedTimer clock;
+        qint64 period = 0;                      // Nanoseconds
+        qint64 deadline = 0;
+        qint64 reported = 0;
+        quint64 reportedSamples = 0;
+        int failures = 0;                       // In a row
+
+        double latenessMean = 0;                // Running mean/variance (Welford) of the start lateness
+        double latenessM2 = 0;
+        PollStats stats;
+    } poll;
+    QTimer* pollTimer;
+
+    bool isCancelled(const DeviceRequest& request) const;
+    void execute(DeviceRequest& request, DeviceResult& result);
+    // Runs what an interrupted execute() left undone, keeping the results it got
+    void resume(DeviceRequest& request, DeviceResult& result);
+    void resumeBatch(DeviceRequest& request, DeviceResult& result);
+    void executeCached(DeviceRequest& request, DeviceResult& result);
+    bool flushCache(ScheduleReport& report);
+    void record(const DeviceRequest& request, const DeviceResult& result);
+    void traceAll(const std::vector<I2CTransaction>& transactions, const std::vector<I2CResult>& results);
+    // Reopens the adapter if it is gone, true once it is back
+    bool reconnect(const std::function<bool()>& cancelled);
+
+    void beginPoll(const I2CTransaction& transaction, double rate, std::shared_ptr<SampleRing> samples);
+    void endPoll(const QString& error = QString());
+    void schedulePoll(qint64 now);
+    void reportPoll(qint64 now);
+};
+
+#endif // DEVICEWORKER_H
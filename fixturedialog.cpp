@@ -0,0 +1,298 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "fixturedialog.h"
+#include "ui_fixturedialog.h"
+
+#include <QBrush>
+#include <QColor>
+#include <QDebug>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QTableWidgetItem>
+
+#include "commandmodel.h"
+
+namespace {
+
+QString throughputText(std::size_t bytes, qint64 elapsed)
+{
+    if(elapsed <= 0)
+        return "-";
+
+    double rate = bytes * 1000000000.0 / elapsed;
+
+    return rate >= 1024 ? QString::number(rate / 1024, 'f', 1) + " KiB/s" : QString::number(rate, 'f', 0) + " B/s";
+}
+
+}
+
+FixtureDialog::FixtureDialog(const I2CTransport* prototype, const CommandModel* commands, std::shared_ptr<TransactionStats> stats,
+                             const QString& devices, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::FixtureDialog),
+    commands(commands),
+    pool(prototype, std::move(stats))
+{
+    ui->setupUi(this);
+    this->setWindowTitle("Run Fixture");
+
+    ui->adapterTableWidget->setColumnCount(ColumnCount);
+    ui->adapterTableWidget->setHorizontalHeaderLabels({ "Device", "Sequence (; separated)", "Status", "Commands", "NACKs", "Time", "Throughput" });
+    ui->adapterTableWidget->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    ui->adapterTableWidget->horizontalHeader()->setSectionResizeMode(SequenceColumn, QHeaderView::Stretch);
+    ui->adapterTableWidget->verticalHeader()->setVisible(false);
+
+    // DEFAULT SEQUENCE = EVERY COMMAND IN THE LIBRARY
+    QStringList names;
+    for(std::size_t row = 0; row < this->commands->size(); ++row)
+        names.append(this->commands->command(row).name);
+
+    ui->sequenceTextEdit->setPlainText(names.join("\n"));
+    ui->devicesLineEdit->setText(devices);
+
+    connect(&this->pool, &DevicePool::finished, this, &FixtureDialog::onDeviceResult);
+    connect(&this->pool, &DevicePool::disconnected, this, [this](int adapter) {
+        if((std::size_t)adapter < this->runs.size() && this->runs[adapter].id)
+            this->setCell(adapter, StatusColumn, "Reconnecting");
+    });
+    connect(&this->pool, &DevicePool::reconnected, this, &FixtureDialog::onDeviceReconnected);
+}
+
+FixtureDialog::~FixtureDialog()
+{
+    this->pool.close();
+    delete ui;
+}
+
+void FixtureDialog::on_openButton_clicked()
+{
+    std::vector<unsigned long> devices;
+
+    if(!DevicePool::parseDevices(ui->devicesLineEdit->text(), devices)) {
+        qDebug() << "Invalid device list!\n";
+        QMessageBox::warning(this, " ", "Invalid device list, expected e.g. \"0-3, 6\"!");
+        return;
+    }
+
+    // REOPEN EVERY ADAPTER
+    this->pool.close();
+    this->runs.clear();
+    this->running = 0;
+    ui->adapterTableWidget->setRowCount(0);
+
+    QString errors = "";
+
+    for(unsigned long device : devices) {
+        QString error;
+
+        if(!this->pool.open(device, &error)) {
+            errors += "\n" + error;
+            continue;
+        }
+
+        int row = ui->adapterTableWidget->rowCount();
+        ui->adapterTableWidget->insertRow(row);
+
+        for(int column = 0; column < ColumnCount; ++column) {
+            QTableWidgetItem* item = new QTableWidgetItem(column == DeviceColumn ? "#" + QString::number(device) : "");
+
+            if(column != SequenceColumn)
+                item->setFlags(item->flags() & ~Qt::ItemIsEditable);
+
+            ui->adapterTableWidget->setItem(row, column, item);
+        }
+    }
+
+    this->runs.resize(this->pool.size());
+    ui->statusLabel->setText(QString::number(this->pool.size()) + " adapter(s) open");
+
+    if(!errors.isEmpty()) {
+        qDebug().noquote() << "Failed to open:" << errors << "\n";
+        QMessageBox::warning(this, " ", "Failed to open:" + errors);
+    }
+}
+
+void FixtureDialog::on_runButton_clicked()
+{
+    if(this->running) // Still waiting for the last run
+        return;
+
+    if(this->pool.size() == 0) {
+        qDebug() << "No adapters open!\n";
+        QMessageBox::warning(this, " ", "Open at least one adapter first!");
+        return;
+    }
+
+    // COLLECT EVERY ADAPTER'S COMMANDS BEFORE STARTING ANY OF THEM
+    QStringList shared = ui->sequenceTextEdit->toPlainText().split('\n');
+    std::vector<DeviceRequest> requests(this->pool.size());
+    QString unknownCommands = "";
+
+    for(std::size_t adapter = 0; adapter < this->pool.size(); ++adapter) {
+        QString own = ui->adapterTableWidget->item((int)adapter, SequenceColumn)->text().trimmed();
+        QStringList lines = own.isEmpty() ? shared : own.split(';');
+
+        DeviceRequest& request = requests[adapter];
+        request.kind = DeviceRequest::Batch;
+        this->runs[adapter].bytes = 0;
+
+        for(const QString& line : lines) {
+            QString name = line.trimmed();
+
+            if(name.isEmpty())
+                continue;
+
+            if(name == "---") { // Ordering barrier
+                request.barriers.push_back(request.transactions.size());
+                continue;
+            }
+
+            std::vector<Command> commands;
+
+            if(!this->commands->expand(name, commands)) {
+                unknownCommands += "\n#" + QString::number(this->pool.deviceNum(adapter)) + ": \"" + name + "\"";
+                continue;
+            }
+
+            for(const Command& command : commands) {
+                request.names.append(command.name);
+                request.transactions.push_back(command.transaction());
+                this->runs[adapter].bytes += request.transactions.back().busBytes();
+            }
+        }
+    }
+
+    if(!unknownCommands.isEmpty()) {
+        qDebug().noquote() << "Unknown commands:" << unknownCommands << "\n";
+        QMessageBox::warning(this, " ", "Unknown commands:" + unknownCommands);
+        return;
+    }
+
+    // START EVERY ADAPTER
+    this->busyTime = 0;
+    this->wallClock.start();
+
+    for(std::size_t adapter = 0; adapter < this->pool.size(); ++adapter) {
+        int row = (int)adapter;
+
+        for(int column = StatusColumn; column < ColumnCount; ++column)
+            this->setCell(row, (Column)column, "");
+
+        ui->adapterTableWidget->item(row, StatusColumn)->setBackground(QBrush());
+
+        if(requests[adapter].transactions.empty()) {
+            this->runs[adapter].id = 0;
+            this->setCell(row, StatusColumn, "Nothing to run");
+            continue;
+        }
+
+        this->setCell(row, CommandsColumn, QString::number(requests[adapter].transactions.size()));
+        this->runs[adapter].id = this->pool.worker(adapter)->submit(std::move(requests[adapter]));
+
+        if(!this->runs[adapter].id) {
+            this->setCell(row, StatusColumn, "Queue full");
+            continue;
+        }
+
+        this->setCell(row, StatusColumn, "Running");
+        ++this->running;
+    }
+
+    if(!this->running)
+        return;
+
+    ui->statusLabel->setText("Running on " + QString::number(this->running) + " adapter(s)...");
+    ui->runButton->setEnabled(false);
+    ui->openButton->setEnabled(false);
+    ui->cancelButton->setEnabled(true);
+}
+
+void FixtureDialog::on_cancelButton_clicked()
+{
+    for(std::size_t adapter = 0; adapter < this->pool.size(); ++adapter)
+        this->pool.worker(adapter)->cancelPending();
+}
+
+void FixtureDialog::onDeviceResult(int adapter, const DeviceResult& result)
+{
+    if(adapter < 0 || (std::size_t)adapter >= this->runs.size() || result.id != this->runs[adapter].id)
+        return;
+
+    this->runs[adapter].id = 0;
+    this->busyTime += result.elapsed;
+
+    QTableWidgetItem* status = ui->adapterTableWidget->item(adapter, StatusColumn);
+
+    if(!result.ok) {
+        status->setText(result.cancelled ? "Cancelled" : "Failed: " + result.error);
+        status->setBackground(QBrush(QColor(Qt::red)));
+        qDebug().noquote() << "FIXTURE: device #" + QString::number(this->pool.deviceNum(adapter)) << status->text();
+    }
+    else {
+        int nacks = 0;
+        for(const I2CResult& i2cResult : result.results)
+            nacks += !i2cResult.acked;
+
+        status->setText(nacks ? "NACK" : "OK");
+        status->setBackground(QBrush(QColor(nacks ? Qt::red : Qt::green)));
+
+        this->setCell(adapter, NacksColumn, QString::number(nacks));
+        this->setCell(adapter, TimeColumn, QString::number(result.elapsed / 1000000.0, 'f', 2) + " ms");
+        this->setCell(adapter, ThroughputColumn, throughputText(this->runs[adapter].bytes, result.elapsed));
+    }
+
+    if(--this->running == 0)
+        this->finishRun();
+}
+
+void FixtureDialog::onDeviceReconnected(int adapter, const ReconnectReport& report)
+{
+    QString downtime = QString::number(report.downtime / 1000000.0, 'f', 1) + " ms";
+
+    qDebug().noquote() << "FIXTURE: device #" + QString::number(report.deviceNum) <<
+                          (report.ok ? "reopened as #" + QString::number(report.reopenedAs) + " after " + downtime
+                                     : "did not come back within " + downtime);
+
+    if((std::size_t)adapter < this->runs.size() && this->runs[adapter].id && report.ok)
+        this->setCell(adapter, StatusColumn, "Running (resumed after " + downtime + ")");
+}
+
+void FixtureDialog::setCell(int row, Column column, const QString& text) // HELPER FUNCTION TO SET A TABLE CELL
+{
+    ui->adapterTableWidget->item(row, column)->setText(text);
+}
+
+void FixtureDialog::finishRun()                                         // HELPER FUNCTION TO SUMMARIZE A RUN
+{
+    std::size_t bytes = 0;
+    for(const Run& run : this->runs)
+        bytes += run.bytes;
+
+    qint64 wall = this->wallClock.nsecsElapsed();
+
+    // Adapters run side by side, so the wall time should be close to the slowest one rather than the sum
+    QString status = QString::number(this->pool.size()) + " adapter(s) in " + QString::number(wall / 1000000.0, 'f', 2) +
+                     " ms (" + QString::number(this->busyTime / 1000000.0, 'f', 2) + " ms of device time, " +
+                     throughputText(bytes, wall) + " total)";
+
+    ui->statusLabel->setText(status);
+    qDebug().noquote() << "FIXTURE:" << status;
+
+    ui->runButton->setEnabled(true);
+    ui->openButton->setEnabled(true);
+    ui->cancelButton->setEnabled(false);
+}
@@ -0,0 +1,79 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef FIXTUREDIALOG_H
+#define FIXTUREDIALOG_H
+
+#include <memory>
+#include <vector>
+#include <QDialog>
+#include <QElapsedTimer>
+
+#include "devicepool.h"
+
+class CommandModel;
+
+namespace Ui {
+class FixtureDialog;
+}
+
+// Opens several adapters and runs a command sequence on all of them at once,
+// each on its own device thread. Every adapter runs the shared sequence
+// unless it has its own, and reports its status and throughput separately.
+class FixtureDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    FixtureDialog(const I2CTransport* prototype, const CommandModel* commands, std::shared_ptr<TransactionStats> stats,
+                  const QString& devices, QWidget *parent = nullptr);
+    ~FixtureDialog();
+
+    void setAutoReconnect(std::chrono::milliseconds timeout) { this->pool.setAutoReconnect(timeout); }
+
+private slots:
+    void on_openButton_clicked();
+
+    void on_runButton_clicked();
+
+    void on_cancelButton_clicked();
+
+    void onDeviceResult(int adapter, const DeviceResult& result);
+
+    void onDeviceReconnected(int adapter, const ReconnectReport& report);
+
+private:
+    enum Column { DeviceColumn, SequenceColumn, StatusColumn, CommandsColumn, NacksColumn, TimeColumn, ThroughputColumn, ColumnCount };
+
+    struct Run {
+        quint64 id = 0;
+        std::size_t bytes = 0;                  // Bytes on the bus, for the throughput
+    };
+
+    Ui::FixtureDialog *ui;
+    const CommandModel* commands;
+    DevicePool pool;
+
+    std::vector<Run> runs;
+    std::size_t running = 0;
+    qint64 busyTime = 0;                        // Nanoseconds, summed over the adapters
+    QElapsedTimer wallClock;
+
+    void setCell(int row, Column column, const QString& text);
+    void finishRun();
+};
+
+#endif // FIXTUREDIALOG_H
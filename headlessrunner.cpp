@@ -0,0 +1,563 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "headlessrunner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+
+#include "commandcsv.h"
+#include "devicepool.h"
+#include "i2ctransport.h"
+#include "tracereplay.h"
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+namespace {
+
+const char hexDigits[] = "0123456789abcdef";
+
+std::string jsonString(const QString& text)
+{
+    std::string escaped = "\"";
+
+    for(unsigned char c : text.toUtf8().toStdString()) {
+        switch(c) {
+            case '"':  escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n";  break;
+            case '\r': escaped += "\\r";  break;
+            case '\t': escaped += "\\t";  break;
+            default:
+                if(c < 0x20) {
+                    escaped += "\\u00";
+                    escaped += hexDigits[c >> 4];
+                    escaped += hexDigits[c & 0x0F];
+                }
+                else
+                    escaped += c;
+        }
+    }
+
+    return escaped + '"';
+}
+
+std::string hexString(const std::vector<unsigned char>& bytes)
+{
+    std::string text;
+    text.reserve(bytes.size() * 2);
+
+    for(unsigned char byte : bytes) {
+        text += hexDigits[byte >> 4];
+        text += hexDigits[byte & 0x0F];
+    }
+
+    return text;
+}
+
+long long microsecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+const std::chrono::milliseconds reconnectInterval(250);   // Between attempts to reopen a lost adapter
+const int maxResumes = 3;                                   // Reconnects a single command or batch may go through
+
+}
+
+int HeadlessRunner::exec(const QStringList& arguments)
+{
+#ifdef Q_OS_WIN
+    // Built as a GUI program, so there is no console unless the parent has one (pipes work either way)
+    if(!GetStdHandle(STD_OUTPUT_HANDLE) && AttachConsole(ATTACH_PARENT_PROCESS)) {
+        std::freopen("CONOUT$", "w", stdout);
+        std::freopen("CONOUT$", "w", stderr);
+    }
+#endif
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs saved commands without opening a window.");
+    parser.addHelpOption();
+
+    QCommandLineOption runOption("run", "Run commands without a window.");
+    QCommandLineOption deviceOption({ "d", "device" }, "CH341 device number(s), e.g. 0 or 0-3,6 (default 0).", "numbers", "0");
+    QCommandLineOption libraryOption({ "l", "library" }, "Command library (.csv or .ch341lib, the latter opens fastest).", "file");
+    QCommandLineOption sequenceOption({ "s", "sequence" }, "File listing the commands to run, one per line.", "file");
+    QCommandLineOption formatOption({ "f", "format" }, "json (one line per command) or raw (read data only).", "format", "json");
+    QCommandLineOption batchOption({ "b", "batch" }, "Pack all commands into as few USB transfers as possible (no per command timing).");
+    QCommandLineOption simulateOption("simulate", "Use the simulated bus instead of a CH341.");
+    QCommandLineOption replayOption("replay", "Replay a recorded trace and compare the read back with it.", "file");
+    QCommandLineOption timingOption("timing", "Replay timing: fast (as fast as possible) or original.", "timing", "fast");
+    QCommandLineOption traceOption("trace", "Record every transaction into a trace file (.ch341trc) for --replay.", "file");
+    QCommandLineOption reconnectOption("reconnect", "Reopen an adapter that drops off the bus for up to this long and resume (default 0, off).", "seconds", "0");
+
+    parser.addOptions({ runOption, deviceOption, libraryOption, sequenceOption, formatOption, batchOption, simulateOption,
+                        replayOption, timingOption, traceOption, reconnectOption });
+    parser.addPositionalArgument("commands", "Command names or #tags to run, after those of the sequence file.", "[commands...]");
+
+    if(!parser.parse(arguments)) {
+        std::fprintf(stderr, "%s\n", qPrintable(parser.errorText()));
+        return UsageError;
+    }
+
+    if(parser.isSet("help"))
+        parser.showHelp(Success);
+
+    // OPTIONS
+    std::vector<unsigned long> devices;
+
+    if(!DevicePool::parseDevices(parser.value(deviceOption), devices)) {
+        std::fprintf(stderr, "Invalid device list \"%s\"\n", qPrintable(parser.value(deviceOption)));
+        return UsageError;
+    }
+
+    this->tagDevices = devices.size() > 1;
+
+    bool reconnectOk;
+    double reconnectSeconds = parser.value(reconnectOption).toDouble(&reconnectOk);
+
+    if(!reconnectOk || reconnectSeconds < 0 || reconnectSeconds > 3600) {
+        std::fprintf(stderr, "Invalid reconnect time \"%s\"\n", qPrintable(parser.value(reconnectOption)));
+        return UsageError;
+    }
+
+    this->reconnectTimeout = std::chrono::milliseconds((long long)(reconnectSeconds * 1000));
+
+    if(parser.value(formatOption) == "raw") {
+        this->format = Raw;
+#ifdef Q_OS_WIN
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+    else if(parser.value(formatOption) != "json") {
+        std::fprintf(stderr, "Unknown format \"%s\"\n", qPrintable(parser.value(formatOption)));
+        return UsageError;
+    }
+
+    if(this->format == Raw && this->tagDevices) {
+        std::fprintf(stderr, "Raw output needs a single device\n");
+        return UsageError;
+    }
+
+    if(parser.isSet(replayOption)) {
+        if(devices.size() != 1 || this->format != JsonLines) {
+            std::fprintf(stderr, "Replaying needs a single device and JSON output\n");
+            return UsageError;
+        }
+
+        if(parser.value(timingOption) != "fast" && parser.value(timingOption) != "original") {
+            std::fprintf(stderr, "Unknown timing \"%s\"\n", qPrintable(parser.value(timingOption)));
+            return UsageError;
+        }
+
+        return this->replay(parser.value(replayOption), parser.isSet(simulateOption), parser.value(timingOption) == "original", devices[0]);
+    }
+
+    if(!parser.isSet(libraryOption)) {
+        std::fprintf(stderr, "No command library given (--library)\n");
+        return UsageError;
+    }
+
+    if(!this->loadLibrary(parser.value(libraryOption)))
+        return UsageError;
+
+    // COMMANDS
+    QStringList lines;
+
+    if(parser.isSet(sequenceOption)) {
+        QFile sequence(parser.value(sequenceOption));
+
+        if(!sequence.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            std::fprintf(stderr, "Failed to open \"%s\" (%s)\n", qPrintable(sequence.fileName()), qPrintable(sequence.errorString()));
+            return UsageError;
+        }
+
+        lines = QString::fromUtf8(sequence.readAll()).split('\n');
+    }
+
+    lines += parser.positionalArguments();
+
+    std::vector<Command> commands;
+    if(!this->collect(lines, commands))
+        return UsageError;
+
+    if(parser.isSet(traceOption)) {
+        QString error;
+        this->trace = std::make_unique<TraceWriter>();
+
+        if(!this->trace->open(parser.value(traceOption), &error)) {
+            std::fprintf(stderr, "Failed to open \"%s\" (%s)\n", qPrintable(parser.value(traceOption)), qPrintable(error));
+            return UsageError;
+        }
+    }
+
+    // DEVICES (one thread each, so several adapters take as long as the slowest one)
+    std::vector<Outcome> outcomes(devices.size());
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+
+    for(std::size_t i = 0; i < devices.size(); ++i) {
+        outcomes[i].deviceNum = devices[i];
+
+        if(devices.size() == 1)
+            this->run(parser.isSet(simulateOption), parser.isSet(batchOption), commands, outcomes[i]);
+        else
+            threads.emplace_back(&HeadlessRunner::run, this, parser.isSet(simulateOption), parser.isSet(batchOption),
+                                 std::cref(commands), std::ref(outcomes[i]));
+    }
+
+    for(std::thread& thread : threads)
+        thread.join();
+
+    Outcome total;
+    total.elapsedUs = microsecondsSince(start);
+
+    for(const Outcome& outcome : outcomes) {
+        total.exitCode = std::max(total.exitCode, outcome.exitCode);
+        total.commands += outcome.commands;
+        total.nacks += outcome.nacks;
+        total.transfers += outcome.transfers;
+        total.reconnects += outcome.reconnects;
+    }
+
+    if(this->tagDevices && this->format == JsonLines) {
+        char line[256];
+        std::snprintf(line, sizeof(line), "{\"total\":{\"devices\":%zu,\"failed\":%zu,\"commands\":%zu,\"nacks\":%zu,\"transfers\":%zu,\"reconnects\":%zu,\"elapsed_us\":%lld}}\n",
+                      outcomes.size(), (std::size_t)std::count_if(outcomes.begin(), outcomes.end(), [](const Outcome& outcome) { return outcome.exitCode == DeviceError; }),
+                      total.commands, total.nacks, total.transfers, total.reconnects, total.elapsedUs);
+        this->print(line);
+    }
+
+    std::fflush(this->out);
+
+    return total.exitCode;
+}
+
+int HeadlessRunner::replay(const QString& path, bool simulate, bool originalTiming, unsigned long deviceNum)
+{
+    TraceReader trace;
+    QString error;
+
+    if(!trace.open(path, &error)) {
+        std::fprintf(stderr, "Failed to open \"%s\" (%s)\n", qPrintable(path), qPrintable(error));
+        return UsageError;
+    }
+
+    std::unique_ptr<I2CTransport> transport(I2CTransport::create(simulate));
+
+    if(!transport->open(deviceNum)) {
+        std::fprintf(stderr, "Failed to open %s device #%lu\n", transport->name(), deviceNum);
+        return DeviceError;
+    }
+
+    auto mismatch = [&](std::size_t record, const TraceRecord& recorded, const I2CResult& replayed) {
+        char address[8];
+        std::snprintf(address, sizeof(address), "0x%02x", recorded.transaction.address);
+
+        this->print("{\"record\":" + std::to_string(record) + ",\"t_us\":" + std::to_string(recorded.timestamp / 1000) +
+                    ",\"address\":\"" + address + "\",\"write\":\"" + hexString(recorded.transaction.write) +
+                    "\",\"recorded_ack\":" + (recorded.result.acked ? "true" : "false") + ",\"ack\":" + (replayed.acked ? "true" : "false") +
+                    ",\"recorded\":\"" + hexString(recorded.result.read) + "\",\"read\":\"" + hexString(replayed.read) + "\"}\n");
+    };
+
+    TraceReplay replay(transport.get());
+    bool ok = replay.run(trace, originalTiming ? TraceReplay::OriginalTiming : TraceReplay::AsFastAsPossible, mismatch);
+
+    transport->close();
+
+    if(!ok)
+        std::fprintf(stderr, "%s\n", qPrintable(replay.error()));
+
+    const TraceReplayReport& report = replay.report();
+    char line[256];
+    std::snprintf(line, sizeof(line), "{\"replay\":{\"transactions\":%zu,\"skipped\":%zu,\"mismatches\":%zu,\"transfers\":%zu,\"elapsed_us\":%lld,\"recorded_us\":%lld}}\n",
+                  report.transactions, report.skipped, report.mismatches, report.transfers,
+                  (long long)(report.elapsed.count() / 1000), (long long)(report.recorded.count() / 1000));
+    this->print(line);
+
+    std::fflush(this->out);
+
+    if(!ok)
+        return trace.damaged() ? UsageError : DeviceError;
+
+    return report.mismatches == 0 ? Success : Nacked;
+}
+
+bool HeadlessRunner::loadLibrary(const QString& path)
+{
+    if(QFileInfo(path).suffix() == CommandLibrary::suffix) {
+        std::shared_ptr<CommandLibrary> library = std::make_shared<CommandLibrary>();
+        QString error;
+
+        if(!library->open(path, &error)) {
+            std::fprintf(stderr, "Failed to open \"%s\" (%s)\n", qPrintable(path), qPrintable(error));
+            return false;
+        }
+
+        this->library.setLibrary(library);
+        return true;
+    }
+
+    CommandCsv::LoadResult result;
+
+    if(!CommandCsv::load(path, result)) {
+        std::fprintf(stderr, "Failed to open \"%s\" (%s)\n", qPrintable(path), qPrintable(result.error));
+        return false;
+    }
+
+    for(const CommandCsv::Rejected& rejected : result.rejected)
+        std::fprintf(stderr, "Skipped invalid command \"%s\" (row %zu)\n", qPrintable(rejected.name), rejected.row);
+
+    this->library.setCommands(std::move(result.commands));
+    return true;
+}
+
+bool HeadlessRunner::collect(const QStringList& lines, std::vector<Command>& commands)
+{
+    bool ok = true;
+
+    for(const QString& line : lines) {
+        QString name = line.trimmed();
+
+        if(name.isEmpty() || name == "---") // Ordering barriers only matter to the GUI's reordering batches
+            continue;
+
+        if(!this->library.expand(name, commands)) {
+            std::fprintf(stderr, "Unknown command \"%s\"\n", qPrintable(name));
+            ok = false;
+        }
+    }
+
+    if(ok && commands.empty()) {
+        std::fprintf(stderr, "No commands to run\n");
+        ok = false;
+    }
+
+    return ok;
+}
+
+void HeadlessRunner::run(bool simulate, bool batch, const std::vector<Command>& commands, Outcome& outcome)
+{
+    std::unique_ptr<I2CTransport> transport(I2CTransport::create(simulate));
+
+    if(!transport->open(outcome.deviceNum)) {
+        std::fprintf(stderr, "Failed to open %s device #%lu\n", transport->name(), outcome.deviceNum);
+        outcome.exitCode = DeviceError;
+        return;
+    }
+
+    if(batch)
+        this->runBatch(transport.get(), commands, outcome);
+    else
+        this->runEach(transport.get(), commands, outcome);
+
+    transport->close();
+
+    if(outcome.exitCode != DeviceError)
+        this->printSummary(outcome);
+}
+
+void HeadlessRunner::runEach(I2CTransport* transport, const std::vector<Command>& commands, Outcome& outcome)
+{
+    std::vector<I2CTransaction> transactions(1);
+    std::vector<I2CResult> results;
+    auto start = std::chrono::steady_clock::now();
+
+    int resumes = 0;
+
+    for(std::size_t i = 0; i < commands.size(); ++i) {
+        transactions[0] = commands[i].transaction();
+        std::size_t transferCount = 0;
+        auto commandStart = std::chrono::steady_clock::now();
+
+        I2CResult result;
+
+        bool transferred = commands[i].retry.run(transport, transactions[0], [&](I2CResult& attempt) {
+            std::size_t count = 0;
+            bool ok = transport->transferBatch(transactions, results, &count);
+            transferCount += count;
+
+            if(ok)
+                attempt = std::move(results[0]);
+
+            return ok;
+        }, result);
+
+        if(!transferred && resumes < maxResumes && this->reconnect(transport, transactions[0].speedMode, outcome)) {
+            ++resumes;
+            --i; // Runs it again
+            continue;
+        }
+
+        resumes = 0;
+
+        if(!transferred) {
+            std::fprintf(stderr, "Transfer failed at \"%s\" on device #%lu\n", qPrintable(commands[i].name), outcome.deviceNum);
+            outcome.exitCode = DeviceError;
+            return;
+        }
+
+        if(this->trace) // Only the final attempt
+            this->trace->append(outcome.deviceNum, transactions[0], result);
+
+        this->printResult(outcome.deviceNum, i, commands[i], result, microsecondsSince(commandStart));
+
+        ++outcome.commands;
+        outcome.nacks += !result.acked;
+        outcome.retries += result.retries;
+        outcome.transfers += transferCount;
+    }
+
+    outcome.elapsedUs = microsecondsSince(start);
+    outcome.exitCode = outcome.nacks == 0 ? Success : Nacked;
+}
+
+void HeadlessRunner::runBatch(I2CTransport* transport, const std::vector<Command>& commands, Outcome& outcome)
+{
+    std::vector<I2CTransaction> transactions;
+    transactions.reserve(commands.size());
+
+    for(const Command& command : commands)
+        transactions.push_back(command.transaction());
+
+    std::vector<I2CResult> results;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = transport->transferBatch(transactions, results, &outcome.transfers);
+
+    // The whole batch again, it is not known how far it got
+    for(int resumes = 0; !ok && resumes < maxResumes && this->reconnect(transport, transactions.front().speedMode, outcome); ++resumes)
+        ok = transport->transferBatch(transactions, results, &outcome.transfers);
+
+    if(!ok) {
+        std::fprintf(stderr, "Batch transfer failed on device #%lu\n", outcome.deviceNum);
+        outcome.exitCode = DeviceError;
+        return;
+    }
+
+    outcome.elapsedUs = microsecondsSince(start);
+
+    for(std::size_t i = 0; i < commands.size(); ++i) {
+        if(this->trace)
+            this->trace->append(outcome.deviceNum, transactions[i], results[i]);
+
+        this->printResult(outcome.deviceNum, i, commands[i], results[i], -1);
+        outcome.nacks += !results[i].acked;
+    }
+
+    outcome.commands = commands.size();
+    outcome.exitCode = outcome.nacks == 0 ? Success : Nacked;
+}
+
+bool HeadlessRunner::reconnect(I2CTransport* transport, long speedMode, Outcome& outcome)
+{
+    if(this->reconnectTimeout.count() == 0 || transport->isAttached())
+        return false;
+
+    std::fprintf(stderr, "Lost %s device #%lu, reopening\n", transport->name(), outcome.deviceNum);
+
+    auto start = std::chrono::steady_clock::now();
+    int attempts = 1;
+    bool ok;
+
+    while(!(ok = transport->reopen(speedMode)) && std::chrono::steady_clock::now() - start < this->reconnectTimeout) {
+        std::this_thread::sleep_for(reconnectInterval);
+        ++attempts;
+    }
+
+    long long downtimeUs = microsecondsSince(start);
+
+    if(!ok) {
+        std::fprintf(stderr, "%s device #%lu did not come back within %.1f ms (%d attempts)\n", transport->name(), outcome.deviceNum,
+                     downtimeUs / 1000.0, attempts);
+        return false;
+    }
+
+    std::fprintf(stderr, "Reopened %s device #%lu as #%lu after %.1f ms (%d attempts), resuming\n", transport->name(), outcome.deviceNum,
+                 transport->deviceNum(), downtimeUs / 1000.0, attempts);
+
+    ++outcome.reconnects;
+    outcome.downtimeUs += downtimeUs;
+
+    return true;
+}
+
+void HeadlessRunner::printResult(unsigned long deviceNum, std::size_t index, const Command& command, const I2CResult& result, long long elapsedUs)
+{
+    if(this->format == Raw) {
+        std::fwrite(result.read.data(), 1, result.read.size(), this->out);
+        return;
+    }
+
+    std::string line = "{";
+    line.reserve(64 + command.name.size() + result.read.size() * 2);
+
+    if(this->tagDevices)
+        line += "\"device\":" + std::to_string(deviceNum) + ",";
+
+    line += "\"index\":" + std::to_string(index) + ",\"command\":" + jsonString(command.name) +
+            ",\"ack\":" + (result.acked ? "true" : "false") + ",\"read\":\"";
+
+    for(unsigned char byte : result.read) {
+        line += hexDigits[byte >> 4];
+        line += hexDigits[byte & 0x0F];
+    }
+
+    line += '"';
+
+    if(result.retries != 0)
+        line += ",\"retries\":" + std::to_string(result.retries);
+
+    if(elapsedUs >= 0)
+        line += ",\"elapsed_us\":" + std::to_string(elapsedUs);
+
+    this->print(line + "}\n");
+}
+
+void HeadlessRunner::printSummary(const Outcome& outcome)
+{
+    if(this->format == Raw)
+        return;
+
+    std::string line = "{\"summary\":{";
+
+    if(this->tagDevices)
+        line += "\"device\":" + std::to_string(outcome.deviceNum) + ",";
+
+    line += "\"commands\":" + std::to_string(outcome.commands) + ",\"nacks\":" + std::to_string(outcome.nacks) +
+            ",\"retries\":" + std::to_string(outcome.retries) + ",\"transfers\":" + std::to_string(outcome.transfers) + ",\"elapsed_us\":" + std::to_string(outcome.elapsedUs);
+
+    if(outcome.reconnects)
+        line += ",\"reconnects\":" + std::to_string(outcome.reconnects) + ",\"downtime_us\":" + std::to_string(outcome.downtimeUs);
+
+    line += "}}\n";
+
+    this->print(line);
+}
+
+void HeadlessRunner::print(const std::string& line)
+{
+    std::lock_guard<std::mutex> lock(this->outLock);
+    std::fputs(line.c_str(), this->out);
+}
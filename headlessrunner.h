@@ -0,0 +1,96 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef HEADLESSRUNNER_H
+#define HEADLESSRUNNER_H
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <QStringList>
+
+#include "commandmodel.h"
+#include "tracelog.h"
+
+class I2CTransport;
+
+// Runs saved commands without any window, for test station scripts:
+//
+//   CH341_I2C_Tool --run -l library.ch341lib -d 0 "Read ID" "#init"
+//
+// Commands are given as arguments and/or in a sequence file (same syntax as
+// Commands > Run Batch) and run back to back. Given several devices ("-d 0-3")
+// every device runs the same commands on its own thread. Every command prints
+// one JSON line to stdout, errors go to stderr. Exit code 0 means every command
+// was acknowledged, 1 that some were not, 2 a usage or library error and 3 a
+// device error (the worst of all devices). With --reconnect an adapter that
+// drops off the bus is reopened and the interrupted command (or batch) runs
+// again, instead of ending the run with a device error.
+//
+//   CH341_I2C_Tool --replay trace.ch341trc -d 0 --timing original
+//
+// replays a recorded trace instead, printing a JSON line for every transaction
+// whose ACK or read back differs from the recording (exit code 1 if any).
+class HeadlessRunner
+{
+public:
+    enum ExitCode { Success = 0, Nacked = 1, UsageError = 2, DeviceError = 3 };
+
+    int exec(const QStringList& arguments);
+
+private:
+    enum Format { JsonLines, Raw };
+
+    struct Outcome {
+        unsigned long deviceNum = 0;
+        int exitCode = Success;
+        std::size_t commands = 0;
+        std::size_t nacks = 0;
+        std::size_t retries = 0;
+        std::size_t transfers = 0;
+        long long elapsedUs = 0;
+        std::size_t reconnects = 0;
+        long long downtimeUs = 0;
+    };
+
+    CommandModel library;
+    Format format = JsonLines;
+    bool tagDevices = false;                    // Add the device number to every line (several devices)
+    std::FILE* out = stdout;
+    std::mutex outLock;                         // Keeps lines of devices running side by side whole
+    std::unique_ptr<TraceWriter> trace;         // Shared by all devices, --trace
+    std::chrono::milliseconds reconnectTimeout{0}; // --reconnect, zero = off
+
+    int replay(const QString& path, bool simulate, bool originalTiming, unsigned long deviceNum);
+
+    bool loadLibrary(const QString& path);
+    bool collect(const QStringList& lines, std::vector<Command>& commands);
+
+    void run(bool simulate, bool batch, const std::vector<Command>& commands, Outcome& outcome);
+    void runEach(I2CTransport* transport, const std::vector<Command>& commands, Outcome& outcome);
+    void runBatch(I2CTransport* transport, const std::vector<Command>& commands, Outcome& outcome);
+    // Reopens the adapter after a failed transfer if it dropped off the bus, true once it is back
+    bool reconnect(I2CTransport* transport, long speedMode, Outcome& outcome);
+
+    void printResult(unsigned long deviceNum, std::size_t index, const Command& command, const I2CResult& result, long long elapsedUs);
+    void printSummary(const Outcome& outcome);
+    void print(const std::string& line);
+};
+
+#endif // HEADLESSRUNNER_H
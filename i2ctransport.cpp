@@ -0,0 +1,173 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "i2ctransport.h"
+#include "simulatedtransport.h"
+
+#include <chrono>
+
+#ifdef HAVE_CH341DLL
+#include "ch341transport.h"
+#elif defined(HAVE_LIBUSB)
+#include "libusbtransport.h"
+#endif
+
+I2CTransport* I2CTransport::create(bool simulated)
+{
+#ifdef HAVE_CH341DLL
+    if(!simulated)
+        return new CH341Transport;
+#elif defined(HAVE_LIBUSB)
+    if(!simulated)
+        return new LibUsbTransport;
+#else
+    (void)simulated;
+#endif
+
+    SimulatedTransport* transport = new SimulatedTransport;
+
+    transport->addTarget(0x50, new SimulatedEEPROM(65536, 128, 2)); // 24LC512
+    transport->addTarget(0x48, new SimulatedRegisterFile(256));     // Register file sensor
+
+    return transport;
+}
+
+bool I2CTransport::reopen(long speedMode, unsigned long maxDevices)
+{
+    unsigned long deviceNum = this->device;
+    std::string location = this->devicePath;
+
+    this->close();
+
+    // Usually it comes back under its old number, unless adapters were plugged in or out meanwhile.
+    // Probing by opening would close the handles of other adapters in use (CH341DLL keys them by number).
+    unsigned long target = deviceNum;
+
+    if(!location.empty() && this->locationOf(deviceNum) != location) {
+        target = maxDevices;
+
+        for(unsigned long i = 0; i < maxDevices && target == maxDevices; ++i) {
+            if(i != deviceNum && this->locationOf(i) == location)
+                target = i;
+        }
+    }
+
+    bool found = target != maxDevices && this->open(target) && (location.empty() || this->devicePath == location);
+
+    if(!found) {
+        this->close();
+        this->device = deviceNum;
+        this->devicePath = location;
+
+        return false;
+    }
+
+    return speedMode < 0 || this->setStream(speedMode);
+}
+
+bool I2CTransport::transferBatch(const std::vector<I2CTransaction>& transactions, std::vector<I2CResult>& results,
+                                 std::size_t* transferCount)
+{
+    long speedMode = this->streamMode;
+    std::vector<CH341Transfer> transfers = CH341StreamEncoder().encode(transactions, speedMode);
+
+    results.clear();
+    results.resize(transactions.size());
+
+    if(transferCount)
+        *transferCount = transfers.size();
+
+    if(transfers.size() == 1)
+        return this->runTransfer(transfers.front(), speedMode, results);
+
+    // QUEUED, EVERY TRANSFER IS CHARGED ITS SHARE OF THE WHOLE CALL
+    std::vector<std::vector<unsigned char>> in(transfers.size());
+    std::vector<unsigned char*> readBuffers(transfers.size());
+
+    for(std::size_t i = 0; i < transfers.size(); ++i) {
+        in[i].resize(transfers[i].inLength);
+        readBuffers[i] = in[i].data();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::size_t completed = this->writeReadQueued(transfers.data(), readBuffers.data(), transfers.size());
+    std::int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    // Transfers after a failed one never ran
+    for(std::size_t i = 0; i < transfers.size() && i <= completed; ++i)
+        I2CTransport::finishTransfer(transfers[i], in[i].data(), i < completed, elapsed / (std::int64_t)transfers.size(), results);
+
+    this->streamMode = completed == transfers.size() ? speedMode : -1;
+
+    return completed == transfers.size();
+}
+
+std::size_t I2CTransport::writeReadQueued(const CH341Transfer* transfers, unsigned char* const* readBuffers, std::size_t count)
+{
+    for(std::size_t i = 0; i < count; ++i) {
+        if(!this->writeRead(transfers[i], readBuffers[i]))
+            return i;
+    }
+
+    return count;
+}
+
+bool I2CTransport::runTransaction(const I2CTransaction& transaction, I2CResult& result)
+{
+    long speedMode = this->streamMode;
+    std::vector<CH341Transfer> transfers = CH341StreamEncoder().encode({ transaction }, speedMode);
+    std::vector<I2CResult> results(1);
+
+    bool ok = this->runTransfer(transfers.front(), speedMode, results);
+    result = std::move(results.front());
+
+    return ok;
+}
+
+bool I2CTransport::runTransfer(const CH341Transfer& transfer, long speedMode, std::vector<I2CResult>& results)
+{
+    std::vector<unsigned char> in(transfer.inLength);
+
+    auto start = std::chrono::steady_clock::now();
+    bool ok = this->writeRead(transfer, in.data());
+    std::int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    I2CTransport::finishTransfer(transfer, in.data(), ok, elapsed, results);
+
+    this->streamMode = ok ? speedMode : -1;
+
+    return ok;
+}
+
+void I2CTransport::finishTransfer(const CH341Transfer& transfer, const unsigned char* in, bool ok, std::int64_t elapsed,
+                                  std::vector<I2CResult>& results)
+{
+    if(ok)
+        CH341StreamEncoder::decode(transfer, in, results);
+
+    // Every transaction in the transfer waited for the whole USB call
+    for(const CH341Slice& slice : transfer.slices) {
+        if(results.size() <= slice.transaction)
+            results.resize(slice.transaction + 1);
+
+        I2CResult& result = results[slice.transaction];
+        result.elapsed = elapsed;
+        result.batched = transfer.slices.size();
+
+        if(!ok)
+            result.acked = false;
+    }
+}
@@ -0,0 +1,105 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef I2CTRANSPORT_H
+#define I2CTRANSPORT_H
+
+#include "ch341stream.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Every device access in the tool goes through an I2CTransport. One instance
+// represents one (possibly not yet opened) CH341 adapter.
+class I2CTransport
+{
+public:
+    virtual ~I2CTransport() = default;
+
+    virtual const char* name() const = 0;
+    // A new, unopened transport of the same kind, for driving another adapter
+    virtual I2CTransport* createSibling() const = 0;
+
+    virtual bool open(unsigned long deviceNum) = 0;
+    virtual void close() = 0;
+    bool isOpen() const { return this->opened; }
+    unsigned long deviceNum() const { return this->device; }
+    // Where the open adapter is attached (e.g. its USB port), kept after it is
+    // unplugged. Empty if the backend cannot tell adapters apart.
+    const std::string& location() const { return this->devicePath; }
+    // Where adapter deviceNum is attached, without opening it (other instances
+    // may have it open). Empty if there is none or the backend cannot tell.
+    virtual std::string locationOf(unsigned long deviceNum) const { (void)deviceNum; return std::string(); }
+    // Whether the open adapter is still there, asked after a transfer failed
+    virtual bool isAttached() const { return this->opened; }
+
+    // Opens the adapter again after it dropped off the bus: under its old
+    // number if it is back at the same location (or the location is unknown),
+    // otherwise whichever of the first maxDevices is at that location. Only
+    // that one is opened, the others are looked up through locationOf(). Puts
+    // it back into speedMode, unless negative.
+    bool reopen(long speedMode, unsigned long maxDevices = 16);
+
+    // Speed modes 0-3 select 20, 100, 400 and 750 kHz respectively
+    virtual bool setStream(unsigned long speedMode) = 0;
+    // Mode the device was last successfully put in, -1 if unknown (e.g. after open or a failure)
+    long currentStreamMode() const { return this->streamMode; }
+
+    // The first write byte is the address byte (address << 1 | R/W). Any
+    // further write bytes are sent before the read phase begins.
+    virtual bool streamI2C(std::size_t writeLength, const unsigned char* writeBuffer,
+                           std::size_t readLength, unsigned char* readBuffer) = 0;
+
+    // Sends one pre-encoded stream transfer and reads back transfer.inLength bytes
+    virtual bool writeRead(const CH341Transfer& transfer, unsigned char* readBuffer) = 0;
+    // Sends count transfers in order, readBuffers[i] receiving transfers[i].inLength
+    // bytes. Transports that can keep several transfers in flight do so to hide
+    // the USB round trips, the default sends them one by one. Returns the number
+    // of transfers that completed before the first failure.
+    virtual std::size_t writeReadQueued(const CH341Transfer* transfers, unsigned char* const* readBuffers, std::size_t count);
+
+    // Packs the transactions into as few USB transfers as possible and splits
+    // the read back into per transaction results
+    bool transferBatch(const std::vector<I2CTransaction>& transactions, std::vector<I2CResult>& results,
+                       std::size_t* transferCount = nullptr);
+    // Runs one transfer encoded ahead of time, speedMode being the mode the
+    // encoder says it leaves the device in. Results are decoded into results.
+    bool runTransfer(const CH341Transfer& transfer, long speedMode, std::vector<I2CResult>& results);
+    // Runs a single transaction as a stream transfer. Unlike streamI2C this
+    // tells a NACK (result.acked) apart from a failed USB transfer (false).
+    bool runTransaction(const I2CTransaction& transaction, I2CResult& result);
+
+    virtual unsigned long driverVersion() const = 0;
+    virtual unsigned long libraryVersion() const = 0;
+
+    // Returns the CH341 DLL backend on Windows and the libusb backend where
+    // libusb is available, otherwise (or when simulated is set) a simulated bus
+    // populated with the default targets
+    static I2CTransport* create(bool simulated);
+
+protected:
+    bool opened = false;
+    unsigned long device = 0;
+    long streamMode = -1;
+    std::string devicePath;                     // Set by open(), see location()
+
+private:
+    static void finishTransfer(const CH341Transfer& transfer, const unsigned char* in, bool ok, std::int64_t elapsed,
+                               std::vector<I2CResult>& results);
+};
+
+#endif // I2CTRANSPORT_H
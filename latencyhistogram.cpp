@@ -0,0 +1,132 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "latencyhistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <QtAlgorithms>
+
+int LatencyHistogram::bucket(std::uint64_t value)
+{
+    if(value < (std::uint64_t)subBuckets)
+        return (int)value;
+
+    int shift = 63 - (int)qCountLeadingZeroBits(value) - subBucketBits; // Keeps the top subBucketBits + 1 bits
+
+    return (shift + 1) * subBuckets + (int)((value >> shift) & (subBuckets - 1));
+}
+
+std::uint64_t LatencyHistogram::lowerBound(int bucket)
+{
+    if(bucket < subBuckets)
+        return bucket;
+
+    int shift = bucket / subBuckets - 1;
+
+    return (std::uint64_t)(subBuckets + bucket % subBuckets) << shift;
+}
+
+void LatencyHistogram::record(std::uint64_t latency, std::uint64_t busy, std::size_t bytes, bool ok,
+                              std::uint64_t retries, std::uint64_t waited)
+{
+    this->counts[LatencyHistogram::bucket(latency)].fetch_add(1, std::memory_order_relaxed);
+    this->busy.fetch_add(busy, std::memory_order_relaxed);
+    this->bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+    if(!ok)
+        this->errors.fetch_add(1, std::memory_order_relaxed);
+
+    if(retries != 0) {
+        this->retries.fetch_add(retries, std::memory_order_relaxed);
+        this->waited.fetch_add(waited, std::memory_order_relaxed);
+    }
+
+    std::uint64_t max = this->max.load(std::memory_order_relaxed);
+    while(latency > max && !this->max.compare_exchange_weak(max, latency, std::memory_order_relaxed)) {}
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.counts.resize(bucketCount);
+
+    for(int i = 0; i < bucketCount; ++i) {
+        snapshot.counts[i] = this->counts[i].load(std::memory_order_relaxed);
+        snapshot.count += snapshot.counts[i];
+    }
+
+    snapshot.errors = this->errors.load(std::memory_order_relaxed);
+    snapshot.bytes = this->bytes.load(std::memory_order_relaxed);
+    snapshot.busy = this->busy.load(std::memory_order_relaxed);
+    snapshot.max = this->max.load(std::memory_order_relaxed);
+    snapshot.retries = this->retries.load(std::memory_order_relaxed);
+    snapshot.waited = this->waited.load(std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+void LatencyHistogram::reset()
+{
+    for(std::atomic<std::uint64_t>& count : this->counts)
+        count.store(0, std::memory_order_relaxed);
+
+    this->errors.store(0, std::memory_order_relaxed);
+    this->bytes.store(0, std::memory_order_relaxed);
+    this->busy.store(0, std::memory_order_relaxed);
+    this->max.store(0, std::memory_order_relaxed);
+    this->retries.store(0, std::memory_order_relaxed);
+    this->waited.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::Snapshot::quantile(double fraction) const
+{
+    if(this->count == 0)
+        return 0;
+
+    std::uint64_t rank = std::max<std::uint64_t>(1, (std::uint64_t)std::ceil(fraction * this->count));
+    std::uint64_t seen = 0;
+
+    for(std::size_t i = 0; i < this->counts.size(); ++i) {
+        seen += this->counts[i];
+
+        if(seen >= rank) { // Middle of the bucket, but never past the largest value seen
+            std::uint64_t low = LatencyHistogram::lowerBound((int)i);
+            std::uint64_t high = i + 1 < (std::size_t)bucketCount ? LatencyHistogram::lowerBound((int)i + 1) : low;
+
+            return std::min(low + (high - low) / 2, this->max);
+        }
+    }
+
+    return this->max;
+}
+
+void LatencyHistogram::Snapshot::merge(const Snapshot& other)
+{
+    if(this->counts.size() < other.counts.size())
+        this->counts.resize(other.counts.size());
+
+    for(std::size_t i = 0; i < other.counts.size(); ++i)
+        this->counts[i] += other.counts[i];
+
+    this->count += other.count;
+    this->errors += other.errors;
+    this->bytes += other.bytes;
+    this->busy += other.busy;
+    this->max = std::max(this->max, other.max);
+    this->retries += other.retries;
+    this->waited += other.waited;
+}
@@ -0,0 +1,76 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Log bucketed latency histogram: values below 8 ns have a bucket each, above
+// that every power of two is split into 8 buckets, so any quantile is known to
+// within 12.5% over the whole 64 bit range in a fixed 4 KiB. Recording is a
+// few relaxed atomic adds with no locks or allocations, so it can stay on in
+// the transaction path and be fed from several device threads at once.
+class LatencyHistogram
+{
+public:
+    static const int subBucketBits = 3;
+    static const int subBuckets = 1 << subBucketBits;
+    static const int bucketCount = (64 - subBucketBits + 1) * subBuckets;
+
+    struct Snapshot {
+        std::vector<std::uint64_t> counts;      // Per bucket
+        std::uint64_t count = 0;
+        std::uint64_t errors = 0;               // NACKs and failed USB calls
+        std::uint64_t bytes = 0;                // On the bus, address bytes included
+        std::uint64_t busy = 0;                 // Nanoseconds of USB time, shared out over batched transactions
+        std::uint64_t max = 0;                  // Nanoseconds
+        std::uint64_t retries = 0;              // Attempts after the first one of retried transactions
+        std::uint64_t waited = 0;               // Nanoseconds spent retrying
+
+        // Nanoseconds at or below which fraction (0-1) of the samples lie
+        std::uint64_t quantile(double fraction) const;
+        double bytesPerSecond() const { return this->busy ? this->bytes * 1e9 / this->busy : 0; }
+
+        void merge(const Snapshot& other);
+    };
+
+    // latency is the duration of the USB call that carried the transaction,
+    // busy its share of it (less than latency if the call carried several)
+    void record(std::uint64_t latency, std::uint64_t busy, std::size_t bytes, bool ok,
+                std::uint64_t retries = 0, std::uint64_t waited = 0);
+
+    // Consistent per counter, not across counters while recording goes on
+    Snapshot snapshot() const;
+    void reset();
+
+    static int bucket(std::uint64_t value);
+    static std::uint64_t lowerBound(int bucket);
+
+private:
+    std::atomic<std::uint64_t> counts[bucketCount] = {};
+    std::atomic<std::uint64_t> errors{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> busy{0};
+    std::atomic<std::uint64_t> max{0};
+    std::atomic<std::uint64_t> retries{0};
+    std::atomic<std::uint64_t> waited{0};
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -0,0 +1,373 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "libusbtransport.h"
+
+#include <algorithm>
+#include <string>
+
+#include <libusb.h>
+
+namespace {
+
+const std::uint16_t CH341_VENDOR_ID = 0x1A86;
+const std::uint16_t CH341_PRODUCT_ID = 0x5512;      // I2C/SPI/GPIO mode
+const int CH341_INTERFACE = 0;
+const unsigned char CH341_ENDPOINT_OUT = 0x02;
+const unsigned char CH341_ENDPOINT_IN = 0x82;
+
+const unsigned int usbTimeout = 500;                // Milliseconds allowed on top of the bus time
+
+// Milliseconds the bus needs for a transfer at worst (20 kHz, every byte on the wire)
+unsigned int busTime(const CH341Transfer& transfer)
+{
+    return (unsigned int)((transfer.out.size() + transfer.inLength) * 9 * 1000 / 20000) + 1;
+}
+
+// "BUS-PORT.PORT...", the same as long as the adapter stays plugged into the same port
+std::string portPath(libusb_device* device)
+{
+    std::uint8_t ports[8];
+    int depth = libusb_get_port_numbers(device, ports, sizeof(ports));
+
+    std::string path = std::to_string(libusb_get_bus_number(device));
+
+    for(int i = 0; i < depth; ++i)
+        path += (i == 0 ? "-" : ".") + std::to_string(ports[i]);
+
+    return path;
+}
+
+}
+
+LibUsbTransport::LibUsbTransport(std::size_t queueDepth)
+    : flights(std::max<std::size_t>(queueDepth, 1))
+{
+}
+
+LibUsbTransport::~LibUsbTransport()
+{
+    this->close();
+
+    for(Flight& flight : this->flights) {
+        libusb_free_transfer(flight.out);
+
+        for(libusb_transfer* in : flight.in)
+            libusb_free_transfer(in);
+    }
+
+    if(this->context)
+        libusb_exit(this->context);
+}
+
+bool LibUsbTransport::open(unsigned long deviceNum)
+{
+    this->close();
+
+    if(!this->context && libusb_init(&this->context) != 0) {
+        this->context = nullptr;
+        return false;
+    }
+
+    libusb_device** list;
+    ssize_t count = libusb_get_device_list(this->context, &list);
+
+    if(count < 0)
+        return false;
+
+    unsigned long index = 0;
+    for(ssize_t i = 0; i < count; ++i) {
+        libusb_device_descriptor descriptor;
+
+        if(libusb_get_device_descriptor(list[i], &descriptor) != 0 ||
+           descriptor.idVendor != CH341_VENDOR_ID || descriptor.idProduct != CH341_PRODUCT_ID)
+            continue;
+
+        if(index++ != deviceNum)
+            continue;
+
+        if(libusb_open(list[i], &this->handle) != 0)
+            this->handle = nullptr;
+
+        this->chipVersion = descriptor.bcdDevice;
+        this->devicePath = portPath(list[i]);
+        break;
+    }
+
+    libusb_free_device_list(list, 1);
+
+    if(!this->handle)
+        return false;
+
+    libusb_set_auto_detach_kernel_driver(this->handle, 1); // e.g. i2c-ch341-usb
+
+    if(libusb_claim_interface(this->handle, CH341_INTERFACE) != 0) {
+        libusb_close(this->handle);
+        this->handle = nullptr;
+
+        return false;
+    }
+
+    this->device = deviceNum;
+    this->opened = true;
+    this->streamMode = -1;
+
+    return true;
+}
+
+void LibUsbTransport::close()
+{
+    if(!this->opened)
+        return;
+
+    libusb_release_interface(this->handle, CH341_INTERFACE);
+    libusb_close(this->handle);
+
+    this->handle = nullptr;
+    this->opened = false;
+    this->streamMode = -1;
+}
+
+std::string LibUsbTransport::locationOf(unsigned long deviceNum) const
+{
+    if(!this->context) // Nothing was opened yet
+        return std::string();
+
+    libusb_device** list;
+    ssize_t count = libusb_get_device_list(this->context, &list);
+
+    if(count < 0)
+        return std::string();
+
+    std::string path;
+    unsigned long index = 0;
+    for(ssize_t i = 0; i < count; ++i) {
+        libusb_device_descriptor descriptor;
+
+        if(libusb_get_device_descriptor(list[i], &descriptor) != 0 ||
+           descriptor.idVendor != CH341_VENDOR_ID || descriptor.idProduct != CH341_PRODUCT_ID)
+            continue;
+
+        if(index++ == deviceNum) {
+            path = portPath(list[i]);
+            break;
+        }
+    }
+
+    libusb_free_device_list(list, 1);
+
+    return path;
+}
+
+bool LibUsbTransport::isAttached() const
+{
+    int configuration;
+
+    return this->opened && libusb_get_configuration(this->handle, &configuration) != LIBUSB_ERROR_NO_DEVICE;
+}
+
+bool LibUsbTransport::setStream(unsigned long speedMode)
+{
+    CH341Transfer transfer;
+    transfer.out = { CH341_CMD_I2C_STREAM, (unsigned char)(CH341_STM_SET | (speedMode & 0x03)), CH341_STM_END };
+
+    bool result = this->writeRead(transfer, nullptr);
+    this->streamMode = result ? (long)(speedMode & 0x03) : -1;
+
+    return result;
+}
+
+bool LibUsbTransport::streamI2C(std::size_t writeLength, const unsigned char* writeBuffer,
+                                std::size_t readLength, unsigned char* readBuffer)
+{
+    if(!this->opened || writeLength == 0)
+        return false;
+
+    // Runs at the mode set last, the encoder only adds a SET command if that is unknown
+    I2CTransaction transaction = { (unsigned char)(writeBuffer[0] >> 1),
+                                   std::vector<unsigned char>(writeBuffer + 1, writeBuffer + writeLength),
+                                   readLength, this->streamMode < 0 ? 1UL : (unsigned long)this->streamMode };
+    I2CResult result;
+
+    if(!this->runTransaction(transaction, result))
+        return false;
+
+    std::copy(result.read.begin(), result.read.end(), readBuffer);
+
+    return result.acked;
+}
+
+bool LibUsbTransport::writeRead(const CH341Transfer& transfer, unsigned char* readBuffer)
+{
+    return this->writeReadQueued(&transfer, &readBuffer, 1) == 1;
+}
+
+std::size_t LibUsbTransport::writeReadQueued(const CH341Transfer* transfers, unsigned char* const* readBuffers, std::size_t count)
+{
+    if(!this->opened)
+        return 0;
+
+    std::size_t depth = this->flights.size();
+    std::size_t submitted = 0;
+    std::size_t completed = 0;
+    bool failed = false;
+
+    while(completed < count) {
+        // KEEP THE QUEUE FULL, each transfer may wait for the bus time of the ones ahead of it
+        while(!failed && submitted < count && submitted - completed < depth) {
+            unsigned int timeout = usbTimeout;
+            for(std::size_t i = completed; i <= submitted; ++i)
+                timeout += busTime(transfers[i]);
+
+            if(!this->submit(this->flights[submitted % depth], transfers[submitted], timeout))
+                failed = true;
+            else
+                ++submitted;
+        }
+
+        if(completed == submitted) // The next transfer could not be submitted
+            break;
+
+        Flight& flight = this->flights[completed % depth];
+        this->wait(flight);
+
+        if(!this->collect(flight, transfers[completed], readBuffers[completed])) {
+            // The adapter's state is unknown from here on, take back whatever is still queued
+            for(std::size_t i = completed + 1; i < submitted; ++i)
+                this->cancel(this->flights[i % depth]);
+
+            for(std::size_t i = completed + 1; i < submitted; ++i)
+                this->wait(this->flights[i % depth]);
+
+            // Read back of the cancelled transfers may still come in, it must not end up in the next one
+            unsigned char packet[CH341_PACKET_LENGTH];
+            int length;
+            while(libusb_bulk_transfer(this->handle, CH341_ENDPOINT_IN, packet, sizeof(packet), &length, 20) == 0) {}
+
+            break;
+        }
+
+        ++completed;
+    }
+
+    return completed;
+}
+
+unsigned long LibUsbTransport::libraryVersion() const
+{
+    const libusb_version* version = libusb_get_version();
+
+    return ((unsigned long)version->major << 16) | ((unsigned long)version->minor << 8) | version->micro;
+}
+
+bool LibUsbTransport::submit(Flight& flight, const CH341Transfer& transfer, unsigned int timeout)
+{
+    flight.failed = false;
+    flight.readBack.resize(transfer.inPackets * CH341_PACKET_LENGTH);
+
+    if(!flight.out && !(flight.out = libusb_alloc_transfer(0)))
+        return false;
+
+    while(flight.in.size() < transfer.inPackets) {
+        libusb_transfer* in = libusb_alloc_transfer(0);
+
+        if(!in)
+            return false;
+
+        flight.in.push_back(in);
+    }
+
+    // The adapter works through the OUT packets in order and answers every
+    // packet with IN commands with one read back packet, which the IN
+    // transfers (queued behind those of earlier flights) pick up in order
+    libusb_fill_bulk_transfer(flight.out, this->handle, CH341_ENDPOINT_OUT, const_cast<unsigned char*>(transfer.out.data()),
+                              (int)transfer.out.size(), &LibUsbTransport::transferCompleted, &flight, timeout);
+
+    if(libusb_submit_transfer(flight.out) != 0)
+        return false;
+
+    ++flight.active;
+
+    for(std::size_t i = 0; i < transfer.inPackets; ++i) {
+        libusb_fill_bulk_transfer(flight.in[i], this->handle, CH341_ENDPOINT_IN, flight.readBack.data() + i * CH341_PACKET_LENGTH,
+                                  (int)CH341_PACKET_LENGTH, &LibUsbTransport::transferCompleted, &flight, timeout);
+
+        if(libusb_submit_transfer(flight.in[i]) != 0) {
+            flight.failed = true;
+            this->wait(flight);
+
+            return false;
+        }
+
+        ++flight.active;
+    }
+
+    return true;
+}
+
+void LibUsbTransport::cancel(Flight& flight)
+{
+    // Transfers that already completed (or were never submitted) just report LIBUSB_ERROR_NOT_FOUND
+    libusb_cancel_transfer(flight.out);
+
+    for(libusb_transfer* in : flight.in)
+        libusb_cancel_transfer(in);
+}
+
+void LibUsbTransport::wait(Flight& flight)
+{
+    bool cancelled = false;
+
+    while(flight.active != 0) {
+        if(flight.failed && !cancelled) { // The rest of the flight can not succeed anymore
+            this->cancel(flight);
+            cancelled = true;
+        }
+
+        timeval timeout = { 0, 100000 };
+        libusb_handle_events_timeout_completed(this->context, &timeout, nullptr);
+    }
+}
+
+bool LibUsbTransport::collect(Flight& flight, const CH341Transfer& transfer, unsigned char* readBuffer)
+{
+    if(flight.failed)
+        return false;
+
+    std::size_t length = 0;
+    for(std::size_t i = 0; i < transfer.inPackets; ++i) {
+        std::size_t received = (std::size_t)flight.in[i]->actual_length;
+
+        if(length + received > transfer.inLength)
+            return false;
+
+        std::copy_n(flight.readBack.data() + i * CH341_PACKET_LENGTH, received, readBuffer + length);
+        length += received;
+    }
+
+    return length == transfer.inLength;
+}
+
+void LibUsbTransport::transferCompleted(libusb_transfer* transfer)
+{
+    Flight* flight = static_cast<Flight*>(transfer->user_data);
+    --flight->active;
+
+    bool shortWrite = transfer->endpoint == CH341_ENDPOINT_OUT && transfer->actual_length != transfer->length;
+
+    if(transfer->status != LIBUSB_TRANSFER_COMPLETED || shortWrite)
+        flight->failed = true;
+}
@@ -0,0 +1,84 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef LIBUSBTRANSPORT_H
+#define LIBUSBTRANSPORT_H
+
+#include "i2ctransport.h"
+
+#include <vector>
+
+struct libusb_context;
+struct libusb_device_handle;
+struct libusb_transfer;
+
+// Transport talking to the CH341 directly through libusb (Linux), no vendor
+// library needed. Transfers are encoded by CH341StreamEncoder and sent as
+// asynchronous bulk transfers; writeReadQueued keeps up to queueDepth of them
+// submitted so the adapter never waits for the host between transfers.
+class LibUsbTransport : public I2CTransport
+{
+public:
+    explicit LibUsbTransport(std::size_t queueDepth = 4);
+    ~LibUsbTransport();
+
+    const char* name() const override { return "libusb"; }
+    I2CTransport* createSibling() const override { return new LibUsbTransport(this->flights.size()); }
+
+    // deviceNum counts the attached CH341s in I2C mode, in bus order. The
+    // location is the bus and port path, e.g. "1-2.3".
+    bool open(unsigned long deviceNum) override;
+    void close() override;
+    std::string locationOf(unsigned long deviceNum) const override;
+    bool isAttached() const override;
+
+    bool setStream(unsigned long speedMode) override;
+    bool streamI2C(std::size_t writeLength, const unsigned char* writeBuffer,
+                   std::size_t readLength, unsigned char* readBuffer) override;
+    bool writeRead(const CH341Transfer& transfer, unsigned char* readBuffer) override;
+    std::size_t writeReadQueued(const CH341Transfer* transfers, unsigned char* const* readBuffers, std::size_t count) override;
+
+    // Chip release (bcdDevice) of the open adapter
+    unsigned long driverVersion() const override { return this->chipVersion; }
+    unsigned long libraryVersion() const override;
+
+private:
+    // One CH341Transfer on the wire: a bulk OUT transfer carrying its packets
+    // and a bulk IN transfer for every packet that produces read back
+    struct Flight {
+        libusb_transfer* out = nullptr;
+        std::vector<libusb_transfer*> in;
+        std::vector<unsigned char> readBack;    // One packet length per IN transfer
+        int active = 0;                         // Submitted libusb transfers that have not completed
+        bool failed = false;
+    };
+
+    libusb_context* context = nullptr;
+    libusb_device_handle* handle = nullptr;
+    unsigned long chipVersion = 0;
+    std::vector<Flight> flights;
+
+    bool submit(Flight& flight, const CH341Transfer& transfer, unsigned int timeout);
+    void cancel(Flight& flight);
+    // Handles USB events until every transfer of the flight completed
+    void wait(Flight& flight);
+    // Copies the read back packets together, false if the flight failed or came back short
+    bool collect(Flight& flight, const CH341Transfer& transfer, unsigned char* readBuffer);
+
+    static void transferCompleted(libusb_transfer* transfer);
+};
+
+#endif // LIBUSBTRANSPORT_H
@@ -16,23 +16,45 @@
 
 #include "mainwindow.h"
 #include "deviceselect.h"
+#include "headlessrunner.h"
+#include "i2ctransport.h"
 
+#include <cstring>
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "--run") == 0 || std::strcmp(argv[i], "--replay") == 0) { // Headless, no widgets are ever set up
+            QCoreApplication a(argc, argv);
+
+            return HeadlessRunner().exec(a.arguments());
+        }
+    }
+
     QApplication a(argc, argv);
 
-    DeviceSelect* deviceSelect = new DeviceSelect(NULL);
+    I2CTransport* transport = I2CTransport::create(a.arguments().contains("--simulate"));
+
+    DeviceSelect* deviceSelect = new DeviceSelect(transport, NULL);
     deviceSelect->exec();
     int deviceNum = deviceSelect->deviceNum;
     delete deviceSelect;
 
-    if(deviceNum == -1)
+    if(deviceNum == -1) {
+        delete transport;
         return 0;
+    }
+
+    int result;
+    {
+        MainWindow w(transport);
+        w.show();
+
+        result = a.exec();
+    }
 
-    MainWindow w;
-    w.show();
+    delete transport;
 
-    return a.exec();
+    return result;
 }
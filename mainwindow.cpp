@@ -18,239 +18,975 @@
 #include "./ui_mainwindow.h"
 
 #include <fstream>
+#include <filesystem>
 #include <algorithm>
 #include <sstream>
 #include <bitset>
+#include <QClipboard>
+#include <QCompleter>
 #include <QDebug>
+#include <QFontDatabase>
+#include <QGuiApplication>
+#include <QHeaderView>
+#include <QItemSelectionModel>
+#include <QLineEdit>
+#include <QListView>
 #include <QMessageBox>
 #include <QFileDialog>
-
+#include <QFileInfo>
+#include <QInputDialog>
+#include <QProgressBar>
+#include <QSet>
+#include <QSignalBlocker>
+#include <QTextCursor>
+#include <QtConcurrent>
+
+#include "byteparser.h"
 #include "deviceselect.h"
-#include "CH341DLL_EN.H"
-
-MainWindow::MainWindow(QWidget *parent, ULONG deviceNum)
+#include "fixturedialog.h"
+#include "i2ctransport.h"
+#include "memorydialog.h"
+#include "registercachedialog.h"
+#include "scandialog.h"
+#include "sequencedialog.h"
+#include "statsdialog.h"
+#include "streamscheduler.h"
+
+MainWindow::MainWindow(I2CTransport* transport, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , transport(transport)
 {
     ui->setupUi(this);
     this->setWindowTitle("CH341 I2C Tool");
-    this->deviceNum = deviceNum;
+
+    connect(&this->captureTimer, &QTimer::timeout, this, &MainWindow::showCapture);
+
+    // COMMAND LIBRARY, THE DROP-DOWN LISTS THE MODEL DIRECTLY AND TYPING SEARCHES IT
+    ui->commandsComboBox->setModel(&this->commands);
+    this->commandSearch.setSourceModel(&this->commands);
+
+    QCompleter* completer = new QCompleter(&this->commandSearch, this);
+    completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion); // Already filtered and ranked by commandSearch
+    completer->setCaseSensitivity(Qt::CaseInsensitive);
+    completer->setMaxVisibleItems(12);
+    ui->commandsComboBox->setCompleter(completer);
+
+    // Sizing the drop-down to its longest name or to varying item heights would visit every command
+    ui->commandsComboBox->setSizeAdjustPolicy(QComboBox::AdjustToMinimumContentsLengthWithIcon);
+    if(QListView* view = qobject_cast<QListView*>(ui->commandsComboBox->view()))
+        view->setUniformItemSizes(true);
+
+    connect(ui->commandsComboBox->lineEdit(), &QLineEdit::textEdited, &this->commandSearch, &CommandFilterModel::setPattern);
+
+    this->memoryProgressBar = new QProgressBar(this);
+    this->memoryProgressBar->setMaximumWidth(160);
+    this->memoryProgressBar->setRange(0, 1000);
+    this->memoryProgressBar->hide();
+    ui->statusbar->addPermanentWidget(this->memoryProgressBar);
+
+    this->loadProgressBar = new QProgressBar(this);
+    this->loadProgressBar->setMaximumWidth(160);
+    this->loadProgressBar->setRange(0, 1000);
+    this->loadProgressBar->setFormat("Loading %p%");
+    this->loadProgressBar->hide();
+    ui->statusbar->addPermanentWidget(this->loadProgressBar);
+
+    connect(&this->libraryLoader, &QFutureWatcher<CommandCsv::LoadResult>::progressValueChanged, this->loadProgressBar, &QProgressBar::setValue);
+    connect(&this->libraryLoader, &QFutureWatcher<CommandCsv::LoadResult>::finished, this, &MainWindow::onLibraryLoaded);
+
+    // READ RESULTS, ONLY THE VISIBLE ROWS ARE EVER FORMATTED
+    ui->readTableView->setModel(&this->results);
+    ui->readTableView->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    ui->readTableView->verticalHeader()->hide();
+    ui->readTableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    ui->readTableView->verticalHeader()->setDefaultSectionSize(ui->readTableView->fontMetrics().height() + 4);
+    ui->readTableView->horizontalHeader()->setStretchLastSection(true);
+
+    const int columnChars[] = { 16, 6, ResultModel::bytesPerRow * 3, ResultModel::bytesPerRow * 9 }; // Fixed widths, sizing to contents would visit every row
+    for(int column = 0; column < 4; ++column)
+        ui->readTableView->setColumnWidth(column, ui->readTableView->fontMetrics().horizontalAdvance('0') * columnChars[column] + 12);
+
+    QAction* copyAction = new QAction("Copy", ui->readTableView);
+    copyAction->setShortcut(QKeySequence::Copy);
+    copyAction->setShortcutContext(Qt::WidgetShortcut);
+    connect(copyAction, &QAction::triggered, this, &MainWindow::copyResults);
+    ui->readTableView->addAction(copyAction);
+
+    this->startWorker();
 }
 
 MainWindow::~MainWindow()
 {
-    qDebug().nospace() << "CLOSING CH341 DEVICE #" << this->deviceNum;
-    CH341CloseDevice(this->deviceNum);
+    this->libraryLoader.cancel();
+    this->libraryLoader.waitForFinished();
+
+    this->stopWorker();
+
+    qDebug().nospace() << "CLOSING CH341 DEVICE #" << this->transport->deviceNum();
+    this->transport->close();
     delete ui;
 }
 
-bool isBinary(const std::string& token, const std::size_t& length) {
-    if(token.length() > length || token.empty())
-        return false;
+bool parseValue(const QString& text, unsigned max, unsigned& value) {      // HELPER FUNCTIONS FOR USER INPUT (see byteparser.h)
+    return ByteParser::parseValueTrimmed(text.utf16(), text.size(), max, value);
+}
 
-    for(size_t i = 0; i < token.length(); ++i) {
-        if(token[i] != '1' && token[i] != '0')
-            return false;
-    }
+bool parseValue(const std::string& text, unsigned max, unsigned& value) {
+    return ByteParser::parseValueTrimmed(text.data(), text.size(), max, value);
+}
 
-    return true;
+bool parseBytes(const QString& text, std::vector<unsigned char>& bytes, ByteParser::Error* error = nullptr) {
+    return ByteParser::parse(text.utf16(), text.size(), bytes, error);
 }
 
-bool isBinaryByte(const std::string& token) {
-    return isBinary(token, 8);
+bool parseBytes(const std::string& text, std::vector<unsigned char>& bytes, ByteParser::Error* error = nullptr) {
+    return ByteParser::parse(text.data(), text.size(), bytes, error);
 }
 
-bool isValidAddress(const std::string& token) {
-    return isBinary(token, 7);
+const std::chrono::seconds autoReconnectTimeout(10);                    // Before a lost CH341 device is given up on
+
+const char* const libraryFilter = "Command libraries (*.csv *.ch341lib);;Comma separated values (*.csv);;Precompiled command libraries (*.ch341lib)";
+
+QString describeError(const QString& text, const ByteParser::Error& error) {
+    return "\"" + text.mid(error.position, error.length) + "\" at character " + QString::number(error.position + 1);
 }
 
-bool isValidWriteData(const std::string& tokens, std::vector<std::string>* bytes) {
-    if(tokens.empty())
-        return true;
+unsigned long MainWindow::selectedSpeedMode() const {                   // HELPER FUNCTION FOR RUN COMMMAND BUTTON
+    if(ui->busSpeedRadioButton_0->isChecked())      // 20 kHz
+        return 0;
+    else if(ui->busSpeedRadioButton_1->isChecked()) // 100 kHz
+        return 1;
+    else if(ui->busSpeedRadioButton_2->isChecked()) // 400 kHz
+        return 2;
+    else                                            // 750 kHz
+        return 3;
+}
 
-    std::istringstream iss(tokens);
+void MainWindow::startWorker() {                                        // HELPER FUNCTIONS FOR THE DEVICE THREAD
+    this->deviceNum = this->transport->deviceNum();
+    this->deviceLocation = this->transport->location();
+    this->driverVersion = this->transport->driverVersion();
+    this->libraryVersion = this->transport->libraryVersion();
 
-    std::string token;
-    while(iss >> token) {
-        if(!isBinaryByte(token)) {
-            if(bytes)
-                bytes->push_back(token);
+    this->worker = new DeviceWorker(this->transport, this->stats, this->registerCache);
+    this->worker->moveToThread(&this->deviceThread);
 
-            return false;
-        }
+    connect(&this->deviceThread, &QThread::finished, this->worker, &QObject::deleteLater);
+    connect(this->worker, &DeviceWorker::finished, this, &MainWindow::onDeviceResult);
+    connect(this->worker, &DeviceWorker::pollStatus, this, &MainWindow::onPollStatus);
+    connect(this->worker, &DeviceWorker::memoryProgress, this, &MainWindow::onMemoryProgress);
+    connect(this->worker, &DeviceWorker::disconnected, this, &MainWindow::onDeviceDisconnected);
+    connect(this->worker, &DeviceWorker::reconnected, this, &MainWindow::onDeviceReconnected);
 
-        for(std::size_t i = token.length(); i < 8; ++i)
-            token = '0' + token;
+    this->worker->setAutoReconnect(ui->actionReconnect_Automatically->isChecked() ? autoReconnectTimeout : std::chrono::seconds(0));
 
-        if(bytes)
-            bytes->push_back(token);
-    }
+    if(this->trace)
+        this->worker->startTrace(this->trace);
 
-    return true;
+    this->automationDevice.setWorker(this->worker);
+
+    this->deviceThread.start();
 }
 
-BOOL MainWindow::setBusSpeed() const {                                  // HELPER FUNCTION FOR RUN COMMMAND BUTTON
-    bool result;
+void MainWindow::stopWorker() {
+    if(!this->worker)
+        return;
 
-    if(ui->busSpeedRadioButton_0->isChecked()) { // 20 kHz
-        result = CH341SetStream(this->deviceNum, 0);
-        qDebug() << "BUS SPEED: 20 kHz";
-    }
-    else if(ui->busSpeedRadioButton_1->isChecked()) { // 100 kHz
-        result = CH341SetStream(this->deviceNum, 1);
-        qDebug() << "BUS SPEED: 100 kHz";
-    }
-    else if(ui->busSpeedRadioButton_2->isChecked()) { // 400 kHz
-        result = CH341SetStream(this->deviceNum, 2);
-        qDebug() << "BUS SPEED: 400 kHz";
-    }
-    else {                                            // 750 kHz
-        result = CH341SetStream(this->deviceNum, 3);
-        qDebug() << "BUS SPEED: 750 kHz";
+    this->automationDevice.setWorker(nullptr); // Its futures finish with "Device closed"
+    this->worker->cancelPending();
+
+    this->deviceThread.requestInterruption(); // Stops waiting for a lost adapter to come back
+    this->deviceThread.quit();
+    this->deviceThread.wait();
+
+    this->worker = nullptr;
+
+    // WRITE BACK DEFERRED REGISTERS, THE DEVICE MAY NOT BE THE SAME ONE ONCE REOPENED
+    std::vector<std::size_t> origin;
+    std::vector<I2CTransaction> flush = this->registerCache->flush(origin);
+
+    if(!flush.empty()) {
+        StreamScheduler scheduler(this->transport);
+        ScheduleReport report;
+        std::vector<I2CResult> flushResults;
+
+        scheduler.runBatch(flush, {}, false, flushResults, report);
+        this->registerCache->complete(flush, origin, flushResults);
     }
 
-    return result;
-}
+    if(std::size_t dropped = this->registerCache->invalidate())
+        qDebug().nospace() << "DROPPED " << dropped << " UNFLUSHED REGISTER WRITE(S)!\n";
 
-void MainWindow::on_runButton_clicked()                                 // RUN COMMAND BUTTON
-{
-    ui->readTextEdit->clear();
+    ui->cancelButton->setEnabled(false);
+    this->resetPollButton();
 
-    // SET BUS SPEED
-    if(!this->setBusSpeed()) {
-        qDebug() << "Failed to set bus speed, please reconnect the CH341 device!\n";
-        QMessageBox::critical(this, " ", "Failed to set bus speed, please reconnect the CH341 device!");
+    this->memoryFiles.clear();
+    this->memoryProgressBar->hide();
+}
+
+void MainWindow::submit(DeviceRequest request) {
+    if(!this->worker->submit(std::move(request))) {
+        qDebug() << "Too many queued commands!\n";
+        QMessageBox::warning(this, " ", "Too many queued commands!");
         return;
     }
 
+    ui->cancelButton->setEnabled(true);
+    ui->statusbar->showMessage("Queued " + QString::number(this->worker->pending()) + " request(s)", 5000);
+}
+
+void MainWindow::on_runButton_clicked()                                 // RUN COMMAND BUTTON
+{
     // PROCESS ADDRESS
-    std::string addressStr = ui->addressLineEdit->text().toStdString();
-    if(!isValidAddress(addressStr)) {
+    QString addressStr = ui->addressLineEdit->text();
+    unsigned address;
+    if(!parseValue(addressStr, 0x7F, address)) {
         qDebug().nospace().noquote() << "Invalid device address (" << addressStr << ")!\n";
-        QMessageBox::warning(this, " ", "Invalid device address (" + QString::fromStdString(addressStr) + ")!");
+        QMessageBox::warning(this, " ", "Invalid device address (" + addressStr + ")!");
         return;
     }
 
-    UCHAR address = std::stoi(addressStr, NULL, 2);
-
     qDebug().nospace() << "ADDRESS: " << Qt::bin << address;
 
     // PROCESS REGISTER
-    std::string regStr = ui->registerLineEdit->text().toStdString();
-    if(!regStr.empty() && !isBinaryByte(regStr)) {
+    QString regStr = ui->registerLineEdit->text();
+    unsigned reg = 0;
+    bool hasReg = !regStr.trimmed().isEmpty();
+    if(hasReg && !parseValue(regStr, 0xFF, reg)) {
         qDebug().nospace().noquote() << "Invalid register address (" << regStr << ")!\n";
-        QMessageBox::warning(this, " ", "Invalid register address (" + QString::fromStdString(regStr) + ")!");
+        QMessageBox::warning(this, " ", "Invalid register address (" + regStr + ")!");
         return;
     }
 
+    DeviceRequest request;
+    request.transactions.resize(1);
+
+    I2CTransaction& transaction = request.transactions.front();
+    transaction.address = address;
+    transaction.readLength = ui->readSpinBox->value();
+    transaction.speedMode = this->selectedSpeedMode();
+
+    if(hasReg)
+        transaction.write.push_back(reg);
+
     // PROCESS WRITE DATA
-    std::string writeDataStr = ui->writeTextEdit->toPlainText().toStdString();
+    QString writeDataStr = ui->writeTextEdit->toPlainText();
+    ByteParser::Error error;
 
-    if(!regStr.empty())
-        writeDataStr = regStr + " " + writeDataStr;
+    if(!parseBytes(writeDataStr, transaction.write, &error)) {
+        QString invalidByte = describeError(writeDataStr, error);
 
-    int readLength = ui->readSpinBox->value();
+        qDebug().nospace().noquote() << "Invalid write data (" << invalidByte << ")!\n";
+        QMessageBox::warning(this, " ", "Invalid write data (" + invalidByte + ")!");
 
-    if(writeDataStr.empty() && readLength == 0) {
-        qDebug() << "Nothing to read/write!\n";
+        QTextCursor cursor = ui->writeTextEdit->textCursor(); // Select the offending token
+        cursor.setPosition((int)error.position);
+        cursor.setPosition((int)(error.position + error.length), QTextCursor::KeepAnchor);
+        ui->writeTextEdit->setTextCursor(cursor);
         return;
     }
 
-    std::vector<std::string> strBytes;
+    if(transaction.write.empty() && transaction.readLength == 0) {
+        qDebug() << "Nothing to read/write!\n";
+        return;
+    }
 
-    if(!isValidWriteData(writeDataStr, &strBytes)) {
-        QString invalidByte = "";
+    if(transaction.write.size() > 1022) {
+        qDebug() << "Exceeded write limit (1022 bytes)!\n";
+        QMessageBox::warning(this, " ", "Exceeded write limit (1022 bytes)!");
+        return;
+    }
 
-        if(strBytes.size() != 0)
-            invalidByte = " (" + QString::fromStdString(strBytes.back()) + ")";
+    // PROCESS RETRY POLICY
+    QString retryStr = ui->retryLineEdit->text();
+    QString retryError;
 
-        qDebug().nospace().noquote() << "Invalid write data" << invalidByte << "!\n";
-        QMessageBox::warning(this, " ", "Invalid write data" + invalidByte + "!");
+    if(!RetryPolicy::parse(retryStr, request.retry, &retryError)) {
+        qDebug().nospace().noquote() << "Invalid retry policy (" << retryError << ")!\n";
+        QMessageBox::warning(this, " ", "Invalid retry policy (" + retryError + ")!");
         return;
     }
 
-    if(strBytes.size() > 1022) {
-        qDebug() << "Exceeded write limit (1022 bytes)!\n";
-        QMessageBox::warning(this, " ", "Exceeded write limit (1022 bytes)!");
+    qDebug() << "BUS SPEED MODE:" << transaction.speedMode;
+
+    if(!transaction.write.empty()) {
+        qDebug() << "WRITING:";
+        for(unsigned char byte : transaction.write)
+            qDebug().nospace() << "\t" << Qt::bin << byte;
+    }
+
+    // QUEUE R/W REQUEST
+    this->submit(std::move(request));
+}
+
+void MainWindow::onDeviceResult(const DeviceResult& result)             // DEVICE THREAD RESULT
+{
+    ui->cancelButton->setEnabled(this->worker && this->worker->pending() != 0);
+
+    if(result.kind == DeviceRequest::Scan || result.kind == DeviceRequest::CacheFlush) // Shown by their dialogs
+        return;
+
+    if(result.owner) // Submitted through the automation API, delivered to its futures
+        return;
+
+    if(result.kind == DeviceRequest::MemoryRead || result.kind == DeviceRequest::MemoryWrite) {
+        this->showMemoryResult(result);
         return;
     }
 
-    std::vector<UCHAR> bytes; bytes.reserve(strBytes.size() + 1);
+    if(result.cancelled) {
+        qDebug().nospace() << "CANCELLED REQUEST #" << result.id << "\n";
+        return;
+    }
 
-    bytes.push_back(address << 1);
+    if(result.kind == DeviceRequest::Sequence) {
+        this->showSequenceResult(result);
+        return;
+    }
 
-    for(std::string& byte : strBytes)
-        bytes.push_back(std::stoi(byte, NULL, 2));
+    if(result.nacked) { // The adapter is fine, the device did not answer (e.g. busy or wrong address)
+        const I2CResult& nacked = result.results.front();
+        QString retried = nacked.retries ? " after " + QString::number(nacked.retries) + " retries (" +
+                                           QString::number(nacked.waited / 1000000.0, 'f', 2) + " ms)" : QString();
 
-    if(bytes.size() == 1) // If only reading
-        ++bytes[0];
-    else {
-        std::size_t count = bytes.size();
+        qDebug().noquote() << result.error + retried + "!\n";
+        ui->statusbar->showMessage(result.error + retried + "!", 5000);
+        return;
+    }
 
-        qDebug() << "WRITING:";
-        for(std::size_t i = 1; i < count; ++i)
-            qDebug().nospace() << "\t" << Qt::bin << bytes[i];
+    if(!result.ok) {
+        qDebug().noquote() << result.error + ", please reconnect the CH341 device!\n";
+        QMessageBox::critical(this, " ", result.error + ", please reconnect the CH341 device!");
+        return;
     }
 
-    // SEND R/W REQUEST
-    UCHAR* readBuffer = NULL;
+    if(result.resumed)
+        qDebug().nospace() << "RESUMED REQUEST #" << result.id << " AFTER RECONNECTING";
 
-    if(readLength != 0)
-        readBuffer = new UCHAR[readLength];
+    QString resumed = result.resumed ? ", resumed after reconnecting" : "";
 
-    if(!CH341StreamI2C(this->deviceNum, bytes.size(), &bytes[0], readLength, readBuffer)) {
-        qDebug() << "Failed to run command, please reconnect the CH341 device!\n";
-        QMessageBox::critical(this, " ", "Failed to run command, please reconnect the CH341 device!");
+    this->results.clear();
+
+    // DISPLAY BATCH RESULTS
+    if(!result.names.isEmpty()) {
+        qDebug().nospace() << "RAN " << result.names.size() << " COMMANDS IN " << result.schedule.transfers << " TRANSFER(S) (" << result.elapsed / 1000 << " us)";
+        qDebug().nospace() << "BUS SPEED CHANGES: " << result.schedule.reconfigurations << " (" << result.schedule.saved << " SAVED)";
+        if(result.schedule.merged)
+            qDebug().nospace() << "REGISTER WRITES MERGED INTO BURSTS: " << result.schedule.merged;
+
+        for(qsizetype i = 0; i < result.names.size(); ++i) {
+            this->results.beginSegment(result.names[i], result.results[i].acked);
+            this->results.append(result.results[i].read.data(), result.results[i].read.size());
+        }
+
+        ui->statusbar->showMessage("Ran " + QString::number(result.names.size()) + " command(s) in " + QString::number(result.schedule.transfers) +
+                                   " transfer(s), " + QString::number(result.elapsed / 1000000.0, 'f', 2) + " ms, " +
+                                   QString::number(result.schedule.saved) + " bus speed change(s) saved" +
+                                   (result.schedule.merged ? ", " + QString::number(result.schedule.merged) + " write(s) merged" : "") +
+                                   (result.cached ? ", " + QString::number(result.cached) + " from the register cache" : "") + resumed, 5000);
+
+        qDebug() << "";
         return;
     }
+
+    const I2CResult& transactionResult = result.results.front();
+
+    if(transactionResult.retries) {
+        qDebug().nospace() << "ACKED AFTER " << transactionResult.retries << " RETRIES (" << transactionResult.waited / 1000 << " us)";
+        ui->statusbar->showMessage("Command success! (after " + QString::number(transactionResult.retries) + " retries, " +
+                                   QString::number(transactionResult.waited / 1000000.0, 'f', 2) + " ms)", 5000);
+    }
+    else if(result.cached)
+        ui->statusbar->showMessage("Command success! (from the register cache)", 5000);
+    else if(result.resumed)
+        ui->statusbar->showMessage("Command success! (resumed after reconnecting)", 5000);
     else
-        ui->statusbar->showMessage("Command success!", 5000);
+        ui->statusbar->showMessage(result.schedule.saved ? "Command success! (bus speed unchanged)" : "Command success!", 5000);
 
     // DISPLAY READ DATA
-    if(readBuffer) {
+    const std::vector<unsigned char>& readBuffer = transactionResult.read;
+
+    if(!readBuffer.empty()) {
         qDebug() << "READING:";
-        for(int i = 0; i < readLength; ++i)
-            qDebug().nospace() << "\t" << Qt::bin << readBuffer[i];
+        for(unsigned char byte : readBuffer)
+            qDebug().nospace() << "\t" << Qt::bin << byte;
 
-        std::ostringstream oss;
-        oss << std::bitset<8>{readBuffer[0]};
+        this->results.append(readBuffer.data(), readBuffer.size());
+    }
+
+    qDebug() << "";
+}
+
+void MainWindow::copyResults()                                          // COPY READ RESULTS
+{
+    // Walk the selection ranges rather than selectedIndexes(), which would create an index per selected cell
+    QString text;
+
+    for(const QItemSelectionRange& range : ui->readTableView->selectionModel()->selection())
+        text += this->results.text(range.top(), range.bottom(), range.left(), range.right());
 
-        for(int i = 1; i < readLength; ++i)
-            oss << " " << std::bitset<8>{readBuffer[i]};
+    if(!text.isEmpty())
+        QGuiApplication::clipboard()->setText(text);
+}
+
+void MainWindow::on_cancelButton_clicked()                              // CANCEL BUTTON
+{
+    this->worker->cancelPending();
+
+    qDebug() << "CANCELLING QUEUED REQUESTS\n";
+    ui->statusbar->showMessage("Cancelled queued requests", 5000);
+}
+
+void MainWindow::on_pollButton_toggled(bool checked)                   // POLL BUTTON
+{
+    if(!checked) {
+        if(this->worker)
+            this->worker->stopPolling();
 
-        ui->readTextEdit->setPlainText(QString::fromStdString(oss.str()));
+        return;
+    }
+
+    QString commandName = ui->commandsComboBox->currentText();
+    std::optional<Command> command = this->commands.find(commandName);
+
+    if(!command) {
+        qDebug() << "Select a saved command to poll!\n";
+        QMessageBox::warning(this, " ", "Select a saved command to poll!");
+        this->resetPollButton();
+        return;
+    }
+
+    I2CTransaction transaction = command->transaction();
+
+    // Bounded no matter how long the capture runs, the oldest samples get overwritten
+    const std::size_t captureBudget = 64 * 1024 * 1024;
+    this->capture = std::make_shared<SampleRing>(transaction.readLength,
+                                                 SampleRing::capacityFor(transaction.readLength, captureBudget));
+    this->captureName = commandName;
+    this->captureShown = 0;
+
+    this->worker->startPolling(transaction, ui->pollRateSpinBox->value(), this->capture);
+    this->captureTimer.start(100);
+
+    ui->pollButton->setText("STOP");
+    ui->pollRateSpinBox->setEnabled(false);
+    ui->actionExport_Capture->setEnabled(true);
+
+    qDebug().nospace() << "POLLING " << commandName << " AT " << ui->pollRateSpinBox->value() << " HZ ("
+                       << this->capture->capacity() << " SAMPLE BUFFER)\n";
+}
 
-        delete[] readBuffer;
+void MainWindow::on_actionReconnect_Automatically_toggled(bool checked) // RECONNECT AUTOMATICALLY MENU BUTTON
+{
+    if(this->worker)
+        this->worker->setAutoReconnect(checked ? autoReconnectTimeout : std::chrono::seconds(0));
+}
+
+void MainWindow::onDeviceDisconnected(unsigned long deviceNum)          // DEVICE THREAD LOST THE DEVICE
+{
+    qDebug().nospace() << "CH341 DEVICE #" << deviceNum << " DISCONNECTED, REOPENING";
+    ui->statusbar->showMessage("CH341 device #" + QString::number(deviceNum) + " disconnected, reconnecting...");
+}
+
+void MainWindow::onDeviceReconnected(const ReconnectReport& report)
+{
+    QString location = report.location.isEmpty() ? QString() : " (" + report.location + ")";
+    QString downtime = QString::number(report.downtime / 1000000.0, 'f', 1) + " ms";
+
+    if(!report.ok) {
+        qDebug().nospace().noquote() << "GAVE UP REOPENING CH341 DEVICE #" << report.deviceNum << location << " AFTER "
+                                     << downtime << " (" << report.attempts << " ATTEMPTS)\n";
+        ui->statusbar->showMessage("CH341 device #" + QString::number(report.deviceNum) + " did not come back within " + downtime);
+        return;
+    }
+
+    ++this->reconnects;
+    this->downtime += report.downtime;
+    this->deviceNum = report.reopenedAs;
+    this->deviceLocation = report.location.toStdString();
+    this->driverVersion = report.driverVersion;
+
+    qDebug().nospace().noquote() << "REOPENED CH341 DEVICE #" << report.deviceNum << location << " AS #" << report.reopenedAs
+                                 << " AFTER " << downtime << " (" << report.attempts << " ATTEMPTS)\n";
+    ui->statusbar->showMessage("Reconnected CH341 device #" + QString::number(report.reopenedAs) + " after " + downtime +
+                               " of downtime, resuming", 10000);
+}
+
+void MainWindow::onPollStatus(const PollStats& stats)                   // DEVICE THREAD POLLING STATUS
+{
+    QString status = "\"" + this->captureName + "\": " + QString::number(stats.rate, 'f', 1) + " Hz (target " +
+                     QString::number(stats.targetRate, 'f', 0) + "), jitter " + QString::number(stats.jitter, 'f', 1) + " us, " +
+                     QString::number(stats.missed) + " missed, " + QString::number(stats.nacks) + " NACK(s), " +
+                     QString::number(stats.samples) + " sample(s)";
+
+    if(stats.running) {
+        ui->statusbar->showMessage("Polling " + status);
+        return;
+    }
+
+    this->resetPollButton();
+    this->showCapture();
+
+    qDebug().noquote() << "STOPPED POLLING" << status << "( max lateness" << stats.maxLateness << "us )\n";
+    ui->statusbar->showMessage("Stopped polling " + status);
+
+    if(!stats.error.isEmpty()) {
+        qDebug().noquote() << stats.error + ", please reconnect the CH341 device!\n";
+        QMessageBox::critical(this, " ", stats.error + ", please reconnect the CH341 device!");
+    }
+}
+
+void MainWindow::showCapture() {                                        // HELPER FUNCTIONS FOR POLLING
+    if(!this->capture || this->capture->written() == this->captureShown)
+        return;
+
+    this->captureShown = this->capture->written();
+
+    SampleRing::Sample sample;
+    if(!this->capture->read(this->captureShown - 1, sample))
+        return;
+
+    this->results.clear();
+    this->results.beginSegment("#" + QString::number(sample.index + 1) + " @ " + QString::number(sample.timestamp / 1000) + " us",
+                               sample.acked);
+    this->results.append(sample.data.data(), sample.data.size());
+}
+
+void MainWindow::resetPollButton() {
+    QSignalBlocker blocker(ui->pollButton);
+
+    ui->pollButton->setChecked(false);
+    ui->pollButton->setText("POLL");
+    ui->pollRateSpinBox->setEnabled(true);
+
+    this->captureTimer.stop();
+}
+
+void MainWindow::on_actionExport_Capture_triggered()                    // EXPORT CAPTURE MENU BUTTON
+{
+    if(!this->capture)
+        return;
+
+    QString filePath = QFileDialog::getSaveFileName(this, "Export capture", QDir::homePath(), "Comma separated values (*.csv)");
+
+    if(filePath.isEmpty())
+        return;
+
+    std::ofstream file(std::filesystem::path(filePath.toStdU16String()));
+
+    if(!file.is_open()) {
+        qDebug().nospace() << "Failed to export to " << filePath << "!";
+        QMessageBox::warning(this, " ", "Failed to export to \"" + filePath + "\"!");
+        return;
+    }
+
+    file << "Sample,Time (us),ACK,Read Data";
+
+    // Samples still being captured past this point are left out
+    std::uint64_t end = this->capture->written();
+    std::size_t exported = 0;
+
+    SampleRing::Sample sample;
+    for(std::uint64_t i = this->capture->oldest(); i < end; ++i) {
+        if(!this->capture->read(i, sample))
+            continue;
+
+        file << "\n" << sample.index + 1 << "," << sample.timestamp / 1000 << "," << (sample.acked ? 1 : 0) << ",";
+
+        for(std::size_t j = 0; j < sample.data.size(); ++j)
+            file << (j ? " " : "") << std::bitset<8>{sample.data[j]};
+
+        ++exported;
+    }
+
+    file.close();
+
+    qDebug().nospace() << "EXPORTED " << exported << " SAMPLES TO " << filePath << "!\n";
+    ui->statusbar->showMessage("Exported " + QString::number(exported) + " sample(s) to \"" + filePath + "\"!", 5000);
+}
+
+void MainWindow::on_actionScan_Bus_triggered()                          // SCAN BUS MENU BUTTON
+{
+    ScanDialog dialog(this->worker, this->selectedSpeedMode(), this);
+    dialog.exec();
+}
+
+void MainWindow::on_actionRun_Fixture_triggered()                       // RUN FIXTURE MENU BUTTON
+{
+    // RELEASE THIS ADAPTER SO THE FIXTURE CAN OPEN IT TOO
+    unsigned long deviceNum = this->deviceNum;
+
+    this->stopWorker();
+
+    qDebug().nospace() << "CLOSING CH341 DEVICE #" << deviceNum << "\n";
+    this->transport->close();
+
+    {
+        FixtureDialog dialog(this->transport, &this->commands, this->stats, QString::number(deviceNum), this);
+        dialog.setAutoReconnect(ui->actionReconnect_Automatically->isChecked() ? autoReconnectTimeout : std::chrono::seconds(0));
+        dialog.exec();
+    }
+
+    if(!this->transport->open(deviceNum)) {
+        qDebug().nospace() << "Failed to reopen CH341 device #" << deviceNum << "!\n";
+        QMessageBox::critical(this, " ", "Failed to reopen CH341 device #" + QString::number(deviceNum) + "!");
+
+        this->on_actionReconnect_Device_triggered();
+        return;
+    }
+
+    this->startWorker();
+}
+
+void MainWindow::on_actionStatistics_triggered()                        // STATISTICS MENU BUTTON
+{
+    if(!this->statsDialog)
+        this->statsDialog = new StatsDialog(this->stats, this);
+
+    this->statsDialog->show();
+    this->statsDialog->raise();
+    this->statsDialog->activateWindow();
+}
+
+void MainWindow::on_actionRegister_Cache_triggered()                    // REGISTER CACHE MENU BUTTON
+{
+    RegisterCacheDialog dialog(this->worker, this->registerCache, this);
+    dialog.exec();
+}
+
+void MainWindow::on_actionRecord_Trace_triggered(bool checked)          // RECORD TRACE MENU BUTTON
+{
+    if(!checked) {
+        this->worker->stopTrace();
+
+        qDebug().nospace() << "RECORDED " << this->trace->records() << " TRANSACTIONS TO " << this->trace->path() << "!\n";
+        ui->statusbar->showMessage("Recorded " + QString::number(this->trace->records()) + " transaction(s) to \"" + this->trace->path() + "\"", 5000);
+
+        this->trace.reset();
+        return;
+    }
+
+    QString filePath = QFileDialog::getSaveFileName(this, "Record trace", QDir::homePath(),
+                                                    QString("Transaction traces (*.") + TraceWriter::suffix + ")");
+
+    if(filePath.isEmpty()) {
+        ui->actionRecord_Trace->setChecked(false);
+        return;
+    }
+
+    std::shared_ptr<TraceWriter> trace = std::make_shared<TraceWriter>();
+    QString error;
+
+    if(!trace->open(filePath, &error)) {
+        qDebug().nospace() << "Failed to record to " << filePath << " (" << error << ")!\n";
+        QMessageBox::warning(this, " ", "Failed to record to \"" + filePath + "\" (" + error + ")!");
+        ui->actionRecord_Trace->setChecked(false);
+        return;
+    }
+
+    this->trace = trace;
+    this->worker->startTrace(trace);
+
+    qDebug().nospace() << "RECORDING TRANSACTIONS TO " << filePath << "\n";
+    ui->statusbar->showMessage("Recording transactions to \"" + filePath + "\"", 5000);
+}
+
+void MainWindow::on_actionRead_Memory_triggered()                       // READ MEMORY MENU BUTTON
+{
+    this->runMemory(false);
+}
+
+void MainWindow::on_actionWrite_Memory_triggered()                      // WRITE MEMORY MENU BUTTON
+{
+    this->runMemory(true);
+}
+
+void MainWindow::runMemory(bool writing) {                              // HELPER FUNCTIONS FOR MEMORY READS/WRITES
+    MemoryDialog dialog(writing, ui->addressLineEdit->text(), this);
+
+    if(dialog.exec() != QDialog::Accepted)
+        return;
+
+    QString addressStr = dialog.address();
+    unsigned address;
+    if(!parseValue(addressStr, 0x7F, address)) {
+        qDebug().nospace().noquote() << "Invalid device address (" << addressStr << ")!\n";
+        QMessageBox::warning(this, " ", "Invalid device address (" + addressStr + ")!");
+        return;
     }
 
+    QString filePath = dialog.filePath();
+    if(filePath.isEmpty()) {
+        qDebug() << "No file selected!\n";
+        QMessageBox::warning(this, " ", "No file selected!");
+        return;
+    }
+
+    DeviceRequest request;
+    request.kind = writing ? DeviceRequest::MemoryWrite : DeviceRequest::MemoryRead;
+    request.memory.address = address;
+    request.memory.addressBytes = dialog.addressBytes();
+    request.memory.pageSize = dialog.pageSize();
+    request.memory.speedMode = this->selectedSpeedMode();
+    request.offset = dialog.offset();
+    request.length = dialog.length();
+
+    if(writing) {
+        std::ifstream file(std::filesystem::path(filePath.toStdU16String()), std::ios::binary);
+
+        if(!file.is_open()) {
+            qDebug().nospace() << "Failed to open " << filePath << "!\n";
+            QMessageBox::warning(this, " ", "Failed to open \"" + filePath + "\"!");
+            return;
+        }
+
+        request.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        request.length = request.data.size();
+
+        if(request.data.empty()) {
+            qDebug().nospace() << "Nothing to write (" << filePath << " is empty)!\n";
+            QMessageBox::warning(this, " ", "Nothing to write (\"" + filePath + "\" is empty)!");
+            return;
+        }
+    }
+
+    // 8 bit addressing reaches 2 KB through the device address bits, 16 bit addressing 64 KB
+    std::size_t memorySize = request.memory.addressBytes == 1 ? 2048 : 65536;
+
+    if(request.offset + request.length > memorySize) {
+        qDebug().nospace() << "Exceeded memory size (" << memorySize << " bytes)!\n";
+        QMessageBox::warning(this, " ", "Exceeded memory size (" + QString::number(memorySize) + " bytes)!");
+        return;
+    }
+
+    qDebug().nospace() << (writing ? "WRITING " : "READING ") << request.length << " BYTES " << (writing ? "TO" : "FROM")
+                       << " MEMORY AT 0x" << Qt::hex << request.offset;
+
+    // The result comes back through the event loop, so the id is recorded before it can arrive
+    quint64 id = this->worker->submit(std::move(request));
+
+    if(!id) {
+        qDebug() << "Too many queued commands!\n";
+        QMessageBox::warning(this, " ", "Too many queued commands!");
+        return;
+    }
+
+    this->memoryFiles[id] = writing ? QString() : filePath;
+
+    ui->cancelButton->setEnabled(true);
+    this->memoryProgressBar->setValue(0);
+    this->memoryProgressBar->show();
+}
+
+void MainWindow::onMemoryProgress(quint64 id, const BlockProgress& progress)
+{
+    (void)id;
+
+    this->memoryProgressBar->setValue(progress.total ? (int)(progress.done * 1000 / progress.total) : 0);
+    this->memoryProgressBar->show();
+
+    ui->statusbar->showMessage(QString::number(progress.done) + " / " + QString::number(progress.total) + " bytes, " +
+                               QString::number(progress.bytesPerSecond() / 1024, 'f', 1) + " KiB/s, " +
+                               QString::number(progress.ackPolls) + " ACK poll(s)");
+}
+
+void MainWindow::showMemoryResult(const DeviceResult& result) {
+    bool writing = result.kind == DeviceRequest::MemoryWrite;
+    QString filePath = this->memoryFiles[result.id];
+
+    this->memoryFiles.erase(result.id);
+    this->memoryProgressBar->setVisible(!this->memoryFiles.empty());
+
+    if(result.cancelled) {
+        qDebug().nospace() << "CANCELLED MEMORY " << (writing ? "WRITE" : "READ") << " #" << result.id << " AFTER " << result.memory.done << " BYTES\n";
+        ui->statusbar->showMessage("Cancelled memory " + QString(writing ? "write" : "read") + " after " +
+                                   QString::number(result.memory.done) + " bytes", 5000);
+        return;
+    }
+
+    if(!result.ok) {
+        qDebug().noquote() << "Memory" << (writing ? "write" : "read") << "failed (" + result.error + ")!\n";
+        QMessageBox::critical(this, " ", "Memory " + QString(writing ? "write" : "read") + " failed (" + result.error + ")!");
+        return;
+    }
+
+    if(!writing) {
+        const std::vector<unsigned char>& data = result.results.front().read;
+
+        this->results.clear();
+        this->results.beginSegment(QFileInfo(filePath).fileName(), true, result.offset);
+        this->results.append(data.data(), data.size());
+
+        std::ofstream file(std::filesystem::path(filePath.toStdU16String()), std::ios::binary);
+
+        if(!file.is_open() || !file.write(reinterpret_cast<const char*>(data.data()), data.size())) {
+            qDebug().nospace() << "Failed to save to " << filePath << "!\n";
+            QMessageBox::warning(this, " ", "Failed to save to \"" + filePath + "\"!");
+            return;
+        }
+    }
+
+    QString summary = QString(writing ? "Wrote " : "Read ") + QString::number(result.memory.done) + " bytes in " +
+                      QString::number(result.memory.elapsed.count() / 1000000.0, 'f', 1) + " ms (" +
+                      QString::number(result.memory.bytesPerSecond() / 1024, 'f', 1) + " KiB/s, " +
+                      QString::number(result.memory.ackPolls) + " ACK poll(s))";
+
+    qDebug().noquote() << summary.toUpper() << "\n";
+    ui->statusbar->showMessage(summary, 5000);
+}
+
+void MainWindow::showSequenceResult(const DeviceResult& result) {       // HELPER FUNCTION FOR SEQUENCE RESULTS
+    const SequenceReport& report = result.sequence;
+    QString summary = QString::number(report.transactions) + " read(s)/write(s), " + QString::number(report.retries) + " retries, " +
+                      (report.commandRetries ? QString::number(report.commandRetries) + " command retries, " : QString()) +
+                      QString::number(report.nacks) + " NACK(s) in " + QString::number(report.elapsed.count() / 1000000.0, 'f', 2) + " ms";
+
+    qDebug().noquote() << "RAN SEQUENCE:" << summary;
+
+    // LAST READ BACK OF EVERY READ, ALSO WHEN THE SEQUENCE STOPPED PART WAY
+    this->results.clear();
+
+    for(qsizetype i = 0; i < result.names.size(); ++i) {
+        const I2CResult& read = result.results[i];
+
+        if(read.batched == 0 || read.read.empty())
+            continue;
+
+        this->results.beginSegment(result.names[i], read.acked);
+        this->results.append(read.read.data(), read.read.size());
+    }
+
+    if(!result.ok) { // A NACK, failed assertion or timeout is the sequence's verdict, not a lost device
+        qDebug().noquote() << result.error + "!\n";
+        QMessageBox::warning(this, " ", result.error + "!");
+        return;
+    }
+
+    ui->statusbar->showMessage("Sequence done, " + summary, 5000);
+
     qDebug() << "";
 }
 
-void MainWindow::addCommands() {                                        // HELPER FUNCTION TO DISPLAY COMMANDS IN COMBO BOX
-    ui->commandsComboBox->clear();
+void MainWindow::on_actionRun_Batch_triggered()                         // RUN BATCH MENU BUTTON
+{
+    QStringList names;
+    for(std::size_t row = 0; row < this->commands.size(); ++row)
+        names.append(this->commands.command(row).name);
+
+    bool ok;
+    QString text = QInputDialog::getMultiLineText(this, " ", "Commands to run in order (one per line, \"#tag\" runs every command with that tag, \"---\" keeps the order across it):",
+                                                  names.join("\n"), &ok);
+
+    if(!ok)
+        return;
+
+    // COLLECT COMMANDS
+    DeviceRequest request;
+    request.kind = DeviceRequest::Batch;
+    request.reorder = ui->actionGroup_By_Bus_Speed->isChecked();
+    request.autoIncrement = this->autoIncrement;
+
+    QString unknownCommands = "";
+
+    for(const QString& line : text.split('\n')) {
+        QString name = line.trimmed();
+
+        if(name.isEmpty())
+            continue;
+
+        if(name == "---") { // Ordering barrier
+            request.barriers.push_back(request.transactions.size());
+            continue;
+        }
+
+        std::vector<Command> commands; // A name or "#tag" for a whole group
+
+        if(!this->commands.expand(name, commands)) {
+            unknownCommands += "\n\"" + name + "\"";
+            continue;
+        }
+
+        for(const Command& command : commands) {
+            request.names.append(command.name);
+            request.transactions.push_back(command.transaction());
+        }
+    }
+
+    if(!unknownCommands.isEmpty()) {
+        qDebug().noquote() << "Unknown commands:" << unknownCommands << "\n";
+        QMessageBox::warning(this, " ", "Unknown commands:" + unknownCommands);
+        return;
+    }
+
+    if(request.transactions.empty())
+        return;
+
+    this->submit(std::move(request));
+}
+
+void MainWindow::on_actionAuto_Increment_Devices_triggered()            // AUTO INCREMENT DEVICES MENU BUTTON
+{
+    QStringList addresses;
+    for(unsigned address = 0; address < 128; ++address) {
+        if(this->autoIncrement[address])
+            addresses.append("0x" + QString::number(address, 16).rightJustified(2, '0').toUpper());
+    }
+
+    bool ok;
+    QString text = QInputDialog::getText(this, " ", "Addresses of the devices that auto increment their register pointer (space separated),\n"
+                                                    "batches merge consecutive register writes to them into a single burst:",
+                                         QLineEdit::Normal, addresses.join(" "), &ok);
+
+    if(!ok)
+        return;
+
+    std::bitset<128> autoIncrement;
+
+    for(const QString& token : text.split(' ', Qt::SkipEmptyParts)) {
+        unsigned address;
+
+        if(!parseValue(token, 0x7F, address)) {
+            qDebug().noquote() << "Invalid address \"" + token + "\"!\n";
+            QMessageBox::warning(this, " ", "Invalid address \"" + token + "\"!");
+            return;
+        }
 
-    for(std::pair<const QString, Command>& command : this->commands)
-        ui->commandsComboBox->addItem(command.first);
+        autoIncrement[address] = true;
+    }
+
+    this->autoIncrement = autoIncrement;
+    qDebug().nospace() << "AUTO INCREMENT DEVICES: " << autoIncrement.count() << "\n";
+}
+
+void MainWindow::on_actionSequences_triggered()                         // SEQUENCES MENU BUTTON
+{
+    SequenceDialog dialog(this->worker, &this->commands, &this->sequences, this);
+    dialog.exec();
+
+    if(dialog.changed())
+        this->saved = false;
 }
 
 void MainWindow::on_commandsLoadButton_clicked()                        // LOAD BUTTON
 {
     QString commandName = ui->commandsComboBox->currentText();
+    std::optional<Command> command = this->commands.find(commandName);
 
-    if(this->commands.find(commandName) == this->commands.end())
+    if(!command)
         return;
 
     if(QMessageBox::question(this, " ", "Load command \"" + commandName + "\"?") == QMessageBox::No)
         return;
 
-    Command& command = this->commands[commandName];
-
-    ui->addressLineEdit->setText(command.address);
-    ui->registerLineEdit->setText(command.reg);
-    ui->writeTextEdit->setPlainText(command.data);
-    ui->readSpinBox->setValue(command.readLength);
+    ui->addressLineEdit->setText(QString::fromStdString(command->addressText()));
+    ui->registerLineEdit->setText(QString::fromStdString(command->registerText()));
+    ui->writeTextEdit->setPlainText(QString::fromStdString(command->dataText()));
+    ui->readSpinBox->setValue(command->readLength);
+    ui->tagsLineEdit->setText(command->tags.join(" "));
+    ui->retryLineEdit->setText(command->retry.text());
 
-    switch (command.speedMode) {
+    switch (command->speedMode) {
         case 0: ui->busSpeedRadioButton_0->setChecked(true); break;
         case 1: ui->busSpeedRadioButton_1->setChecked(true); break;
         case 2: ui->busSpeedRadioButton_2->setChecked(true); break;
@@ -268,7 +1004,7 @@ void MainWindow::on_commandsAddButton_clicked()                         // ADD B
     if(commandName.isEmpty())
         return;
 
-    if(this->commands.find(commandName) != this->commands.end()) {
+    if(this->commands.find(commandName)) {
         if(QMessageBox::No == QMessageBox::warning(this, " ", "Command \"" + commandName + "\" already exists! Overwrite?",
                                                     QMessageBox::Yes | QMessageBox::No, QMessageBox::No)) {
             return;
@@ -279,78 +1015,74 @@ void MainWindow::on_commandsAddButton_clicked()                         // ADD B
             return;
     }
 
-    QString address = ui->addressLineEdit->text(); // Address check
-    if(!isValidAddress(address.toStdString())) {
-        qDebug().nospace().noquote() << "Failed to add command \"" << commandName << "\" (invalid device address: " << address << ")!\n";
-        QMessageBox::warning(this, " ", "Failed to add command \"" + commandName + "\" (invalid device address: " + address + ")!");
+    QString addressStr = ui->addressLineEdit->text(); // Address check
+    unsigned addressValue;
+    if(!parseValue(addressStr, 0x7F, addressValue)) {
+        qDebug().nospace().noquote() << "Failed to add command \"" << commandName << "\" (invalid device address: " << addressStr << ")!\n";
+        QMessageBox::warning(this, " ", "Failed to add command \"" + commandName + "\" (invalid device address: " + addressStr + ")!");
         return;
     }
 
-    for(size_t i = address.length(); i < 7; ++i)
-        address = '0' + address;
-
-    QString reg = ui->registerLineEdit->text(); // Register check
-    if(!reg.isEmpty() && !isBinaryByte(reg.toStdString())) {
-        qDebug().nospace().noquote() << "Failed to add command \"" << commandName << "\" (invalid register address: " << reg << ")!\n";
-        QMessageBox::warning(this, " ", "Failed to add command \"" + commandName + "\" (invalid register address: " + reg + ")!");
+    QString regStr = ui->registerLineEdit->text(); // Register check
+    unsigned regValue = 0;
+    bool hasReg = !regStr.trimmed().isEmpty();
+    if(hasReg && !parseValue(regStr, 0xFF, regValue)) {
+        qDebug().nospace().noquote() << "Failed to add command \"" << commandName << "\" (invalid register address: " << regStr << ")!\n";
+        QMessageBox::warning(this, " ", "Failed to add command \"" + commandName + "\" (invalid register address: " + regStr + ")!");
         return;
     }
 
-    if(!reg.isEmpty()) {
-        for(size_t i = reg.length(); i < 8; ++i)
-            reg = '0' + reg;
-    }
+    QString writeDataStr = ui->writeTextEdit->toPlainText(); // Write data check
+    std::vector<unsigned char> bytes;
+    ByteParser::Error error;
+
+    if(!parseBytes(writeDataStr, bytes, &error)) {
+        QString invalidByte = describeError(writeDataStr, error);
 
-    std::string writeDataStr = ui->writeTextEdit->toPlainText().toStdString(); // Write data check
+        qDebug().nospace().noquote() << "Failed to add command \"" << commandName << "\" (invalid write data: " << invalidByte << ")!\n";
+        QMessageBox::warning(this, " ", "Failed to add command \"" + commandName + "\" (invalid write data: " + invalidByte + ")!");
+        return;
+    }
 
     int readLength = ui->readSpinBox->value();
 
-    if(reg.isEmpty() && writeDataStr.empty() && readLength == 0) {
+    if(!hasReg && bytes.empty() && readLength == 0) {
         qDebug().nospace() << "Failed to add command " << commandName << " (nothing to read/write)!\n";
         QMessageBox::warning(this, " ", "Failed to add command \"" + commandName + "\" (nothing to read/write)!");
         return;
     }
 
-    if(!writeDataStr.empty()) {
-        std::vector<std::string> bytes;
-
-        if(!isValidWriteData(writeDataStr, &bytes)) {
-            qDebug().nospace().noquote() << "Failed to add command \"" << commandName << "\" (invalid write data: " << bytes.back() << ")!\n";
-            QMessageBox::warning(this, " ", "Failed to add command \"" + commandName + "\" (invalid write data: " + QString::fromStdString(bytes.back()) + ")!");
-            return;
-        }
-
-        std::size_t byteLimit = 1022;
-        if(!reg.isEmpty())
-            --byteLimit;
-
-        if(bytes.size() > byteLimit) {
-            qDebug().nospace() << "Failed to add command " << commandName << " (exceeded write limit of 1022 bytes)!\n";
-            QMessageBox::warning(this, " ", "Failed to add command \"" + commandName + "\" (exceeded write limit of 1022 bytes)!");
-            return;
-        }
+    if(bytes.size() + hasReg > 1022) {
+        qDebug().nospace() << "Failed to add command " << commandName << " (exceeded write limit of 1022 bytes)!\n";
+        QMessageBox::warning(this, " ", "Failed to add command \"" + commandName + "\" (exceeded write limit of 1022 bytes)!");
+        return;
+    }
 
-        std::ostringstream oss;
-        oss << bytes[0];    // Generating write data string
-        for(std::size_t i = 1; i < bytes.size(); ++i)
-            oss << " " << bytes[i];
+    QString retryStr = ui->retryLineEdit->text(); // Retry policy check
+    RetryPolicy retry;
+    QString retryError;
 
-        writeDataStr = oss.str();
+    if(!RetryPolicy::parse(retryStr, retry, &retryError)) {
+        qDebug().nospace().noquote() << "Failed to add command \"" << commandName << "\" (invalid retry policy: " << retryError << ")!\n";
+        QMessageBox::warning(this, " ", "Failed to add command \"" + commandName + "\" (invalid retry policy: " + retryError + ")!");
+        return;
     }
 
-    ULONG speedMode;    // Get speed mode
-    if(ui->busSpeedRadioButton_0->isChecked())      // 20 kHz
-        speedMode = 0;
-    else if(ui->busSpeedRadioButton_1->isChecked()) // 100 kHz
-        speedMode = 1;
-    else if(ui->busSpeedRadioButton_2->isChecked()) // 400 kHz
-        speedMode = 2;
-    else                                            // 750 kHz
-        speedMode = 3;
-
-    this->commands[commandName] = { commandName, address, reg, QString::fromStdString(writeDataStr), readLength, speedMode };
-    this->addCommands();
-    ui->commandsComboBox->setCurrentIndex(ui->commandsComboBox->findText(commandName));
+    // Stored encoded, ready to go onto the bus
+    Command command;
+    command.name = commandName;
+    command.address = addressValue;
+    command.hasRegister = hasReg;
+    if(hasReg)
+        command.write.push_back(regValue);
+    command.write.insert(command.write.end(), bytes.begin(), bytes.end());
+    command.readLength = readLength;
+    command.speedMode = this->selectedSpeedMode();
+    command.tags = Command::splitTags(ui->tagsLineEdit->text());
+    command.retry = retry;
+
+    int row = this->commands.insertOrReplace(command);
+    ui->commandsComboBox->setCurrentIndex(row);
 
     this->saved = false;
 
@@ -362,15 +1094,13 @@ void MainWindow::on_commandsDeleteButton_clicked()                      // DELET
 {
     QString commandName = ui->commandsComboBox->currentText();
 
-    if(this->commands.find(commandName) == this->commands.end())
+    if(!this->commands.find(commandName))
         return;
 
     if(QMessageBox::warning(this, " ", "Delete command \"" + commandName + "\"?", QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::No)
         return;
 
-    this->commands.erase(this->commands.find(commandName));
-
-    ui->commandsComboBox->removeItem(ui->commandsComboBox->findText(commandName));
+    this->commands.remove(commandName);
 
     this->saved = false;
 
@@ -380,185 +1110,169 @@ void MainWindow::on_commandsDeleteButton_clicked()                      // DELET
 
 void MainWindow::on_actionOpen_triggered()                              // OPEN MENU BUTTON
 {
-    // OPENING FILE
-    QString filePath = QFileDialog::getOpenFileName(this, "Open", QDir::homePath(), "Comma separated values (*.csv)");
+    QString filePath = QFileDialog::getOpenFileName(this, "Open", QDir::homePath(), libraryFilter);
 
     if(filePath.isEmpty())
         return;
 
-    qDebug() << "OPENING CSV FILE";
+    if(QFileInfo(filePath).suffix() == CommandLibrary::suffix) { // Mapped and used in place, nothing to parse
+        qDebug() << "OPENING COMMAND LIBRARY";
 
-    std::ifstream file(filePath.toStdWString().c_str());
+        std::shared_ptr<CommandLibrary> library = std::make_shared<CommandLibrary>();
+        QString error;
 
-    if(file.is_open()) {
-        qDebug().nospace() << "OPENED " << filePath << "!";
-        ui->statusbar->showMessage("Opened \"" + filePath + "\"!", 5000);
-    }
-    else {
-        qDebug().nospace() << "Failed to open " << filePath << "!";
-        QMessageBox::warning(this, " ", "Failed to open \"" + filePath + "\"!");
+        if(!library->open(filePath, &error)) {
+            qDebug().nospace() << "Failed to open " << filePath << " (" << error << ")!\n";
+            QMessageBox::warning(this, " ", "Failed to open \"" + filePath + "\" (" + error + ")!");
+            return;
+        }
+
+        this->commands.setLibrary(library);
+        this->loadSequences(filePath);
+
+        qDebug().nospace() << "OPENED " << filePath << " (" << library->size() << " COMMANDS)!\n";
+        ui->statusbar->showMessage("Opened \"" + filePath + "\" (" + QString::number(library->size()) + " commands)!", 5000);
+
+        this->currPath = filePath;
+        this->saved = true;
         return;
     }
 
-    // PROCESSING FILE
-    this->commands.clear();
+    qDebug() << "OPENING CSV FILE";
 
-    std::string line;
+    // PARSED IN THE BACKGROUND, THE LIBRARY IS SWAPPED IN ONCE IT IS DONE
+    this->loadingPath = filePath;
+    this->loadTimer.start();
+    this->setLibraryBusy(true);
 
-    std::getline(file, line); // Skip title line
+    this->libraryLoader.setFuture(QtConcurrent::run([filePath](QPromise<CommandCsv::LoadResult>& promise) {
+        CommandCsv::LoadResult result;
+        promise.setProgressRange(0, 1000);
 
-    QString invalidCommands = "";
+        bool ok = CommandCsv::load(filePath, result, [&promise](std::size_t done, std::size_t total) {
+            promise.setProgressValue(total == 0 ? 1000 : (int)(done * 1000 / total));
+            return !promise.isCanceled();
+        });
 
-    std::istringstream iss;
-    while(std::getline(file, line)) {
-        iss.str(line);
-        iss.clear();
+        if(ok || !result.error.isEmpty())
+            promise.addResult(std::move(result));
+    }));
+}
 
-        std::string name; // Name
+void MainWindow::onLibraryLoaded()
+{
+    this->setLibraryBusy(false);
 
-        if(line[0] == '"') { // Handles the infuriating case of commas and/or double quotes in names
-            std::size_t lastDoubleQuote = line.find_last_of('"');
+    QFuture<CommandCsv::LoadResult> future = this->libraryLoader.future();
 
-            if(lastDoubleQuote < 2 || lastDoubleQuote + 2 > line.length())
-                continue;
+    if(future.isCanceled() || future.resultCount() == 0)
+        return;
 
-            for(size_t i = 1; i < lastDoubleQuote; ++i) {
-                name += line[i];
+    CommandCsv::LoadResult result = future.takeResult();
 
-                if(line[i] == '"') // Skip the next quote due to CSV format
-                    ++i;
-            }
+    if(!result.error.isEmpty()) {
+        qDebug().nospace() << "Failed to open " << this->loadingPath << " (" << result.error << ")!\n";
+        QMessageBox::warning(this, " ", "Failed to open \"" + this->loadingPath + "\"!");
+        return;
+    }
 
-            iss.str(line.substr(lastDoubleQuote + 2));
-        }
-        else if(!std::getline(iss, name, ',') || name.empty())
-            continue;
+    std::size_t count = result.commands.size();
+    this->commands.setCommands(std::move(result.commands)); // Already sorted, one reset instead of an insert per command
+    this->loadSequences(this->loadingPath);
 
-        if(this->commands.find(QString::fromStdString(name)) != this->commands.end()) {
-            invalidCommands += "\n\"" + QString::fromStdString(name) + "\"";
-            continue;
-        }
+    QString summary = "Opened \"" + this->loadingPath + "\" (" + QString::number(count) + " commands in " +
+                      QString::number(this->loadTimer.elapsed()) + " ms)!";
 
-        std::string address; // Address
-        if(!std::getline(iss, address, ',') || !isValidAddress(address)) {
-            invalidCommands += "\n\"" + QString::fromStdString(name) + "\"";
-            continue;
-        }
+    qDebug().noquote() << summary.toUpper();
+    ui->statusbar->showMessage(summary, 5000);
 
-        for(size_t i = address.length(); i < 7; ++i)
-            address = '0' + address;
+    if(!result.rejected.empty()) {
+        const std::size_t listed = 20;
+        QString invalidCommands = "";
 
-        std::string reg; // Register
-        if(!std::getline(iss, reg, ',') || (!reg.empty() && !isBinaryByte(reg))) {
-            invalidCommands += "\n\"" + QString::fromStdString(name) + "\"";
-            continue;
-        }
+        for(std::size_t i = 0; i < result.rejected.size() && i < listed; ++i)
+            invalidCommands += "\n\"" + result.rejected[i].name + "\" (row " + QString::number(result.rejected[i].row) + ")";
 
-        std::size_t byteLimit = 1022;
+        if(result.rejected.size() > listed)
+            invalidCommands += "\n... and " + QString::number(result.rejected.size() - listed) + " more";
 
-        if(!reg.empty()) {
-            for(size_t i = reg.length(); i < 8; ++i)
-                reg = '0' + reg;
+        qDebug().noquote() << "Failed to load these commands:" << invalidCommands;
+        QMessageBox::warning(this, " ", "Failed to load these commands:" + invalidCommands);
+    }
 
-            --byteLimit;
-        }
+    this->currPath = this->loadingPath;
+    this->saved = true;
 
-        std::string writeDataStr; // Write data
-        std::vector<std::string> bytes;
+    qDebug() << "";
+}
 
-        if(!std::getline(iss, writeDataStr, ',') || !isValidWriteData(writeDataStr, &bytes) || bytes.size() > byteLimit) {
-            invalidCommands += "\n\"" + QString::fromStdString(name) + "\"";
-            continue;
-        }
+void MainWindow::setLibraryBusy(bool busy) {                           // HELPER FUNCTION, NO EDITS WHILE A LIBRARY LOADS
+    ui->commandsComboBox->setEnabled(!busy);
+    ui->commandsLoadButton->setEnabled(!busy);
+    ui->commandsAddButton->setEnabled(!busy);
+    ui->commandsDeleteButton->setEnabled(!busy);
+    ui->actionOpen->setEnabled(!busy);
+    ui->actionSave->setEnabled(!busy);
+    ui->actionSave_As->setEnabled(!busy);
+
+    this->loadProgressBar->setValue(0);
+    this->loadProgressBar->setVisible(busy);
+}
 
-        if(!writeDataStr.empty()) {
-            std::ostringstream oss;
-            oss << bytes[0];    // Generating write data string
-            for(std::size_t i = 1; i < bytes.size(); ++i)
-                oss << " " << bytes[i];
+bool MainWindow::saveLibrary(const QString& filePath) {                 // HELPER FUNCTION FOR SAVE/SAVE AS, THE FORMAT FOLLOWS THE FILE SUFFIX
+    if(QFileInfo(filePath).suffix() == CommandLibrary::suffix) {
+        qDebug() << "SAVING COMMAND LIBRARY";
 
-            writeDataStr = oss.str();
-        }
+        // Stop reading from a mapped library first, it may be the very file being replaced
+        this->commands.detach();
 
-        int readLength = 0; // Read length
-        std::string readLengthStr;
-        try {
-            if(std::getline(iss, readLengthStr, ',')) {
-                readLength = std::stoi(readLengthStr);
-
-                if(readLength < 0 || readLength > 1023)
-                    throw std::invalid_argument("Read length out of range!");
-            }
-            else
-                throw std::invalid_argument("Read length not given!");
-        }
-        catch(const std::invalid_argument& e) {
-            invalidCommands += "\n\"" + QString::fromStdString(name) + "\"";
-            continue;
-        }
+        return CommandLibrary::write(filePath, this->commands) && this->saveSequences(filePath);
+    }
 
-        if(reg.empty() && writeDataStr.empty() && readLength == 0) {
-            invalidCommands += "\n\"" + QString::fromStdString(name) + "\"";
-            continue;
-        }
+    qDebug() << "SAVING CSV FILE";
 
-        ULONG speedMode = 1; // Speed mode
-        std::string speedModeStr;
-        try {
-            if(std::getline(iss, speedModeStr, ',')) {
-                speedMode = std::stoi(speedModeStr);
-
-                if(speedMode > 3)
-                    throw std::invalid_argument("Speed mode out of range!");
-            }
-            else
-                throw std::invalid_argument("Speed mode not given!");
-        }
-        catch(const std::invalid_argument& e) {
-            invalidCommands += "\n\"" + QString::fromStdString(name) + "\"";
-            continue;
-        }
+    return CommandCsv::save(filePath, this->commands) && this->saveSequences(filePath);
+}
 
-        this->commands[QString::fromStdString(name)] =
-            {
-                QString::fromStdString(name),
-                QString::fromStdString(address),
-                QString::fromStdString(reg),
-                QString::fromStdString(writeDataStr),
-                readLength,
-                speedMode
-            };
-    }
+bool MainWindow::saveSequences(const QString& libraryPath) {            // HELPER FUNCTIONS FOR THE SEQUENCES SAVED NEXT TO A LIBRARY
+    QString filePath = Sequences::sidecarPath(libraryPath);
 
-    this->addCommands();
+    // No file for a library without sequences, though an outdated one is emptied
+    if(this->sequences.empty() && !QFileInfo::exists(filePath))
+        return true;
 
-    if(!invalidCommands.isEmpty()) {
-        qDebug().noquote() << "Failed to load these commands:" << invalidCommands;
-        QMessageBox::warning(this, " ", "Failed to load these commands:" + invalidCommands);
-    }
+    qDebug() << "SAVING SEQUENCES";
 
-    file.close();
+    return Sequences::save(filePath, this->sequences);
+}
 
-    this->currPath = filePath;
-    this->saved = true;
+void MainWindow::loadSequences(const QString& libraryPath) {
+    QString filePath = Sequences::sidecarPath(libraryPath);
+    QString error;
 
-    qDebug() << "";
+    this->sequences.clear();
+
+    if(!QFileInfo::exists(filePath))
+        return;
+
+    if(!Sequences::load(filePath, this->sequences, &error)) {
+        qDebug().nospace() << "Failed to open " << filePath << " (" << error << ")!\n";
+        QMessageBox::warning(this, " ", "Failed to open \"" + filePath + "\" (" + error + ")!");
+        return;
+    }
+
+    qDebug().nospace() << "OPENED " << this->sequences.size() << " SEQUENCES FROM " << filePath;
 }
 
-const std::string titleLine = "Command Name,Device Address (7 bits),Register Address,\"Write Data (space separated, <1023 bytes including register address)\",Read Length (<1024 bytes),Speed Mode (0-3)";
 void MainWindow::on_actionSave_As_triggered()                           // SAVE AS MENU BUTTON
 {
     // OPENING FILE
-    QString filePath = QFileDialog::getSaveFileName(this, "Save as", QDir::homePath(), "Comma separated values (*.csv)");
+    QString filePath = QFileDialog::getSaveFileName(this, "Save as", QDir::homePath(), libraryFilter);
 
     if(filePath.isEmpty())
         return;
 
-    qDebug() << "SAVING CSV FILE";
-
-    std::ofstream file(filePath.toStdWString().c_str());
-
-    if(file.is_open()) {
+    if(this->saveLibrary(filePath)) {
         qDebug().nospace() << "SAVED to " << filePath << "!";
         ui->statusbar->showMessage("Saved to \"" + filePath + "\"!", 5000);
     }
@@ -568,37 +1282,6 @@ void MainWindow::on_actionSave_As_triggered()                           // SAVE
         return;
     }
 
-    // WRITING FILE
-    file << titleLine;
-
-    for(std::pair<const QString, Command>& command : this->commands) {
-        file << "\n";
-
-        std::string name = command.first.toStdString();
-
-        if(name.find('"') != std::string::npos || name.find(',') != std::string::npos) { // Handles the infuriating case of commas and/or double quotes in names
-            std::string temp = "\"";
-
-            for(size_t i = 0; i < name.length(); ++i) {
-                temp += name[i];
-
-                if(name[i] == '"')
-                    temp += '"';
-            }
-
-            name = temp + '"';
-        }
-
-        file << name << ",";
-        file << command.second.address.toStdString() << ",";
-        file << command.second.reg.toStdString() << ",";
-        file << command.second.data.toStdString() << ",";
-        file << command.second.readLength << ",";
-        file << command.second.speedMode;
-    }
-
-    file.close();
-
     this->currPath = filePath;
     this->saved = true;
 
@@ -617,11 +1300,7 @@ void MainWindow::on_actionSave_triggered()                              // SAVE
     if(QMessageBox::question(this, " ", "Save commands to \"" + this->currPath + "\"?") == QMessageBox::No)
         return;
 
-    qDebug() << "SAVING CSV FILE";
-
-    std::ofstream file(this->currPath.toStdWString().c_str());
-
-    if(file.is_open()) {
+    if(this->saveLibrary(this->currPath)) {
         qDebug().nospace() << "SAVED " << this->currPath << "!";
         ui->statusbar->showMessage("Saved \"" + this->currPath + "\"!", 5000);
     }
@@ -631,36 +1310,6 @@ void MainWindow::on_actionSave_triggered()                              // SAVE
         return;
     }
 
-    // WRITING FILE
-    file << titleLine;
-
-    for(std::pair<const QString, Command>& command : this->commands) {
-        file << "\n";
-
-        std::string name = command.first.toStdString();
-
-        if(name.find('"') != std::string::npos || name.find(',') != std::string::npos) { // Handles the infuriating case of commas and/or double quotes in names
-            std::string temp = "\"";
-
-            for(size_t i = 0; i < name.length(); ++i) {
-                temp += name[i];
-
-                if(name[i] == '"')
-                    temp += '"';
-            }
-
-            name = temp + '"';
-        }
-
-        file << name << ",";
-        file << command.second.address.toStdString() << ",";
-        file << command.second.reg.toStdString() << ",";
-        file << command.second.data.toStdString() << ",";
-        file << command.second.readLength << ",";
-        file << command.second.speedMode;
-    }
-
-    file.close();
     this->saved = true;
 
     qDebug() << "";
@@ -668,13 +1317,15 @@ void MainWindow::on_actionSave_triggered()                              // SAVE
 
 void MainWindow::on_actionReconnect_Device_triggered()                 // RECONNECT DEVICE MENU BUTTON
 {
-    qDebug().nospace() << "CLOSING CH341 DEVICE #" << this->deviceNum << "\n";
-    CH341CloseDevice(this->deviceNum);
+    this->stopWorker();
+
+    qDebug().nospace() << "CLOSING CH341 DEVICE #" << this->transport->deviceNum() << "\n";
+    this->transport->close();
 
     this->hide();
 
     int deviceNum = -1;
-    DeviceSelect* deviceSelect = new DeviceSelect;
+    DeviceSelect* deviceSelect = new DeviceSelect(this->transport);
     deviceSelect->exec();
 
     deviceNum = deviceSelect->deviceNum;
@@ -683,7 +1334,7 @@ void MainWindow::on_actionReconnect_Device_triggered()                 // RECONN
     if(deviceNum == -1)
         QApplication::exit();
     else {
-        this->deviceNum = deviceNum;
+        this->startWorker();
         this->show();
     }
 }
@@ -693,8 +1344,15 @@ void MainWindow::on_actionAbout_Device_triggered()                      // ABOUT
     std::ostringstream oss;
 
     oss << "Device Number: " << this->deviceNum << "\n";
-    oss << "Driver Version: " << CH341GetDrvVersion() << "\n";
-    oss << "Library Version: " << CH341GetVersion();
+    oss << "Transport: " << this->transport->name() << "\n";
+    oss << "Driver Version: " << this->driverVersion << "\n";
+    oss << "Library Version: " << this->libraryVersion;
+
+    if(!this->deviceLocation.empty())
+        oss << "\nLocation: " << this->deviceLocation;
+
+    if(this->reconnects)
+        oss << "\nAutomatic Reconnects: " << this->reconnects << " (" << this->downtime / 1000000 << " ms downtime)";
 
     QMessageBox::information(this, " ", QString::fromStdString(oss.str()));
 }
@@ -17,28 +17,42 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
-#include <windows.h>
+#include <bitset>
 #include <map>
+#include <memory>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QMainWindow>
+#include <QThread>
+#include <QTimer>
+
+#include "asyncdevice.h"
+#include "commandcsv.h"
+#include "commandmodel.h"
+#include "deviceworker.h"
+#include "registercache.h"
+#include "resultmodel.h"
+#include "sequences.h"
+
+class I2CTransport;
+class QProgressBar;
+class StatsDialog;
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
-struct Command {
-    QString name, address, reg, data;
-    int readLength;
-    ULONG speedMode;
-};
-
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr, ULONG deviceNum = 0);
+    MainWindow(I2CTransport* transport, QWidget *parent = nullptr);
     ~MainWindow();
 
+    // Automation API, follows the device across reopens and reconnects
+    AsyncDevice* automation() { return &this->automationDevice; }
+
 private slots:
     void on_runButton_clicked();
 
@@ -60,14 +74,99 @@ private slots:
 
     void on_actionReconnect_Device_triggered();
 
+    void on_actionRun_Batch_triggered();
+
+    void on_actionAuto_Increment_Devices_triggered();
+
+    void on_actionSequences_triggered();
+
+    void on_cancelButton_clicked();
+
+    void onDeviceResult(const DeviceResult& result);
+
+    void on_pollButton_toggled(bool checked);
+
+    void onPollStatus(const PollStats& stats);
+
+    void on_actionExport_Capture_triggered();
+
+    void on_actionScan_Bus_triggered();
+
+    void on_actionRun_Fixture_triggered();
+
+    void on_actionStatistics_triggered();
+
+    void on_actionRegister_Cache_triggered();
+
+    void on_actionRecord_Trace_triggered(bool checked);
+
+    void on_actionRead_Memory_triggered();
+
+    void on_actionWrite_Memory_triggered();
+
+    void onMemoryProgress(quint64 id, const BlockProgress& progress);
+
+    void on_actionReconnect_Automatically_toggled(bool checked);
+
+    void onDeviceDisconnected(unsigned long deviceNum);
+
+    void onDeviceReconnected(const ReconnectReport& report);
+
+    void copyResults();
+
+    void onLibraryLoaded();
+
 private:
     Ui::MainWindow *ui;
     bool saved = false;
     QString currPath = "";
-    std::map<QString, Command> commands;
-
-    ULONG deviceNum = 0;
-    BOOL setBusSpeed() const;
-    void addCommands();
+    CommandModel commands;
+    CommandFilterModel commandSearch;
+    Sequences::Map sequences;                   // Saved next to the library
+    std::bitset<128> autoIncrement;             // Batches merge consecutive register writes to these devices
+
+    QFutureWatcher<CommandCsv::LoadResult> libraryLoader;
+    QString loadingPath;
+    QElapsedTimer loadTimer;
+    QProgressBar* loadProgressBar;
+
+    I2CTransport* transport;
+    QThread deviceThread;
+    DeviceWorker* worker = nullptr;
+    AsyncDevice automationDevice;               // Retargeted to every new worker
+    std::shared_ptr<TransactionStats> stats = std::make_shared<TransactionStats>();
+    StatsDialog* statsDialog = nullptr;
+    std::shared_ptr<RegisterCache> registerCache = std::make_shared<RegisterCache>();
+    std::shared_ptr<TraceWriter> trace;         // Kept across reconnects, closed once the worker lets go too
+    unsigned long deviceNum = 0;                // Copies for About Device, the transport's own change on the device thread
+    std::string deviceLocation;
+    unsigned long driverVersion = 0;
+    unsigned long libraryVersion = 0;
+    int reconnects = 0;                         // Automatic ones, for About Device
+    qint64 downtime = 0;                        // Nanoseconds, summed over them
+
+    ResultModel results;
+
+    std::shared_ptr<SampleRing> capture;
+    QString captureName;
+    quint64 captureShown = 0;
+    QTimer captureTimer;
+
+    std::map<quint64, QString> memoryFiles;     // Memory read request id -> file to save to
+    QProgressBar* memoryProgressBar;
+
+    unsigned long selectedSpeedMode() const;
+    void startWorker();
+    void stopWorker();
+    void submit(DeviceRequest request);
+    void showCapture();
+    void resetPollButton();
+    void runMemory(bool writing);
+    void showMemoryResult(const DeviceResult& result);
+    void showSequenceResult(const DeviceResult& result);
+    void setLibraryBusy(bool busy);
+    bool saveLibrary(const QString& filePath);
+    bool saveSequences(const QString& libraryPath);
+    void loadSequences(const QString& libraryPath);
 };
 #endif // MAINWINDOW_H
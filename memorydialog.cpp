@@ -0,0 +1,80 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "memorydialog.h"
+#include "ui_memorydialog.h"
+
+#include <QDir>
+#include <QFileDialog>
+
+MemoryDialog::MemoryDialog(bool writing, const QString& address, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::MemoryDialog),
+    writing(writing)
+{
+    ui->setupUi(this);
+    this->setWindowTitle(writing ? "Write Memory" : "Read Memory");
+
+    ui->addressLineEdit->setText(address);
+
+    ui->lengthLabel->setVisible(!writing);
+    ui->lengthSpinBox->setVisible(!writing);
+}
+
+MemoryDialog::~MemoryDialog()
+{
+    delete ui;
+}
+
+QString MemoryDialog::address() const
+{
+    return ui->addressLineEdit->text();
+}
+
+int MemoryDialog::addressBytes() const
+{
+    return ui->addressingComboBox->currentIndex() + 1;
+}
+
+int MemoryDialog::pageSize() const
+{
+    return ui->pageSizeSpinBox->value();
+}
+
+int MemoryDialog::offset() const
+{
+    return ui->offsetSpinBox->value();
+}
+
+int MemoryDialog::length() const
+{
+    return ui->lengthSpinBox->value();
+}
+
+QString MemoryDialog::filePath() const
+{
+    return ui->fileLineEdit->text();
+}
+
+void MemoryDialog::on_browseButton_clicked()
+{
+    QString filePath = this->writing ?
+        QFileDialog::getOpenFileName(this, "Write from", QDir::homePath(), "Binary files (*.bin);;All files (*)") :
+        QFileDialog::getSaveFileName(this, "Read to", QDir::homePath(), "Binary files (*.bin);;All files (*)");
+
+    if(!filePath.isEmpty())
+        ui->fileLineEdit->setText(filePath);
+}
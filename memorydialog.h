@@ -0,0 +1,50 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef MEMORYDIALOG_H
+#define MEMORYDIALOG_H
+
+#include <QDialog>
+
+namespace Ui {
+class MemoryDialog;
+}
+
+// Asks for the memory layout, range and file of a memory read/write
+class MemoryDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    MemoryDialog(bool writing, const QString& address, QWidget *parent = nullptr);
+    ~MemoryDialog();
+
+    QString address() const;
+    int addressBytes() const;
+    int pageSize() const;
+    int offset() const;
+    int length() const;     // Reads only, writes take the file size
+    QString filePath() const;
+
+private slots:
+    void on_browseButton_clicked();
+
+private:
+    Ui::MemoryDialog *ui;
+    bool writing;
+};
+
+#endif // MEMORYDIALOG_H
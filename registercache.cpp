@@ -0,0 +1,343 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "registercache.h"
+
+#include <QRegularExpression>
+#include <QStringList>
+
+#include "byteparser.h"
+
+namespace {
+
+struct Access {
+    enum Kind { Other, Read, Write } kind = Other;
+    unsigned first = 0;                 // Register
+    std::size_t count = 0;
+};
+
+Access classify(const I2CTransaction& transaction)
+{
+    const std::vector<unsigned char>& write = transaction.write;
+
+    if(write.size() == 1 && transaction.readLength != 0 && write[0] + transaction.readLength <= 256)
+        return { Access::Read, write[0], transaction.readLength };
+
+    if(write.size() >= 2 && transaction.readLength == 0 && write[0] + write.size() - 1 <= 256)
+        return { Access::Write, write[0], write.size() - 1 };
+
+    return {};
+}
+
+std::bitset<256> registerRange(unsigned first, std::size_t count)
+{
+    return count == 0 ? std::bitset<256>() : (~std::bitset<256>() >> (256 - count)) << first;
+}
+
+}
+
+void RegisterCache::configure(const std::vector<Device>& devices)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    for(std::unique_ptr<Shadow>& shadow : this->shadows)
+        shadow.reset();
+
+    for(const Device& device : devices) {
+        std::unique_ptr<Shadow>& shadow = this->shadows[device.address & 0x7F];
+
+        shadow = std::make_unique<Shadow>();
+        shadow->config = device;
+        shadow->cacheable = device.cached & ~device.volatiles;
+    }
+
+    this->enabled.store(!devices.empty());
+}
+
+std::vector<RegisterCache::Device> RegisterCache::configuration() const
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::vector<Device> devices;
+
+    for(const std::unique_ptr<Shadow>& shadow : this->shadows) {
+        if(shadow)
+            devices.push_back(shadow->config);
+    }
+
+    return devices;
+}
+
+std::vector<I2CTransaction> RegisterCache::plan(const std::vector<I2CTransaction>& transactions, std::vector<I2CResult>& results,
+                                                std::vector<std::size_t>& origin, std::size_t* served)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::vector<I2CTransaction> bus;
+
+    bus.reserve(transactions.size());
+    origin.clear();
+    results.assign(transactions.size(), I2CResult());
+
+    if(served)
+        *served = 0;
+
+    for(std::size_t i = 0; i < transactions.size(); ++i) {
+        const I2CTransaction& transaction = transactions[i];
+        Shadow* shadow = this->shadows[transaction.address & 0x7F].get();
+        results[i].acked = false;
+
+        if(!shadow) {
+            bus.push_back(transaction);
+            origin.push_back(i);
+            continue;
+        }
+
+        Access access = classify(transaction);
+        std::bitset<256> range = registerRange(access.first, access.count);
+        bool cacheable = access.kind != Access::Other && (range & shadow->cacheable) == range;
+
+        // READ HIT
+        if(access.kind == Access::Read && cacheable && (range & shadow->valid) == range) {
+            results[i].acked = true;
+            results[i].read.assign(shadow->values.begin() + access.first, shadow->values.begin() + access.first + access.count);
+
+            ++this->counters.hits;
+            this->counters.bytesSaved += transaction.busBytes();
+
+            if(served)
+                ++*served;
+
+            continue;
+        }
+
+        // DEFERRED WRITE, a register written again before the flush only goes out once
+        if(access.kind == Access::Write && cacheable && shadow->config.writeBack) {
+            std::copy(transaction.write.begin() + 1, transaction.write.end(), shadow->values.begin() + access.first);
+
+            this->counters.coalesced += (range & shadow->dirty).count();
+            shadow->valid |= range;
+            shadow->dirty |= range;
+            shadow->speedMode = transaction.speedMode;
+
+            results[i].acked = true;
+
+            ++this->counters.deferred;
+            this->counters.bytesSaved += transaction.busBytes();
+
+            if(served)
+                ++*served;
+
+            continue;
+        }
+
+        if(access.kind == Access::Read && (range & shadow->cacheable).any())
+            ++this->counters.misses;
+
+        // TO THE BUS, after whatever was deferred for the device
+        this->flushDevice(*shadow, bus, origin);
+
+        if(access.kind == Access::Write)
+            shadow->valid &= ~range; // Known again once it is acknowledged
+        else if(access.kind == Access::Other && transaction.write.size() >= 2)
+            shadow->valid.reset();   // Some write of unknown extent
+
+        bus.push_back(transaction);
+        origin.push_back(i);
+    }
+
+    return bus;
+}
+
+void RegisterCache::complete(const std::vector<I2CTransaction>& bus, const std::vector<std::size_t>& origin,
+                             const std::vector<I2CResult>& results)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    for(std::size_t i = 0; i < bus.size() && i < results.size(); ++i) {
+        const I2CTransaction& transaction = bus[i];
+        const I2CResult& result = results[i];
+        Shadow* shadow = this->shadows[transaction.address & 0x7F].get();
+        bool acked = result.batched != 0 && result.acked; // Transactions after a failed transfer never ran
+
+        if(!shadow) // Reconfigured in the meantime
+            continue;
+
+        if(origin[i] == fromCache) {
+            if(acked) {
+                ++this->counters.flushed;
+                this->counters.bytesFlushed += transaction.busBytes();
+            }
+            else
+                shadow->dirty.set(transaction.write[0]); // The shadow still holds the value to write
+
+            continue;
+        }
+
+        Access access = classify(transaction);
+
+        if(!acked || access.kind == Access::Other)
+            continue;
+
+        if(access.kind == Access::Read && result.read.size() < access.count)
+            continue;
+
+        // Registers deferred again later in the same plan already hold newer values
+        std::bitset<256> update = registerRange(access.first, access.count) & shadow->cacheable & ~shadow->dirty;
+        const unsigned char* data = access.kind == Access::Read ? result.read.data() : transaction.write.data() + 1;
+
+        for(std::size_t j = 0; j < access.count; ++j) {
+            if(update[access.first + j])
+                shadow->values[access.first + j] = data[j];
+        }
+
+        shadow->valid |= update;
+    }
+}
+
+std::vector<I2CTransaction> RegisterCache::flush(std::vector<std::size_t>& origin, int address)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::vector<I2CTransaction> bus;
+
+    origin.clear();
+
+    for(std::size_t i = 0; i < this->shadows.size(); ++i) {
+        if(this->shadows[i] && (address < 0 || (std::size_t)address == i))
+            this->flushDevice(*this->shadows[i], bus, origin);
+    }
+
+    return bus;
+}
+
+void RegisterCache::flushDevice(Shadow& shadow, std::vector<I2CTransaction>& bus, std::vector<std::size_t>& origin)
+{
+    if(shadow.dirty.none())
+        return;
+
+    for(unsigned i = 0; i < 256; ++i) {
+        if(!shadow.dirty[i])
+            continue;
+
+        bus.push_back({ shadow.config.address, { (unsigned char)i, shadow.values[i] }, 0, shadow.speedMode });
+        origin.push_back(fromCache);
+    }
+
+    shadow.dirty.reset(); // Set again by complete() for the ones that fail
+}
+
+std::size_t RegisterCache::invalidate(int address)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    std::size_t dropped = 0;
+
+    for(std::size_t i = 0; i < this->shadows.size(); ++i) {
+        Shadow* shadow = this->shadows[i].get();
+
+        if(!shadow || (address >= 0 && (std::size_t)address != i))
+            continue;
+
+        dropped += shadow->dirty.count();
+        shadow->valid.reset();
+        shadow->dirty.reset();
+    }
+
+    return dropped;
+}
+
+void RegisterCache::forget(const I2CTransaction& transaction)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    Shadow* shadow = this->shadows[transaction.address & 0x7F].get();
+
+    if(!shadow)
+        return;
+
+    Access access = classify(transaction);
+
+    if(access.kind == Access::Write) {
+        std::bitset<256> range = registerRange(access.first, access.count);
+
+        shadow->valid &= ~range;
+        shadow->dirty &= ~range;        // Overwritten on the device, a later flush must not undo that
+    }
+    else if(access.kind == Access::Other && transaction.write.size() >= 2) {
+        shadow->valid.reset();
+        shadow->dirty.reset();
+    }
+}
+
+RegisterCacheStats RegisterCache::stats() const
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+    RegisterCacheStats stats = this->counters;
+
+    for(const std::unique_ptr<Shadow>& shadow : this->shadows) {
+        if(shadow)
+            stats.dirty += shadow->dirty.count();
+    }
+
+    return stats;
+}
+
+void RegisterCache::resetStats()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    this->counters = RegisterCacheStats();
+}
+
+bool RegisterCache::parseRegisters(const QString& text, std::bitset<256>& registers)
+{
+    static const QRegularExpression separators("[\\s,]+");
+
+    registers.reset();
+
+    for(const QString& token : text.split(separators, Qt::SkipEmptyParts)) {
+        qsizetype dash = token.indexOf('-');
+        QString firstText = dash < 0 ? token : token.left(dash);
+        QString lastText = dash < 0 ? token : token.mid(dash + 1);
+        unsigned first, last;
+
+        if(!ByteParser::parseValue(firstText.utf16(), firstText.size(), 0xFF, first) ||
+           !ByteParser::parseValue(lastText.utf16(), lastText.size(), 0xFF, last) || last < first)
+            return false;
+
+        registers |= registerRange(first, last - first + 1);
+    }
+
+    return true;
+}
+
+QString RegisterCache::registersText(const std::bitset<256>& registers)
+{
+    QStringList runs;
+
+    for(unsigned i = 0; i < 256; ++i) {
+        if(!registers[i])
+            continue;
+
+        unsigned first = i;
+        while(i + 1 < 256 && registers[i + 1])
+            ++i;
+
+        QString text = "0x" + QString::number(first, 16).rightJustified(2, '0').toUpper();
+        if(i != first)
+            text += "-0x" + QString::number(i, 16).rightJustified(2, '0').toUpper();
+
+        runs.append(text);
+    }
+
+    return runs.join(" ");
+}
@@ -0,0 +1,110 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef REGISTERCACHE_H
+#define REGISTERCACHE_H
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <QString>
+
+#include "ch341stream.h"
+
+struct RegisterCacheStats {
+    std::size_t hits = 0;               // Reads served from the shadow
+    std::size_t misses = 0;             // Reads of cached registers that had to go to the bus
+    std::size_t deferred = 0;           // Writes held back until a flush
+    std::size_t coalesced = 0;          // Deferred register values overwritten before they were flushed
+    std::size_t flushed = 0;            // Writes sent to flush deferred registers
+    std::size_t bytesSaved = 0;         // Bus bytes of the served reads and deferred writes
+    std::size_t bytesFlushed = 0;       // Bus bytes the flushes spent
+    std::size_t dirty = 0;              // Registers waiting for a flush
+
+    double hitRate() const { return this->hits + this->misses ? (double)this->hits / (this->hits + this->misses) : 0; }
+};
+
+// Shadow copies of the registers of register file devices (the first written
+// byte selects the register, further bytes access the following ones).
+// Transactions are classified by shape: a single register byte followed by a
+// read is a register read, a register byte followed by data is a register
+// write; anything else passes through and only makes the registers it may
+// have changed unknown.
+class RegisterCache
+{
+public:
+    struct Device {
+        unsigned char address = 0;      // 7 bit
+        std::bitset<256> cached;        // Registers reads may be served from the shadow
+        std::bitset<256> volatiles;     // Always read from the bus, even if also cached
+        bool writeBack = false;         // Hold writes to cached registers until a flush
+    };
+
+    static constexpr std::size_t fromCache = (std::size_t)-1;
+
+    // Thread safe. Replaces the configuration and drops every shadow, unflushed writes included.
+    void configure(const std::vector<Device>& devices);
+    std::vector<Device> configuration() const;
+    bool isEnabled() const { return this->enabled.load(std::memory_order_relaxed); }
+
+    // Thread safe. Serves what it can of transactions from the shadows and
+    // returns the rest, in order, to be run on the bus. Deferred writes of a
+    // device are flushed (put in front) before anything else reaches it.
+    // origin[i] is the index in transactions of bus transaction i, or
+    // fromCache for a flush write. results gets an entry per transaction,
+    // served ones filled in with batched == 0 as they never ran.
+    std::vector<I2CTransaction> plan(const std::vector<I2CTransaction>& transactions, std::vector<I2CResult>& results,
+                                     std::vector<std::size_t>& origin, std::size_t* served = nullptr);
+    // Updates the shadows with the outcome of the planned bus transactions
+    void complete(const std::vector<I2CTransaction>& bus, const std::vector<std::size_t>& origin,
+                  const std::vector<I2CResult>& results);
+
+    // Every deferred write (of one device, or all if address is negative), ready to go through complete()
+    std::vector<I2CTransaction> flush(std::vector<std::size_t>& origin, int address = -1);
+    // Forgets the shadow of one device (or all if address is negative). Returns the unflushed writes dropped.
+    std::size_t invalidate(int address = -1);
+    // Forgets the registers a transaction that bypassed the cache may have changed
+    void forget(const I2CTransaction& transaction);
+
+    RegisterCacheStats stats() const;
+    void resetStats();
+
+    // "0x00-0x1F 0x40", values as in ByteParser
+    static bool parseRegisters(const QString& text, std::bitset<256>& registers);
+    static QString registersText(const std::bitset<256>& registers);
+
+private:
+    struct Shadow {
+        Device config;
+        std::bitset<256> cacheable;     // Cached and not volatile
+        std::bitset<256> valid, dirty;
+        std::array<unsigned char, 256> values{};
+        unsigned long speedMode = 1;    // Of the last deferred write, flushes use it
+    };
+
+    mutable std::mutex lock;
+    std::array<std::unique_ptr<Shadow>, 128> shadows;
+    std::atomic<bool> enabled{false};
+    RegisterCacheStats counters;
+
+    void flushDevice(Shadow& shadow, std::vector<I2CTransaction>& bus, std::vector<std::size_t>& origin);
+};
+
+#endif // REGISTERCACHE_H
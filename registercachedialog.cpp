@@ -0,0 +1,236 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "registercachedialog.h"
+#include "ui_registercachedialog.h"
+
+#include <cstdlib>
+#include <QDebug>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QTableWidgetItem>
+
+#include "byteparser.h"
+
+namespace {
+
+const int refreshInterval = 500; // Milliseconds
+
+QString bytesText(std::size_t bytes)
+{
+    return bytes >= 1024 ? QString::number(bytes / 1024.0, 'f', 1) + " KiB" : QString::number(bytes) + " B";
+}
+
+}
+
+RegisterCacheDialog::RegisterCacheDialog(DeviceWorker* worker, std::shared_ptr<RegisterCache> cache, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::RegisterCacheDialog),
+    worker(worker),
+    cache(std::move(cache))
+{
+    ui->setupUi(this);
+    this->setWindowTitle("Register Cache");
+
+    ui->devicesTableWidget->setColumnCount(ColumnCount);
+    ui->devicesTableWidget->setHorizontalHeaderLabels({ "Address", "Cached Registers", "Volatile Registers", "Write Back" });
+    ui->devicesTableWidget->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    ui->devicesTableWidget->horizontalHeader()->setSectionResizeMode(CachedColumn, QHeaderView::Stretch);
+    ui->devicesTableWidget->horizontalHeader()->setSectionResizeMode(VolatileColumn, QHeaderView::Stretch);
+    ui->devicesTableWidget->verticalHeader()->setVisible(false);
+
+    for(const RegisterCache::Device& device : this->cache->configuration())
+        this->addRow(device);
+
+    this->refreshTimer.setInterval(refreshInterval);
+    connect(&this->refreshTimer, &QTimer::timeout, this, &RegisterCacheDialog::refresh);
+    connect(this->worker, &DeviceWorker::finished, this, &RegisterCacheDialog::onDeviceResult);
+}
+
+RegisterCacheDialog::~RegisterCacheDialog()
+{
+    delete ui;
+}
+
+void RegisterCacheDialog::showEvent(QShowEvent* event)
+{
+    QDialog::showEvent(event);
+
+    this->refresh();
+    this->refreshTimer.start();
+}
+
+void RegisterCacheDialog::hideEvent(QHideEvent* event)
+{
+    this->refreshTimer.stop();
+
+    QDialog::hideEvent(event);
+}
+
+void RegisterCacheDialog::addRow(const RegisterCache::Device& device)
+{
+    int row = ui->devicesTableWidget->rowCount();
+    ui->devicesTableWidget->setRowCount(row + 1);
+
+    QTableWidgetItem* writeBack = new QTableWidgetItem();
+    writeBack->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsUserCheckable);
+    writeBack->setCheckState(device.writeBack ? Qt::Checked : Qt::Unchecked);
+
+    ui->devicesTableWidget->setItem(row, AddressColumn, new QTableWidgetItem("0x" + QString::number(device.address, 16).rightJustified(2, '0').toUpper()));
+    ui->devicesTableWidget->setItem(row, CachedColumn, new QTableWidgetItem(RegisterCache::registersText(device.cached)));
+    ui->devicesTableWidget->setItem(row, VolatileColumn, new QTableWidgetItem(RegisterCache::registersText(device.volatiles)));
+    ui->devicesTableWidget->setItem(row, WriteBackColumn, writeBack);
+}
+
+void RegisterCacheDialog::on_addButton_clicked()
+{
+    RegisterCache::Device device;
+    device.cached.set();
+
+    this->addRow(device);
+    ui->devicesTableWidget->setCurrentCell(ui->devicesTableWidget->rowCount() - 1, AddressColumn);
+    ui->devicesTableWidget->editItem(ui->devicesTableWidget->currentItem());
+}
+
+void RegisterCacheDialog::on_removeButton_clicked()
+{
+    int row = ui->devicesTableWidget->currentRow();
+
+    if(row >= 0)
+        ui->devicesTableWidget->removeRow(row);
+}
+
+void RegisterCacheDialog::on_resetButton_clicked()
+{
+    this->cache->resetStats();
+    this->refresh();
+}
+
+void RegisterCacheDialog::on_invalidateButton_clicked()
+{
+    std::size_t dropped = this->cache->invalidate();
+
+    if(dropped)
+        qDebug().nospace() << "DROPPED " << dropped << " UNFLUSHED REGISTER WRITE(S)!\n";
+
+    this->refresh();
+}
+
+void RegisterCacheDialog::on_flushButton_clicked()
+{
+    if(this->pendingId) // Still waiting for the last one
+        return;
+
+    DeviceRequest request;
+    request.kind = DeviceRequest::CacheFlush;
+
+    this->pendingId = this->worker->submit(std::move(request));
+
+    if(!this->pendingId) {
+        qDebug() << "Too many queued commands!\n";
+        QMessageBox::warning(this, " ", "Too many queued commands!");
+    }
+}
+
+void RegisterCacheDialog::on_applyButton_clicked()
+{
+    std::vector<RegisterCache::Device> devices;
+
+    // PARSE EVERY ROW BEFORE TOUCHING THE CACHE
+    for(int row = 0; row < ui->devicesTableWidget->rowCount(); ++row) {
+        QString addressText = ui->devicesTableWidget->item(row, AddressColumn)->text();
+        QString cachedText = ui->devicesTableWidget->item(row, CachedColumn)->text();
+        QString volatileText = ui->devicesTableWidget->item(row, VolatileColumn)->text();
+
+        RegisterCache::Device device;
+        unsigned address;
+
+        if(!ByteParser::parseValueTrimmed(addressText.utf16(), addressText.size(), 0x7F, address)) {
+            qDebug().nospace() << "Invalid address on row " << row + 1 << "!\n";
+            QMessageBox::warning(this, " ", "Invalid address on row " + QString::number(row + 1) + "!");
+            return;
+        }
+
+        if(!RegisterCache::parseRegisters(cachedText, device.cached) || !RegisterCache::parseRegisters(volatileText, device.volatiles)) {
+            qDebug().nospace() << "Invalid registers on row " << row + 1 << "!\n";
+            QMessageBox::warning(this, " ", "Invalid registers on row " + QString::number(row + 1) + ", expected e.g. \"0x00-0x1F 0x40\"!");
+            return;
+        }
+
+        for(const RegisterCache::Device& other : devices) {
+            if(other.address == address) {
+                qDebug().nospace() << "Address " << addressText << " is listed twice!\n";
+                QMessageBox::warning(this, " ", "Address \"" + addressText + "\" is listed twice!");
+                return;
+            }
+        }
+
+        device.address = (unsigned char)address;
+        device.writeBack = ui->devicesTableWidget->item(row, WriteBackColumn)->checkState() == Qt::Checked;
+
+        devices.push_back(device);
+    }
+
+    // RECONFIGURING DROPS THE SHADOWS, UNFLUSHED WRITES INCLUDED
+    std::size_t dirty = this->cache->stats().dirty;
+
+    if(dirty && QMessageBox::question(this, " ", QString::number(dirty) + " register write(s) have not been flushed yet and will be dropped, apply anyway?")
+                != QMessageBox::Yes)
+        return;
+
+    this->cache->configure(devices);
+
+    qDebug().nospace() << "REGISTER CACHE: " << devices.size() << " DEVICE(S)\n";
+    this->refresh();
+}
+
+void RegisterCacheDialog::onDeviceResult(const DeviceResult& result)
+{
+    if(result.id != this->pendingId)
+        return;
+
+    this->pendingId = 0;
+
+    if(!result.ok) {
+        if(!result.cancelled) {
+            qDebug().noquote() << result.error + ", please reconnect the CH341 device!\n";
+            QMessageBox::critical(this, " ", result.error + ", please reconnect the CH341 device!");
+        }
+
+        return;
+    }
+
+    qDebug().nospace() << "FLUSHED REGISTER CACHE IN " << result.schedule.transfers << " TRANSFER(S) (" << result.elapsed / 1000 << " us)\n";
+    this->refresh();
+}
+
+void RegisterCacheDialog::refresh()
+{
+    if(!this->cache->isEnabled()) {
+        ui->statusLabel->setText("Register cache off");
+        return;
+    }
+
+    RegisterCacheStats stats = this->cache->stats();
+    long long saved = (long long)stats.bytesSaved - (long long)stats.bytesFlushed;
+
+    ui->statusLabel->setText(QString::number(stats.hits) + " hit(s), " + QString::number(stats.misses) + " miss(es), " +
+                             QString::number(stats.hitRate() * 100, 'f', 1) + "% hit rate, " +
+                             QString::number(stats.deferred) + " write(s) deferred, " + QString::number(stats.coalesced) + " coalesced, " +
+                             QString::number(stats.flushed) + " flushed, " +
+                             (saved < 0 ? "-" : "") + bytesText((std::size_t)std::llabs(saved)) + " of bus traffic saved, " +
+                             QString::number(stats.dirty) + " register(s) waiting for a flush");
+}
@@ -0,0 +1,76 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef REGISTERCACHEDIALOG_H
+#define REGISTERCACHEDIALOG_H
+
+#include <memory>
+#include <QDialog>
+#include <QTimer>
+
+#include "deviceworker.h"
+#include "registercache.h"
+
+namespace Ui {
+class RegisterCacheDialog;
+}
+
+// Chooses the devices and registers the register cache shadows, shows its
+// hit rate and the bus traffic it saved, and flushes or drops what it holds.
+// Refreshes itself while shown.
+class RegisterCacheDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    RegisterCacheDialog(DeviceWorker* worker, std::shared_ptr<RegisterCache> cache, QWidget *parent = nullptr);
+    ~RegisterCacheDialog();
+
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+private slots:
+    void on_addButton_clicked();
+
+    void on_removeButton_clicked();
+
+    void on_resetButton_clicked();
+
+    void on_invalidateButton_clicked();
+
+    void on_flushButton_clicked();
+
+    void on_applyButton_clicked();
+
+    void onDeviceResult(const DeviceResult& result);
+
+    void refresh();
+
+private:
+    enum Column { AddressColumn, CachedColumn, VolatileColumn, WriteBackColumn, ColumnCount };
+
+    Ui::RegisterCacheDialog *ui;
+    DeviceWorker* worker;
+    std::shared_ptr<RegisterCache> cache;
+    QTimer refreshTimer;
+
+    quint64 pendingId = 0;
+
+    void addRow(const RegisterCache::Device& device);
+};
+
+#endif // REGISTERCACHEDIALOG_H
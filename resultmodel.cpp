@@ -0,0 +1,196 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "resultmodel.h"
+
+#include <algorithm>
+
+namespace {
+
+const char hexDigits[] = "0123456789ABCDEF";
+
+}
+
+ResultModel::ResultModel(QObject* parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+int ResultModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : this->rows;
+}
+
+int ResultModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant ResultModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if(role != Qt::DisplayRole || orientation != Qt::Horizontal)
+        return QVariant();
+
+    switch(section) {
+        case LabelColumn:  return "Command";
+        case OffsetColumn: return "Offset";
+        case HexColumn:    return "Hex";
+        case BinaryColumn: return "Binary";
+        case AsciiColumn:  return "ASCII";
+    }
+
+    return QVariant();
+}
+
+QVariant ResultModel::data(const QModelIndex& index, int role) const
+{
+    if(!index.isValid() || index.row() >= this->rows)
+        return QVariant();
+
+    if(role == Qt::DisplayRole)
+        return this->cell(index.row(), index.column());
+
+    return QVariant();
+}
+
+const ResultModel::Segment& ResultModel::segmentAt(int row) const
+{
+    auto it = std::upper_bound(this->segments.begin(), this->segments.end(), row,
+                               [](int row, const Segment& segment) { return row < segment.firstRow; });
+
+    return *(it - 1);
+}
+
+QString ResultModel::cell(int row, int column) const
+{
+    const Segment& segment = this->segmentAt(row);
+
+    std::size_t offset = (std::size_t)(row - segment.firstRow) * bytesPerRow;
+    std::size_t count = std::min<std::size_t>(bytesPerRow, segment.length - std::min(offset, segment.length));
+    const unsigned char* first = this->bytes.data() + segment.begin + offset;
+
+    QString text;
+
+    switch(column) {
+        case LabelColumn:
+            if(row == segment.firstRow)
+                text = segment.acked ? segment.label : segment.label + " (NACK)";
+            break;
+
+        case OffsetColumn:
+            if(count != 0)
+                text = QString::number(segment.baseOffset + offset, 16).toUpper().rightJustified(4, '0');
+            break;
+
+        case HexColumn:
+            text.reserve(count * 3);
+            for(std::size_t i = 0; i < count; ++i) {
+                if(i != 0)
+                    text += ' ';
+
+                text += QChar(hexDigits[first[i] >> 4]);
+                text += QChar(hexDigits[first[i] & 0x0F]);
+            }
+            break;
+
+        case BinaryColumn:
+            text.reserve(count * 9);
+            for(std::size_t i = 0; i < count; ++i) {
+                if(i != 0)
+                    text += ' ';
+
+                for(int bit = 7; bit >= 0; --bit)
+                    text += QChar('0' + ((first[i] >> bit) & 1));
+            }
+            break;
+
+        case AsciiColumn:
+            text.reserve(count);
+            for(std::size_t i = 0; i < count; ++i)
+                text += QChar(first[i] >= 0x20 && first[i] < 0x7F ? (char)first[i] : '.');
+            break;
+    }
+
+    return text;
+}
+
+void ResultModel::clear()
+{
+    this->beginResetModel();
+
+    this->bytes.clear();
+    this->segments.clear();
+    this->rows = 0;
+
+    this->endResetModel();
+}
+
+void ResultModel::beginSegment(const QString& label, bool acked, std::size_t baseOffset)
+{
+    this->beginInsertRows(QModelIndex(), this->rows, this->rows);
+
+    this->segments.push_back({ label, acked, baseOffset, this->bytes.size(), 0, this->rows });
+    ++this->rows;
+
+    this->endInsertRows();
+}
+
+void ResultModel::append(const unsigned char* data, std::size_t length)
+{
+    if(length == 0)
+        return;
+
+    if(this->segments.empty())
+        this->beginSegment(QString());
+
+    Segment& segment = this->segments.back();
+    int oldRows = rowsFor(segment.length);
+    int newRows = rowsFor(segment.length + length);
+
+    bool partialRow = segment.length % bytesPerRow != 0 || segment.length == 0;
+    int lastRow = segment.firstRow + oldRows - 1;
+
+    if(newRows > oldRows)
+        this->beginInsertRows(QModelIndex(), this->rows, this->rows + newRows - oldRows - 1);
+
+    this->bytes.insert(this->bytes.end(), data, data + length);
+    segment.length += length;
+    this->rows += newRows - oldRows;
+
+    if(newRows > oldRows)
+        this->endInsertRows();
+
+    if(partialRow)
+        emit dataChanged(this->index(lastRow, 0), this->index(lastRow, ColumnCount - 1));
+}
+
+QString ResultModel::text(int firstRow, int lastRow, int firstColumn, int lastColumn) const
+{
+    QString text;
+
+    for(int row = std::max(firstRow, 0); row <= std::min(lastRow, this->rows - 1); ++row) {
+        for(int column = firstColumn; column <= lastColumn; ++column) {
+            if(column != firstColumn)
+                text += '\t';
+
+            text += this->cell(row, column);
+        }
+
+        text += '\n';
+    }
+
+    return text;
+}
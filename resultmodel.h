@@ -0,0 +1,73 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RESULTMODEL_H
+#define RESULTMODEL_H
+
+#include <cstddef>
+#include <vector>
+#include <QAbstractTableModel>
+
+// Read data shown as rows of bytesPerRow bytes. Views only ask for the rows
+// they show, so nothing is formatted ahead of time no matter how large the
+// data gets. The data is split into segments (one per command of a batch,
+// one per memory dump, ...) that each start on a new row.
+class ResultModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column { LabelColumn, OffsetColumn, HexColumn, BinaryColumn, AsciiColumn, ColumnCount };
+
+    static const int bytesPerRow = 8;
+
+    explicit ResultModel(QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    void clear();
+    // Starts a new segment, offsets shown for it count from baseOffset
+    void beginSegment(const QString& label, bool acked = true, std::size_t baseOffset = 0);
+    // Appends to the last segment, starting one if there is none
+    void append(const unsigned char* data, std::size_t length);
+
+    std::size_t byteCount() const { return this->bytes.size(); }
+
+    // Tab separated text of a block of cells, built only for those rows
+    QString text(int firstRow, int lastRow, int firstColumn, int lastColumn) const;
+
+private:
+    struct Segment {
+        QString label;
+        bool acked;
+        std::size_t baseOffset;
+        std::size_t begin, length;      // Into bytes
+        int firstRow;
+    };
+
+    std::vector<unsigned char> bytes;
+    std::vector<Segment> segments;
+    int rows = 0;
+
+    static int rowsFor(std::size_t length) { return length == 0 ? 1 : (int)((length + bytesPerRow - 1) / bytesPerRow); }
+    const Segment& segmentAt(int row) const;
+    QString cell(int row, int column) const;
+};
+
+#endif // RESULTMODEL_H
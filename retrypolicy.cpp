@@ -0,0 +1,211 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "retrypolicy.h"
+
+#include <algorithm>
+#include <thread>
+#include <QRegularExpression>
+#include <QStringList>
+
+#include "i2ctransport.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const std::chrono::microseconds sleepSlice(10000); // Between cancellation checks
+
+// "250us", "5ms" or "2s", as in sequences
+bool timeValue(const QString& text, std::chrono::microseconds& time)
+{
+    static const QRegularExpression pattern("^(\\d+)(us|ms|s)$", QRegularExpression::CaseInsensitiveOption);
+    QRegularExpressionMatch match = pattern.match(text);
+
+    if(!match.hasMatch())
+        return false;
+
+    QString unit = match.captured(2).toLower();
+    unsigned long long scale = unit == "us" ? 1 : unit == "ms" ? 1000 : 1000000;
+
+    bool ok = false;
+    unsigned long long value = match.captured(1).toULongLong(&ok, 10);
+
+    if(!ok || value > 0xFFFFFFFFULL / scale)
+        return false;
+
+    time = std::chrono::microseconds(value * scale);
+
+    return true;
+}
+
+QString timeText(std::chrono::microseconds time)
+{
+    long long value = time.count();
+
+    if(value != 0 && value % 1000000 == 0)
+        return QString::number(value / 1000000) + "s";
+    if(value != 0 && value % 1000 == 0)
+        return QString::number(value / 1000) + "ms";
+
+    return QString::number(value) + "us";
+}
+
+bool fail(QString* error, const QString& message)
+{
+    if(error)
+        *error = message;
+
+    return false;
+}
+
+}
+
+bool RetryPolicy::parse(const QString& text, RetryPolicy& policy, QString* error)
+{
+    QStringList tokens = text.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+    RetryPolicy parsed;
+
+    if(tokens.isEmpty()) {
+        policy = parsed;
+        return true;
+    }
+
+    QString keyword = tokens.takeFirst().toLower();
+
+    if(keyword == "poll")
+        parsed.mode = Poll;
+    else if(keyword == "backoff") {
+        parsed.mode = Backoff;
+
+        QStringList delays = tokens.isEmpty() ? QStringList() : tokens.takeFirst().split('-');
+
+        if(delays.isEmpty() || delays.size() > 2 || !timeValue(delays.front(), parsed.delay) ||
+           !timeValue(delays.back(), parsed.maxDelay) || parsed.delay.count() == 0 || parsed.maxDelay < parsed.delay)
+            return fail(error, "Expected the delay after \"backoff\", e.g. 200us or 200us-5ms");
+    }
+    else
+        return fail(error, "Expected \"poll\" or \"backoff\" (" + keyword + ")");
+
+    for(const QString& token : tokens) {
+        if(token.startsWith("x", Qt::CaseInsensitive)) {
+            bool ok = false;
+            parsed.attempts = token.mid(1).toUInt(&ok, 10);
+
+            if(!ok || parsed.attempts == 0 || parsed.attempts > 0xFFFF)
+                return fail(error, "Invalid attempt count (" + token + ")");
+        }
+        else if(!timeValue(token, parsed.limit) || parsed.limit.count() == 0)
+            return fail(error, "Invalid limit (" + token + "), expected e.g. x10 or 50ms");
+    }
+
+    if(parsed.attempts == 0 && parsed.limit.count() == 0)
+        return fail(error, "Retrying needs a limit, an attempt count (e.g. x10) and/or a time (e.g. 50ms)");
+
+    policy = parsed;
+
+    return true;
+}
+
+QString RetryPolicy::text() const
+{
+    if(this->mode == Off)
+        return QString();
+
+    QString text = this->mode == Poll ? "poll" : "backoff " + timeText(this->delay);
+
+    if(this->mode == Backoff && this->maxDelay != this->delay)
+        text += "-" + timeText(this->maxDelay);
+    if(this->attempts != 0)
+        text += " x" + QString::number(this->attempts);
+    if(this->limit.count() != 0)
+        text += " " + timeText(this->limit);
+
+    return text;
+}
+
+bool RetryPolicy::operator==(const RetryPolicy& other) const
+{
+    return this->mode == other.mode && this->attempts == other.attempts && this->limit == other.limit &&
+           this->delay == other.delay && this->maxDelay == other.maxDelay;
+}
+
+bool RetryPolicy::run(I2CTransport* transport, const I2CTransaction& transaction, const Attempt& attempt, I2CResult& result,
+                      const Cancelled& cancelled) const
+{
+    bool ok = attempt(result);
+    result.retries = 0;
+    result.waited = 0;
+
+    if(!ok || result.acked || this->mode == Off)
+        return ok;
+
+    Clock::time_point nacked = Clock::now();
+    Clock::time_point deadline = this->limit.count() != 0 ? nacked + this->limit : Clock::time_point::max();
+    Clock::time_point started = nacked;
+
+    // Only the address byte, so a busy target costs as little bus time as possible
+    I2CTransaction probe = { transaction.address, {}, 0, transaction.speedMode };
+    I2CResult polled;
+
+    std::chrono::microseconds delay = this->delay;
+    std::size_t retries = 0;
+
+    for(unsigned round = 0; this->attempts == 0 || round < this->attempts; ++round) {
+        if(cancelled && cancelled())
+            break;
+
+        if(this->mode == Backoff) {
+            Clock::time_point until = std::min(Clock::now() + delay, deadline);
+
+            while(Clock::now() < until && !(cancelled && cancelled()))
+                std::this_thread::sleep_for(std::min<Clock::duration>(until - Clock::now(), sleepSlice));
+
+            delay = std::min(delay * 2, this->maxDelay);
+        }
+
+        if(Clock::now() >= deadline)
+            break;
+
+        if(this->mode == Poll) {
+            ++retries;
+
+            if(!transport->runTransaction(probe, polled)) {
+                ok = false;
+                break;
+            }
+
+            if(!polled.acked)
+                continue;
+        }
+
+        ++retries;
+        started = Clock::now();
+
+        if(!attempt(result)) {
+            ok = false;
+            break;
+        }
+
+        if(result.acked)
+            break;
+    }
+
+    result.retries = retries;
+    result.waited = std::chrono::duration_cast<std::chrono::nanoseconds>(started - nacked).count();
+
+    return ok;
+}
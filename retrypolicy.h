@@ -0,0 +1,66 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef RETRYPOLICY_H
+#define RETRYPOLICY_H
+
+#include <chrono>
+#include <functional>
+#include <QString>
+
+#include "ch341stream.h"
+
+class I2CTransport;
+
+// What to do when a command is not acknowledged, e.g. by an EEPROM busy with
+// its write cycle. Only NACKs are retried, a failed USB transfer never is.
+struct RetryPolicy {
+    enum Mode : unsigned char {
+        Off,
+        Poll,                                   // ACK polling: probes the address right away until it is acknowledged, then runs the command again
+        Backoff                                 // Runs the command again after delay, doubling it every time up to maxDelay
+    };
+
+    Mode mode = Off;
+    unsigned attempts = 0;                      // Polls or retries at most (up to 65535), 0 = limited by time only
+    std::chrono::microseconds limit{0};         // Gives up this long after the first NACK, 0 = limited by attempts only
+    std::chrono::microseconds delay{0};         // Backoff only
+    std::chrono::microseconds maxDelay{0};
+
+    bool isEnabled() const { return this->mode != Off; }
+
+    // "poll" or "backoff DELAY[-MAXDELAY]" followed by the limits, "xCOUNT"
+    // and/or a time, e.g. "poll 10ms" or "backoff 200us-5ms x8 100ms". Times
+    // are written as in sequences (us, ms or s). Empty text turns retrying off.
+    static bool parse(const QString& text, RetryPolicy& policy, QString* error = nullptr);
+    QString text() const;
+
+    bool operator==(const RetryPolicy& other) const;
+    bool operator!=(const RetryPolicy& other) const { return !(*this == other); }
+
+    // Runs the command, false for a failed USB transfer
+    using Attempt = std::function<bool(I2CResult& result)>;
+    // Polled between attempts, return true to give up
+    using Cancelled = std::function<bool()>;
+
+    // Runs attempt until result is acknowledged or the policy gives up, ACK
+    // polls go through transport. Returns false only if a USB transfer failed.
+    // result.retries and result.waited tell how long the target kept it waiting.
+    bool run(I2CTransport* transport, const I2CTransaction& transaction, const Attempt& attempt, I2CResult& result,
+             const Cancelled& cancelled = Cancelled()) const;
+};
+
+#endif // RETRYPOLICY_H
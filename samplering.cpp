@@ -0,0 +1,81 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "samplering.h"
+
+#include <algorithm>
+
+SampleRing::SampleRing(std::size_t sampleLength, std::size_t capacity)
+    : length(sampleLength)
+    , timestamps(std::max<std::size_t>(capacity, 2))
+    , acks(timestamps.size())
+    , data(timestamps.size() * sampleLength)
+    , staging(sampleLength)
+{
+}
+
+std::size_t SampleRing::capacityFor(std::size_t sampleLength, std::size_t byteBudget)
+{
+    return std::max<std::size_t>(byteBudget / (sampleLength + sizeof(std::int64_t) + 1), 2);
+}
+
+void SampleRing::commit(std::int64_t timestamp, bool acked)
+{
+    std::uint64_t index = this->count.load(std::memory_order_relaxed);
+    std::size_t slot = this->slot(index);
+    std::atomic<unsigned char>* first = this->data.data() + slot * this->length;
+
+    for(std::size_t i = 0; i < this->length; ++i)
+        first[i].store(this->staging[i], std::memory_order_relaxed);
+
+    this->timestamps[slot].store(timestamp, std::memory_order_relaxed);
+    this->acks[slot].store(acked, std::memory_order_relaxed);
+    this->count.store(index + 1, std::memory_order_release);
+
+    // The next commit overwrites the slot of the sample that just fell out of oldest(). A reader
+    // seeing any of those stores through its acquire fence also sees this count.
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+std::uint64_t SampleRing::oldest() const
+{
+    std::uint64_t written = this->written();
+
+    // The slot after the newest sample may be getting overwritten right now
+    return written < this->capacity() ? 0 : written - this->capacity() + 1;
+}
+
+bool SampleRing::read(std::uint64_t index, Sample& sample) const
+{
+    if(index >= this->written() || index < this->oldest())
+        return false;
+
+    std::size_t slot = this->slot(index);
+    const std::atomic<unsigned char>* first = this->data.data() + slot * this->length;
+
+    sample.index = index;
+    sample.timestamp = this->timestamps[slot].load(std::memory_order_relaxed);
+    sample.acked = this->acks[slot].load(std::memory_order_relaxed);
+    sample.data.resize(this->length);
+
+    for(std::size_t i = 0; i < this->length; ++i)
+        sample.data[i] = first[i].load(std::memory_order_relaxed);
+
+    // Throw the copy away if the producer lapped us while copying
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    return index >= this->oldest();
+}
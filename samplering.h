@@ -0,0 +1,71 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed size capture buffer for one producer thread (the poller) and any
+// number of readers. Every slot is allocated up front, once full the oldest
+// sample is overwritten, so a capture can run indefinitely in constant memory.
+// Slots are read and written through relaxed atomics (a seqlock on count), so
+// a reader racing the producer gets a torn copy it throws away, never a data race.
+class SampleRing
+{
+public:
+    struct Sample {
+        std::uint64_t index = 0;
+        std::int64_t timestamp = 0;     // Nanoseconds since the capture started
+        bool acked = false;
+        std::vector<unsigned char> data;
+    };
+
+    SampleRing(std::size_t sampleLength, std::size_t capacity);
+
+    // Number of samples that fit into byteBudget bytes of storage
+    static std::size_t capacityFor(std::size_t sampleLength, std::size_t byteBudget);
+
+    std::size_t capacity() const { return this->timestamps.size(); }
+    std::size_t sampleLength() const { return this->length; }
+
+    // Producer only. Fill the returned sampleLength() bytes, then commit.
+    unsigned char* nextData() { return this->staging.data(); }
+    void commit(std::int64_t timestamp, bool acked);
+
+    // Total samples committed so far, the last capacity() of which are still held
+    std::uint64_t written() const { return this->count.load(std::memory_order_acquire); }
+    std::uint64_t oldest() const;
+
+    // Returns false if the sample is not (or no longer) held
+    bool read(std::uint64_t index, Sample& sample) const;
+
+private:
+    std::size_t length;
+    std::vector<std::atomic<std::int64_t>> timestamps;
+    std::vector<std::atomic<unsigned char>> acks;
+    std::vector<std::atomic<unsigned char>> data;
+    std::vector<unsigned char> staging;         // Producer only, the sample being filled
+
+    alignas(64) std::atomic<std::uint64_t> count{0};
+
+    std::size_t slot(std::uint64_t index) const { return index % this->timestamps.size(); }
+};
+
+#endif // SAMPLERING_H
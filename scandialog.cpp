@@ -0,0 +1,180 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "scandialog.h"
+#include "ui_scandialog.h"
+
+#include <QBrush>
+#include <QColor>
+#include <QDebug>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QTableWidgetItem>
+
+namespace {
+
+// 0000xxx and 1111xxx are reserved (general call, CBUS, high speed, 10 bit addressing, ...)
+const unsigned char firstAddress = 0x08;
+const unsigned char lastAddress = 0x77;
+
+}
+
+ScanDialog::ScanDialog(DeviceWorker* worker, unsigned long speedMode, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::ScanDialog),
+    worker(worker),
+    speedMode(speedMode)
+{
+    ui->setupUi(this);
+    this->setWindowTitle("Scan Bus");
+
+    // 8 x 16 GRID, ROW = HIGH 3 BITS, COLUMN = LOW 4 BITS
+    ui->gridTableWidget->setRowCount(8);
+    ui->gridTableWidget->setColumnCount(16);
+
+    QStringList rows, columns;
+    for(int row = 0; row < 8; ++row)
+        rows.append(QString::number(row, 2).rightJustified(3, '0'));
+    for(int column = 0; column < 16; ++column)
+        columns.append(QString::number(column, 2).rightJustified(4, '0'));
+
+    ui->gridTableWidget->setVerticalHeaderLabels(rows);
+    ui->gridTableWidget->setHorizontalHeaderLabels(columns);
+    ui->gridTableWidget->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    ui->gridTableWidget->verticalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+
+    for(int address = 0; address < 128; ++address) {
+        QTableWidgetItem* item = new QTableWidgetItem(address < firstAddress || address > lastAddress ? "" : "--");
+        item->setTextAlignment(Qt::AlignCenter);
+
+        ui->gridTableWidget->setItem(address / 16, address % 16, item);
+    }
+
+    this->repeatTimer.setSingleShot(true);
+    connect(&this->repeatTimer, &QTimer::timeout, this, &ScanDialog::scan);
+    connect(this->worker, &DeviceWorker::finished, this, &ScanDialog::onDeviceResult);
+}
+
+ScanDialog::~ScanDialog()
+{
+    delete ui;
+}
+
+std::vector<I2CTransaction> ScanDialog::probes(bool read, unsigned long speedMode)
+{
+    std::vector<I2CTransaction> transactions;
+    transactions.reserve(lastAddress - firstAddress + 1);
+
+    // An empty write is just START, address, STOP. A read has to take (and
+    // NACK) one byte to end the transfer.
+    for(unsigned char address = firstAddress; address <= lastAddress; ++address)
+        transactions.push_back({ address, {}, read ? 1U : 0U, speedMode });
+
+    return transactions;
+}
+
+void ScanDialog::on_scanButton_clicked()
+{
+    this->scan();
+}
+
+void ScanDialog::on_repeatCheckBox_toggled(bool checked)
+{
+    if(checked)
+        this->scan();
+    else
+        this->repeatTimer.stop();
+}
+
+void ScanDialog::scan()
+{
+    if(this->pendingId) // Still waiting for the last one
+        return;
+
+    DeviceRequest request;
+    request.kind = DeviceRequest::Scan;
+    request.transactions = ScanDialog::probes(ui->readCheckBox->isChecked(), this->speedMode);
+
+    this->pendingId = this->worker->submit(std::move(request));
+
+    if(!this->pendingId) {
+        qDebug() << "Too many queued commands!\n";
+        QMessageBox::warning(this, " ", "Too many queued commands!");
+        ui->repeatCheckBox->setChecked(false);
+    }
+}
+
+void ScanDialog::onDeviceResult(const DeviceResult& result)
+{
+    if(result.id != this->pendingId)
+        return;
+
+    this->pendingId = 0;
+
+    if(!result.ok) {
+        ui->repeatCheckBox->setChecked(false);
+
+        if(!result.cancelled) {
+            qDebug().noquote() << result.error + ", please reconnect the CH341 device!\n";
+            QMessageBox::critical(this, " ", result.error + ", please reconnect the CH341 device!");
+        }
+
+        return;
+    }
+
+    // UPDATE GRID
+    std::bitset<128> present;
+    for(std::size_t i = 0; i < result.results.size(); ++i)
+        present[firstAddress + i] = result.results[i].acked;
+
+    QStringList appeared, disappeared;
+
+    for(int address = firstAddress; address <= lastAddress; ++address) {
+        QTableWidgetItem* item = ui->gridTableWidget->item(address / 16, address % 16);
+        QString name = QString::number(address, 2).rightJustified(7, '0');
+        bool changed = this->scans != 0 && present[address] != this->present[address];
+
+        item->setText(present[address] ? name : "--");
+
+        if(changed && present[address]) {
+            item->setBackground(QBrush(QColor(Qt::green)));
+            appeared.append(name);
+        }
+        else if(changed) {
+            item->setBackground(QBrush(QColor(Qt::red)));
+            disappeared.append(name);
+        }
+        else
+            item->setBackground(QBrush());
+    }
+
+    this->present = present;
+    ++this->scans;
+
+    QString status = QString::number(present.count()) + " device(s) in " + QString::number(result.elapsed / 1000000.0, 'f', 2) +
+                     " ms (" + QString::number(result.schedule.transfers) + " transfer(s), scan #" + QString::number(this->scans) + ")";
+
+    if(!appeared.isEmpty())
+        status += ", appeared: " + appeared.join(" ");
+    if(!disappeared.isEmpty())
+        status += ", disappeared: " + disappeared.join(" ");
+
+    ui->statusLabel->setText(status);
+    qDebug().noquote() << "SCAN:" << status;
+
+    if(ui->repeatCheckBox->isChecked())
+        this->repeatTimer.start(ui->intervalSpinBox->value());
+}
@@ -0,0 +1,64 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SCANDIALOG_H
+#define SCANDIALOG_H
+
+#include <bitset>
+#include <QDialog>
+#include <QTimer>
+
+#include "deviceworker.h"
+
+namespace Ui {
+class ScanDialog;
+}
+
+// Probes every non reserved 7 bit address in a single batch and shows the
+// responding ones in an i2cdetect style grid. Addresses that appeared or
+// disappeared since the previous scan are highlighted.
+class ScanDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    ScanDialog(DeviceWorker* worker, unsigned long speedMode, QWidget *parent = nullptr);
+    ~ScanDialog();
+
+    // One probe per address from 0001000 to 1110111
+    static std::vector<I2CTransaction> probes(bool read, unsigned long speedMode);
+
+private slots:
+    void on_scanButton_clicked();
+
+    void on_repeatCheckBox_toggled(bool checked);
+
+    void onDeviceResult(const DeviceResult& result);
+
+private:
+    Ui::ScanDialog *ui;
+    DeviceWorker* worker;
+    unsigned long speedMode;
+
+    quint64 pendingId = 0;
+    quint64 scans = 0;
+    std::bitset<128> present;
+    QTimer repeatTimer;
+
+    void scan();
+};
+
+#endif // SCANDIALOG_H
@@ -0,0 +1,231 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "sequencedialog.h"
+#include "ui_sequencedialog.h"
+
+#include <memory>
+#include <QDebug>
+#include <QFontDatabase>
+#include <QInputDialog>
+#include <QMessageBox>
+#include <QSignalBlocker>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTextCursor>
+
+#include "commandmodel.h"
+
+SequenceDialog::SequenceDialog(DeviceWorker* worker, const CommandModel* commands, Sequences::Map* sequences, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::SequenceDialog),
+    worker(worker),
+    commands(commands),
+    sequences(sequences)
+{
+    ui->setupUi(this);
+    this->setWindowTitle("Sequences");
+
+    ui->sourceTextEdit->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+
+    this->showSequences(this->sequences->empty() ? QString() : this->sequences->begin()->first);
+    this->setRunning(false);
+
+    connect(this->worker, &DeviceWorker::finished, this, &SequenceDialog::onDeviceResult);
+}
+
+SequenceDialog::~SequenceDialog()
+{
+    delete ui;
+}
+
+void SequenceDialog::showSequences(const QString& current) {          // HELPER FUNCTION, LISTS THE SEQUENCES AND SELECTS current
+    {
+        QSignalBlocker blocker(ui->sequencesListWidget);
+        ui->sequencesListWidget->clear();
+
+        for(const std::pair<const QString, QString>& sequence : *this->sequences)
+            ui->sequencesListWidget->addItem(sequence.first);
+    }
+
+    QList<QListWidgetItem*> items = ui->sequencesListWidget->findItems(current, Qt::MatchExactly);
+
+    if(!items.isEmpty())
+        ui->sequencesListWidget->setCurrentItem(items.front());
+
+    this->on_sequencesListWidget_currentTextChanged(items.isEmpty() ? QString() : current);
+}
+
+void SequenceDialog::on_sequencesListWidget_currentTextChanged(const QString& name)
+{
+    auto it = this->sequences->find(name);
+    bool selected = !name.isEmpty() && it != this->sequences->end();
+
+    {
+        QSignalBlocker blocker(ui->sourceTextEdit); // Showing a sequence is not an edit
+        ui->sourceTextEdit->setPlainText(selected ? it->second : QString());
+    }
+
+    ui->sourceTextEdit->setEnabled(selected);
+    ui->deleteButton->setEnabled(selected);
+    ui->checkButton->setEnabled(selected);
+    ui->runButton->setEnabled(selected && !this->pendingId);
+}
+
+void SequenceDialog::on_sourceTextEdit_textChanged()
+{
+    QListWidgetItem* item = ui->sequencesListWidget->currentItem();
+
+    if(!item)
+        return;
+
+    (*this->sequences)[item->text()] = ui->sourceTextEdit->toPlainText();
+    this->modified = true;
+}
+
+void SequenceDialog::on_newButton_clicked()                            // NEW BUTTON
+{
+    QString name = QInputDialog::getText(this, " ", "Sequence name:").trimmed();
+
+    if(name.isEmpty())
+        return;
+
+    if(name.contains('\n') || name.contains('\r')) {
+        qDebug() << "Sequence names are a single line!\n";
+        QMessageBox::warning(this, " ", "Sequence names are a single line!");
+        return;
+    }
+
+    if(this->sequences->count(name)) {
+        qDebug().nospace() << "Sequence " << name << " already exists!\n";
+        QMessageBox::warning(this, " ", "Sequence \"" + name + "\" already exists!");
+        return;
+    }
+
+    (*this->sequences)[name] = QString();
+    this->modified = true;
+
+    this->showSequences(name);
+    ui->sourceTextEdit->setFocus();
+}
+
+void SequenceDialog::on_deleteButton_clicked()                         // DELETE BUTTON
+{
+    QListWidgetItem* item = ui->sequencesListWidget->currentItem();
+
+    if(!item)
+        return;
+
+    QString name = item->text();
+
+    if(QMessageBox::warning(this, " ", "Delete sequence \"" + name + "\"?", QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::No)
+        return;
+
+    this->sequences->erase(name);
+    this->modified = true;
+
+    this->showSequences(this->sequences->empty() ? QString() : this->sequences->begin()->first);
+
+    qDebug().nospace() << "DELETED SEQUENCE " << name << "!\n";
+}
+
+bool SequenceDialog::compile(SequenceProgram& program) {                // HELPER FUNCTION, COMPILES THE SHOWN SEQUENCE
+    Sequences::Error error;
+
+    if(Sequences::compile(ui->sourceTextEdit->toPlainText(), *this->commands, program, &error)) {
+        ui->statusLabel->setText("Compiled to " + QString::number(program.code.size()) + " bytes of bytecode, " +
+                                 QString::number(program.transactions.size()) + " read(s)/write(s)");
+        return true;
+    }
+
+    QString message = error.line ? "Line " + QString::number(error.line) + ": " + error.message : error.message;
+    ui->statusLabel->setText(message);
+    qDebug().noquote() << "SEQUENCE ERROR:" << message;
+
+    // PUT THE CURSOR ON THE OFFENDING LINE
+    if(error.line) {
+        QTextCursor cursor(ui->sourceTextEdit->document()->findBlockByNumber(error.line - 1));
+        ui->sourceTextEdit->setTextCursor(cursor);
+        ui->sourceTextEdit->setFocus();
+    }
+
+    return false;
+}
+
+void SequenceDialog::on_checkButton_clicked()                          // CHECK BUTTON
+{
+    SequenceProgram program;
+    this->compile(program);
+}
+
+void SequenceDialog::on_cancelButton_clicked()                         // CANCEL BUTTON
+{
+    this->worker->cancelPending();
+}
+
+void SequenceDialog::on_runButton_clicked()                            // RUN BUTTON
+{
+    std::shared_ptr<SequenceProgram> program = std::make_shared<SequenceProgram>();
+
+    if(!this->compile(*program)) {
+        QMessageBox::warning(this, " ", ui->statusLabel->text());
+        return;
+    }
+
+    DeviceRequest request;
+    request.kind = DeviceRequest::Sequence;
+    request.sequence = std::move(program);
+
+    qDebug().nospace() << "RUNNING SEQUENCE " << ui->sequencesListWidget->currentItem()->text();
+
+    this->pendingId = this->worker->submit(std::move(request));
+
+    if(!this->pendingId) {
+        qDebug() << "Too many queued commands!\n";
+        QMessageBox::warning(this, " ", "Too many queued commands!");
+        return;
+    }
+
+    ui->statusLabel->setText("Running...");
+    this->setRunning(true);
+}
+
+void SequenceDialog::onDeviceResult(const DeviceResult& result)
+{
+    if(result.id != this->pendingId)
+        return;
+
+    this->pendingId = 0;
+    this->setRunning(false);
+
+    const SequenceReport& report = result.sequence;
+    QString summary = QString::number(report.transactions) + " read(s)/write(s), " + QString::number(report.retries) + " retries, " +
+                      (report.commandRetries ? QString::number(report.commandRetries) + " command retries, " : QString()) +
+                      QString::number(report.nacks) + " NACK(s), " + QString::number(report.steps) + " steps in " +
+                      QString::number(report.elapsed.count() / 1000000.0, 'f', 2) + " ms";
+
+    if(result.cancelled)
+        ui->statusLabel->setText("Cancelled after " + summary);
+    else if(!result.ok)
+        ui->statusLabel->setText(result.error + " after " + summary);
+    else
+        ui->statusLabel->setText("Ran " + summary);
+}
+
+void SequenceDialog::setRunning(bool running) {                         // HELPER FUNCTION
+    ui->runButton->setEnabled(!running && ui->sequencesListWidget->currentItem());
+    ui->cancelButton->setEnabled(running);
+}
@@ -0,0 +1,75 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SEQUENCEDIALOG_H
+#define SEQUENCEDIALOG_H
+
+#include <QDialog>
+
+#include "deviceworker.h"
+#include "sequences.h"
+
+class CommandModel;
+
+namespace Ui {
+class SequenceDialog;
+}
+
+// Edits the sequences of the open library in place and runs them on the
+// device thread. Read data and failures show up in the main window.
+class SequenceDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    SequenceDialog(DeviceWorker* worker, const CommandModel* commands, Sequences::Map* sequences, QWidget *parent = nullptr);
+    ~SequenceDialog();
+
+    // Whether any sequence was added, edited or deleted
+    bool changed() const { return this->modified; }
+
+private slots:
+    void on_sequencesListWidget_currentTextChanged(const QString& name);
+
+    void on_sourceTextEdit_textChanged();
+
+    void on_newButton_clicked();
+
+    void on_deleteButton_clicked();
+
+    void on_checkButton_clicked();
+
+    void on_cancelButton_clicked();
+
+    void on_runButton_clicked();
+
+    void onDeviceResult(const DeviceResult& result);
+
+private:
+    Ui::SequenceDialog *ui;
+    DeviceWorker* worker;
+    const CommandModel* commands;
+    Sequences::Map* sequences;
+    bool modified = false;
+
+    quint64 pendingId = 0;
+
+    void showSequences(const QString& current);
+    bool compile(SequenceProgram& program);
+    void setRunning(bool running);
+};
+
+#endif // SEQUENCEDIALOG_H
@@ -0,0 +1,259 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "sequencerunner.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "i2ctransport.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Sleeps are only as fine as the OS timer (up to ~15 ms on Windows), so the
+// last stretch of a delay is spun out
+const std::chrono::microseconds spinTime(2000);
+const std::chrono::microseconds sleepSlice(10000); // Between cancellation checks
+
+inline unsigned operand8(const unsigned char* code) { return code[0]; }
+inline unsigned operand16(const unsigned char* code) { return code[0] | code[1] << 8; }
+inline unsigned long operand32(const unsigned char* code) { return operand16(code) | (unsigned long)operand16(code + 2) << 16; }
+
+}
+
+SequenceRunner::SequenceRunner(I2CTransport* transport)
+    : transport(transport)
+    , scheduler(transport)
+{
+}
+
+bool SequenceRunner::run(const SequenceProgram& program, std::vector<I2CResult>& results,
+                         const Observer& observer, const Cancelled& cancelled)
+{
+    this->lastError.clear();
+    this->state = SequenceReport();
+
+    results.assign(program.transactions.size(), I2CResult());
+    for(std::size_t i = 0; i < results.size(); ++i) {
+        results[i].acked = false;
+        results[i].read.resize(program.transactions[i].readLength);
+    }
+
+    this->position = Position();
+    this->position.counters.assign(program.counters, 0);
+    this->position.deadlines.assign(program.deadlines, Clock::time_point());
+
+    Clock::time_point start = Clock::now();
+    bool ok = this->execute(program, results, observer, cancelled);
+    this->state.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+
+    return ok;
+}
+
+bool SequenceRunner::resume(const SequenceProgram& program, std::vector<I2CResult>& results,
+                            const Observer& observer, const Cancelled& cancelled)
+{
+    if(!this->position.resumable)
+        return this->fail("Nothing to resume");
+
+    this->lastError.clear();
+    this->position.resumable = false;
+
+    // The time spent stopped does not count against the waits
+    Clock::time_point start = Clock::now();
+
+    for(Clock::time_point& deadline : this->position.deadlines)
+        deadline += start - this->position.stoppedAt;
+
+    bool ok = this->execute(program, results, observer, cancelled);
+    this->state.elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+
+    return ok;
+}
+
+bool SequenceRunner::execute(const SequenceProgram& program, std::vector<I2CResult>& results,
+                             const Observer& observer, const Cancelled& cancelled)
+{
+    Position& at = this->position;
+    std::vector<unsigned long>& counters = at.counters;
+    std::vector<Clock::time_point>& deadlines = at.deadlines;
+    std::size_t& pc = at.pc;
+    bool& condition = at.condition;
+
+    const unsigned char* code = program.code.data();
+    const I2CResult* last = at.ran ? &results[at.last] : nullptr;
+
+    for(;;) {
+        ++this->state.steps;
+
+        switch(code[pc]) {
+            case SequenceProgram::Xfer:
+            case SequenceProgram::Try: {
+                bool tolerant = code[pc] == SequenceProgram::Try;
+                std::size_t index = operand16(code + pc + 1);
+                const I2CTransaction& transaction = program.transactions[index];
+                I2CResult& result = results[index];
+
+                if(cancelled && cancelled())
+                    return this->fail("Cancelled");
+
+                if(!this->scheduler.setSpeed(transaction.speedMode)) {
+                    at.resumable = true;
+                    at.stoppedAt = Clock::now();
+
+                    return this->fail("Failed to set bus speed (" + program.labels[index] + ")");
+                }
+
+                bool transferred = program.retries[index].run(this->transport, transaction, [&](I2CResult& attempt) {
+                    this->decoded.resize(1);
+
+                    bool ok = this->transport->runTransfer(program.transfers[index], transaction.speedMode, this->decoded);
+                    std::swap(attempt, this->decoded.front());
+
+                    return ok;
+                }, result, cancelled);
+
+                ++this->state.transactions;
+                this->state.commandRetries += result.retries;
+                last = &result;
+                at.last = index;
+                at.ran = true;
+
+                if(observer)
+                    observer(index, result);
+
+                if(!transferred) { // Runs again on resume()
+                    at.resumable = true;
+                    at.stoppedAt = Clock::now();
+
+                    return this->fail("Transfer failed (" + program.labels[index] + ")");
+                }
+
+                if(!result.acked) {
+                    ++this->state.nacks;
+
+                    if(!tolerant)
+                        return this->fail("No ACK (" + program.labels[index] + ")");
+                }
+
+                pc += 3;
+                break;
+            }
+            case SequenceProgram::Delay:
+                if(!this->delay(std::chrono::microseconds(operand32(code + pc + 1)), cancelled))
+                    return this->fail("Cancelled");
+
+                pc += 5;
+                break;
+            case SequenceProgram::Loop:
+                counters[operand8(code + pc + 1)] = operand32(code + pc + 2);
+                pc += 6;
+                break;
+            case SequenceProgram::Next:
+                pc = --counters[operand8(code + pc + 1)] != 0 ? operand32(code + pc + 2) : pc + 6;
+                break;
+            case SequenceProgram::Test: {
+                std::size_t index = operand16(code + pc + 1);
+                unsigned mask = operand8(code + pc + 3), value = operand8(code + pc + 4);
+                bool notEqual = operand8(code + pc + 5);
+
+                if(!last)
+                    return this->fail("Nothing was read before testing byte " + QString::number(index));
+
+                if(!last->acked) // Read data of a NACKed transaction means nothing, e.g. a busy target inside a wait
+                    condition = false;
+                else if(index >= last->read.size())
+                    return this->fail("Byte " + QString::number(index) + " was not read (" +
+                                      program.labels[last - results.data()] + " reads " + QString::number(last->read.size()) + ")");
+                else
+                    condition = ((last->read[index] & mask) == value) != notEqual;
+
+                pc += 6;
+                break;
+            }
+            case SequenceProgram::TestAck:
+                if(!last)
+                    return this->fail("Nothing was run before testing for an ACK");
+
+                condition = last->acked == (operand8(code + pc + 1) != 0);
+                pc += 2;
+                break;
+            case SequenceProgram::Jump:
+                pc = operand32(code + pc + 1);
+                break;
+            case SequenceProgram::JumpIfFalse:
+                pc = condition ? pc + 5 : operand32(code + pc + 1);
+                break;
+            case SequenceProgram::Deadline:
+                deadlines[operand8(code + pc + 1)] = Clock::now() + std::chrono::microseconds(operand32(code + pc + 2));
+                pc += 6;
+                break;
+            case SequenceProgram::Until:
+                if(condition) {
+                    pc += 8;
+                    break;
+                }
+
+                if(Clock::now() >= deadlines[operand8(code + pc + 1)])
+                    return this->fail(program.messages[operand16(code + pc + 2)]);
+
+                ++this->state.retries;
+                pc = operand32(code + pc + 4);
+                break;
+            case SequenceProgram::Assert:
+                if(!condition)
+                    return this->fail(program.messages[operand16(code + pc + 1)]);
+
+                pc += 3;
+                break;
+            case SequenceProgram::End:
+                return true;
+            default:
+                return this->fail("Invalid instruction " + QString::number(code[pc]) + " at " + QString::number(pc));
+        }
+    }
+}
+
+bool SequenceRunner::delay(std::chrono::microseconds duration, const Cancelled& cancelled)
+{
+    Clock::time_point end = Clock::now() + duration;
+
+    for(;;) {
+        if(cancelled && cancelled())
+            return false;
+
+        Clock::duration remaining = end - Clock::now();
+
+        if(remaining <= spinTime)
+            break;
+
+        std::this_thread::sleep_for(std::min<Clock::duration>(remaining - spinTime, sleepSlice));
+    }
+
+    while(Clock::now() < end)
+        ;
+
+    return true;
+}
+
+bool SequenceRunner::fail(const QString& error)
+{
+    this->lastError = error;
+
+    return false;
+}
@@ -0,0 +1,92 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SEQUENCERUNNER_H
+#define SEQUENCERUNNER_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <QString>
+
+#include "ch341stream.h"
+#include "sequences.h"
+#include "streamscheduler.h"
+
+class I2CTransport;
+
+struct SequenceReport {
+    std::size_t steps = 0;              // Instructions executed
+    std::size_t transactions = 0;
+    std::size_t nacks = 0;              // Tolerated ones inside waits included
+    std::size_t retries = 0;            // Wait bodies repeated because the condition did not hold yet
+    std::size_t commandRetries = 0;     // Attempts repeated by the retry policies of commands
+    std::chrono::nanoseconds elapsed{0};
+};
+
+// Interprets a compiled sequence on the calling thread. Every loop is
+// counted and every wait has a deadline, so a run always ends.
+class SequenceRunner
+{
+public:
+    // Called after every transaction
+    using Observer = std::function<void(std::size_t transaction, const I2CResult& result)>;
+    // Polled before every transaction and while delaying, return true to abort
+    using Cancelled = std::function<bool()>;
+
+    explicit SequenceRunner(I2CTransport* transport);
+
+    // results[i] holds the outcome of the last run of program.transactions[i]
+    // (batched == 0 if it never ran)
+    bool run(const SequenceProgram& program, std::vector<I2CResult>& results,
+             const Observer& observer = Observer(), const Cancelled& cancelled = Cancelled());
+    // Once run() or resume() stopped on a failed transfer (e.g. the adapter
+    // dropped off the bus), runs the program on from that transfer with the
+    // results and the report kept. Waits get the time in between added.
+    bool resume(const SequenceProgram& program, std::vector<I2CResult>& results,
+                const Observer& observer = Observer(), const Cancelled& cancelled = Cancelled());
+    bool canResume() const { return this->position.resumable; }
+
+    const QString& error() const { return this->lastError; }
+    const SequenceReport& report() const { return this->state; }
+
+private:
+    I2CTransport* transport;
+    StreamScheduler scheduler;
+    QString lastError;
+    SequenceReport state;
+    std::vector<I2CResult> decoded;     // Read back of the last transfer, swapped with the transaction's result
+
+    // Where the interpreter stands, kept for resume()
+    struct Position {
+        std::size_t pc = 0;
+        std::vector<unsigned long> counters;
+        std::vector<std::chrono::steady_clock::time_point> deadlines;
+        bool condition = false;
+        std::size_t last = 0;           // Index of the last transaction run, valid if ran
+        bool ran = false;
+        bool resumable = false;         // Stopped on a failed transfer at pc
+        std::chrono::steady_clock::time_point stoppedAt;
+    } position;
+
+    bool execute(const SequenceProgram& program, std::vector<I2CResult>& results,
+                 const Observer& observer, const Cancelled& cancelled);
+    bool delay(std::chrono::microseconds duration, const Cancelled& cancelled);
+    bool fail(const QString& error);
+};
+
+#endif // SEQUENCERUNNER_H
@@ -0,0 +1,588 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "sequences.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+
+#include "byteparser.h"
+#include "commandmodel.h"
+
+namespace Sequences {
+
+const char* const suffix = "ch341seq";
+
+}
+
+namespace {
+
+const std::size_t maxWriteLength = 1022;        // Including any register address, as in the main window
+const std::size_t maxReadLength = 1023;
+const std::size_t maxTransactions = 0xFFFF;     // Transaction operands are 16 bits
+
+const QRegularExpression spaces("\\s+");
+
+bool byteValue(const QString& text, unsigned max, unsigned& value)
+{
+    return ByteParser::parseValue(text.utf16(), text.size(), max, value);
+}
+
+bool decimalValue(const QString& text, unsigned long long min, unsigned long long max, unsigned long long& value)
+{
+    bool ok = false;
+    value = text.toULongLong(&ok, 10);
+
+    return ok && value >= min && value <= max;
+}
+
+// "250us", "5 ms" or "2s"
+bool timeValue(const QString& text, unsigned long long& microseconds)
+{
+    static const QRegularExpression pattern("^(\\d+)\\s*(us|ms|s)$", QRegularExpression::CaseInsensitiveOption);
+    QRegularExpressionMatch match = pattern.match(text.trimmed());
+
+    if(!match.hasMatch())
+        return false;
+
+    QString unit = match.captured(2).toLower();
+    unsigned long long scale = unit == "us" ? 1 : unit == "ms" ? 1000 : 1000000;
+
+    if(!decimalValue(match.captured(1), 0, 0xFFFFFFFFULL / scale, microseconds))
+        return false;
+
+    microseconds *= scale;
+
+    return true;
+}
+
+class Compiler
+{
+public:
+    Compiler(const CommandModel& commands, SequenceProgram& program) : commands(commands), program(program) {}
+
+    bool statement(int line, const QString& text);
+    bool finish();
+
+    Sequences::Error error;
+
+private:
+    struct Block {
+        enum Kind { Loop, If, Else, Wait } kind;
+        int line;
+        std::size_t start;                      // Loop and wait bodies, where they jump back to
+        std::size_t patch = 0;                  // If/else, the jump operand to point past the block
+        unsigned char slot = 0;                 // Loop counter/wait deadline
+        QString time = QString();               // Wait only, for the timeout message
+    };
+
+    const CommandModel& commands;
+    SequenceProgram& program;
+    std::vector<Block> blocks;
+    unsigned long speedMode = 1;
+    int line = 0;
+
+    bool fail(const QString& message) {
+        this->error.line = this->line;
+        this->error.message = message;
+        return false;
+    }
+
+    void op(SequenceProgram::Op op) { this->program.code.push_back(op); }
+    void u8(unsigned value) { this->program.code.push_back((unsigned char)value); }
+    void u16(unsigned value) { this->u8(value); this->u8(value >> 8); }
+    void u32(unsigned long value) { this->u16(value & 0xFFFF); this->u16(value >> 16); }
+
+    void patch(std::size_t at, unsigned long value) {
+        for(int i = 0; i < 4; ++i)
+            this->program.code[at + i] = (unsigned char)(value >> (8 * i));
+    }
+
+    std::size_t depth(Block::Kind kind) const {
+        return std::count_if(this->blocks.begin(), this->blocks.end(), [kind](const Block& block) { return block.kind == kind; });
+    }
+
+    bool transaction(const I2CTransaction& transaction, const QString& name, const QString& label,
+                     const RetryPolicy& retry = RetryPolicy());
+    bool condition(const QString& text);
+    unsigned message(const QString& text);
+
+    bool address(const QString& text, unsigned& value);
+    bool bytes(const QStringList& tokens, int first, std::vector<unsigned char>& out);
+};
+
+bool Compiler::statement(int line, const QString& text)
+{
+    this->line = line;
+
+    QString trimmed = text.trimmed();
+    QStringList tokens = trimmed.split(spaces, Qt::SkipEmptyParts);
+
+    if(tokens.isEmpty())
+        return true;
+
+    QString keyword = tokens.front().toLower();
+    QString rest = trimmed.mid(tokens.front().size()).trimmed();
+
+    if(keyword == "speed") {
+        static const QStringList names = { "20k", "100k", "400k", "750k" };
+        unsigned long long mode;
+
+        if(tokens.size() != 2)
+            return this->fail("Expected a speed mode (0-3, 20k, 100k, 400k or 750k)");
+
+        int named = names.indexOf(tokens[1].toLower());
+
+        if(named >= 0)
+            this->speedMode = named;
+        else if(decimalValue(tokens[1], 0, 3, mode))
+            this->speedMode = mode;
+        else
+            return this->fail("Invalid speed mode (" + tokens[1] + ")");
+
+        return true;
+    }
+
+    if(keyword == "run") {
+        if(rest.isEmpty())
+            return this->fail("Expected a command name");
+
+        std::optional<Command> command = this->commands.find(rest);
+
+        if(!command)
+            return this->fail("No command named \"" + rest + "\"");
+
+        return this->transaction(command->transaction(), command->name, "Line " + QString::number(line) + ": " + command->name,
+                                 command->retry);
+    }
+
+    if(keyword == "write" || keyword == "read") {
+        bool reading = keyword == "read";
+        I2CTransaction transaction = { 0, {}, 0, this->speedMode };
+        unsigned value;
+        unsigned long long count = 0;
+
+        if(tokens.size() < (reading ? 3 : 2))
+            return this->fail(reading ? "Expected an address and a byte count" : "Expected an address");
+        if(!this->address(tokens[1], value))
+            return false;
+        if(reading && !decimalValue(tokens[2], 1, maxReadLength, count))
+            return this->fail("Invalid read length (" + tokens[2] + ", 1-" + QString::number(maxReadLength) + " bytes)");
+        if(!this->bytes(tokens, reading ? 3 : 2, transaction.write))
+            return false;
+
+        transaction.address = (unsigned char)value;
+        transaction.readLength = count;
+
+        QString label = "Line " + QString::number(line) + ": " + keyword + " " + QString::fromStdString(ByteParser::toBinary(value, 7));
+
+        return this->transaction(transaction, QString(), label);
+    }
+
+    if(keyword == "delay") {
+        unsigned long long microseconds;
+
+        if(!timeValue(rest, microseconds))
+            return this->fail("Invalid delay (" + rest + "), expected e.g. 500us, 10ms or 1s");
+
+        this->op(SequenceProgram::Delay);
+        this->u32(microseconds);
+
+        return true;
+    }
+
+    if(keyword == "loop") {
+        unsigned long long count;
+
+        if(tokens.size() != 2 || !decimalValue(tokens[1], 1, 0xFFFFFFFFULL, count))
+            return this->fail("Invalid loop count (" + rest + ")");
+
+        Block block = { Block::Loop, line, 0 };
+        block.slot = (unsigned char)this->depth(Block::Loop);
+
+        if(block.slot == 0xFF)
+            return this->fail("Loops nested too deeply");
+
+        this->op(SequenceProgram::Loop);
+        this->u8(block.slot);
+        this->u32(count);
+
+        block.start = this->program.code.size();
+        this->program.counters = std::max<std::size_t>(this->program.counters, block.slot + 1);
+        this->blocks.push_back(block);
+
+        return true;
+    }
+
+    if(keyword == "if") {
+        if(!this->condition(rest))
+            return false;
+
+        this->op(SequenceProgram::JumpIfFalse);
+
+        Block block = { Block::If, line, 0 };
+        block.patch = this->program.code.size();
+        this->u32(0);
+
+        this->blocks.push_back(block);
+
+        return true;
+    }
+
+    if(keyword == "else") {
+        if(this->blocks.empty() || this->blocks.back().kind != Block::If)
+            return this->fail("else without if");
+
+        Block& block = this->blocks.back();
+
+        this->op(SequenceProgram::Jump);
+        std::size_t patch = this->program.code.size();
+        this->u32(0);
+
+        this->patch(block.patch, this->program.code.size());
+        block.kind = Block::Else;
+        block.patch = patch;
+
+        return true;
+    }
+
+    if(keyword == "wait") {
+        unsigned long long microseconds;
+
+        if(!timeValue(rest, microseconds))
+            return this->fail("Invalid timeout (" + rest + "), expected e.g. 500us, 10ms or 1s");
+
+        Block block = { Block::Wait, line, 0 };
+        block.slot = (unsigned char)this->depth(Block::Wait);
+        block.time = rest;
+
+        if(block.slot == 0xFF)
+            return this->fail("Waits nested too deeply");
+
+        this->op(SequenceProgram::Deadline);
+        this->u8(block.slot);
+        this->u32(microseconds);
+
+        block.start = this->program.code.size();
+        this->program.deadlines = std::max<std::size_t>(this->program.deadlines, block.slot + 1);
+        this->blocks.push_back(block);
+
+        return true;
+    }
+
+    if(keyword == "until") {
+        if(this->blocks.empty() || this->blocks.back().kind != Block::Wait)
+            return this->fail("until without wait");
+
+        Block block = this->blocks.back();
+
+        if(!this->condition(rest))
+            return false;
+
+        unsigned message = this->message("Timed out after " + block.time + " waiting for \"" + rest + "\" (line " + QString::number(block.line) + ")");
+
+        this->op(SequenceProgram::Until);
+        this->u8(block.slot);
+        this->u16(message);
+        this->u32(block.start);
+
+        this->blocks.pop_back();
+
+        return true;
+    }
+
+    if(keyword == "end") {
+        if(this->blocks.empty())
+            return this->fail("end without loop or if");
+
+        Block block = this->blocks.back();
+
+        if(block.kind == Block::Wait)
+            return this->fail("A wait ends with until, not end");
+
+        if(block.kind == Block::Loop) {
+            this->op(SequenceProgram::Next);
+            this->u8(block.slot);
+            this->u32(block.start);
+        }
+        else
+            this->patch(block.patch, this->program.code.size());
+
+        this->blocks.pop_back();
+
+        return true;
+    }
+
+    if(keyword == "assert") {
+        if(!this->condition(rest))
+            return false;
+
+        unsigned message = this->message("Assertion failed on line " + QString::number(line) + ": " + rest);
+
+        this->op(SequenceProgram::Assert);
+        this->u16(message);
+
+        return true;
+    }
+
+    return this->fail("Unknown statement \"" + tokens.front() + "\"");
+}
+
+bool Compiler::finish()
+{
+    if(!this->blocks.empty()) {
+        const Block& block = this->blocks.back();
+
+        this->line = block.line;
+        return this->fail(block.kind == Block::Wait ? "wait without until" : block.kind == Block::Loop ? "loop without end" : "if without end");
+    }
+
+    if(this->program.code.empty()) {
+        this->line = 0;
+        return this->fail("Nothing to run");
+    }
+
+    this->op(SequenceProgram::End);
+
+    return true;
+}
+
+bool Compiler::transaction(const I2CTransaction& transaction, const QString& name, const QString& label,
+                           const RetryPolicy& retry)
+{
+    if(this->program.transactions.size() == maxTransactions)
+        return this->fail("Too many reads/writes (" + QString::number(maxTransactions) + " at most)");
+
+    if(transaction.write.size() > maxWriteLength)
+        return this->fail("Exceeded write limit (" + QString::number(maxWriteLength) + " bytes)");
+
+    // The runner sets the bus speed beforehand, so the transfer carries no speed change
+    long speedMode = transaction.speedMode;
+    CH341Transfer transfer = CH341StreamEncoder().encode({ transaction }, speedMode).front();
+
+    this->op(this->depth(Block::Wait) != 0 ? SequenceProgram::Try : SequenceProgram::Xfer);
+    this->u16(this->program.transactions.size());
+
+    this->program.transactions.push_back(transaction);
+    this->program.transfers.push_back(std::move(transfer));
+    this->program.retries.push_back(retry);
+    this->program.names.append(name);
+    this->program.labels.append(label);
+    this->program.lines.push_back(this->line);
+
+    return true;
+}
+
+bool Compiler::condition(const QString& text)
+{
+    QString lower = text.trimmed().toLower();
+
+    if(lower == "ack" || lower == "nack") {
+        this->op(SequenceProgram::TestAck);
+        this->u8(lower == "ack");
+
+        return true;
+    }
+
+    // [INDEX] [& MASK] ==|!= VALUE, spacing optional
+    QString spaced = text;
+    spaced.replace("==", " == ").replace("!=", " != ").replace("&", " & ").replace("[", " [ ").replace("]", " ] ");
+
+    QStringList tokens = spaced.split(spaces, Qt::SkipEmptyParts);
+    unsigned long long index = 0;
+    unsigned mask = 0xFF, value;
+    int i = 0;
+
+    auto expected = [&]() { return this->fail("Invalid condition (" + text.trimmed() + "), expected e.g. \"[0] & 0x80 == 0\", \"ack\" or \"nack\""); };
+
+    if(i < tokens.size() && tokens[i] == "[") {
+        if(i + 2 >= tokens.size() || tokens[i + 2] != "]")
+            return expected();
+        if(!decimalValue(tokens[i + 1], 0, maxReadLength - 1, index))
+            return this->fail("Invalid byte index (" + tokens[i + 1] + ")");
+
+        i += 3;
+    }
+
+    if(i < tokens.size() && tokens[i] == "&") {
+        if(i + 1 >= tokens.size() || !byteValue(tokens[i + 1], 0xFF, mask))
+            return expected();
+
+        i += 2;
+    }
+
+    if(i + 2 != tokens.size() || (tokens[i] != "==" && tokens[i] != "!="))
+        return expected();
+    if(!byteValue(tokens[i + 1], 0xFF, value))
+        return this->fail("Invalid value (" + tokens[i + 1] + ")");
+    if(value & ~mask)
+        return this->fail("Value " + tokens[i + 1] + " has bits outside the mask, the condition could never change");
+
+    this->op(SequenceProgram::Test);
+    this->u16((unsigned)index);
+    this->u8(mask);
+    this->u8(value);
+    this->u8(tokens[i] == "!=");
+
+    return true;
+}
+
+unsigned Compiler::message(const QString& text)
+{
+    this->program.messages.append(text);
+
+    return this->program.messages.size() - 1;
+}
+
+bool Compiler::address(const QString& text, unsigned& value)
+{
+    if(!byteValue(text, 0x7F, value))
+        return this->fail("Invalid device address (" + text + ")");
+
+    return true;
+}
+
+bool Compiler::bytes(const QStringList& tokens, int first, std::vector<unsigned char>& out)
+{
+    for(int i = first; i < tokens.size(); ++i) {
+        unsigned value;
+
+        if(!byteValue(tokens[i], 0xFF, value))
+            return this->fail("Invalid byte (" + tokens[i] + ")");
+
+        out.push_back((unsigned char)value);
+    }
+
+    return true;
+}
+
+}
+
+namespace Sequences {
+
+bool compile(const QString& source, const CommandModel& commands, SequenceProgram& program, Error* error)
+{
+    program = SequenceProgram();
+
+    Compiler compiler(commands, program);
+    QStringList lines = source.split('\n');
+
+    for(int i = 0; i < lines.size(); ++i) {
+        QString line = lines[i];
+        qsizetype comment = line.indexOf('#');
+
+        if(comment >= 0)
+            line.truncate(comment);
+
+        if(!compiler.statement(i + 1, line)) {
+            if(error)
+                *error = compiler.error;
+
+            return false;
+        }
+    }
+
+    if(!compiler.finish()) {
+        if(error)
+            *error = compiler.error;
+
+        return false;
+    }
+
+    return true;
+}
+
+QString sidecarPath(const QString& libraryPath)
+{
+    QFileInfo info(libraryPath);
+
+    return info.path() + "/" + info.completeBaseName() + "." + suffix;
+}
+
+bool load(const QString& path, Map& sequences, QString* error)
+{
+    QFile file(path);
+
+    if(!file.open(QIODevice::ReadOnly)) {
+        if(error)
+            *error = file.errorString();
+
+        return false;
+    }
+
+    sequences.clear();
+
+    QStringList lines = QString::fromUtf8(file.readAll()).split('\n');
+    QString* source = nullptr;
+
+    for(QString& line : lines) {
+        if(line.endsWith('\r'))
+            line.chop(1);
+
+        if(line.startsWith('[') && line.endsWith(']') && line.size() > 2) {
+            source = &sequences[line.mid(1, line.size() - 2)];
+            continue;
+        }
+
+        if(source)
+            source->append(line + "\n");
+        else if(!line.trimmed().isEmpty()) {
+            if(error)
+                *error = "Expected a [name] line before any sequence";
+
+            return false;
+        }
+    }
+
+    // Saving separates sequences with a blank line
+    for(std::pair<const QString, QString>& sequence : sequences) {
+        while(sequence.second.endsWith("\n\n"))
+            sequence.second.chop(1);
+    }
+
+    return true;
+}
+
+bool save(const QString& path, const Map& sequences)
+{
+    std::ofstream file(std::filesystem::path(path.toStdU16String()));
+
+    if(!file.is_open())
+        return false;
+
+    for(const std::pair<const QString, QString>& sequence : sequences) {
+        file << "[" << sequence.first.toStdString() << "]\n";
+
+        for(const QString& line : sequence.second.split('\n')) {
+            // Leading space is insignificant to the language, and keeps the line from reading as a name
+            if(line.startsWith('['))
+                file << " ";
+
+            file << line.toStdString() << "\n";
+        }
+    }
+
+    file.close();
+
+    return !file.fail();
+}
+
+}
@@ -0,0 +1,103 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SEQUENCES_H
+#define SEQUENCES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <QString>
+#include <QStringList>
+
+#include "ch341stream.h"
+#include "retrypolicy.h"
+
+class CommandModel;
+
+// A sequence compiled to bytecode. Operands follow their opcode, little
+// endian; jump targets are offsets into code. Every transaction is prepared
+// up front so running it is a table lookup.
+struct SequenceProgram {
+    enum Op : unsigned char {
+        Xfer,                                   // u16 transaction, a NACK fails the sequence
+        Try,                                    // u16 transaction, a NACK only clears the ACK flag
+        Delay,                                  // u32 microseconds
+        Loop,                                   // u8 counter, u32 count
+        Next,                                   // u8 counter, u32 target: jumps while the decremented counter is not 0
+        Test,                                   // u16 byte, u8 mask, u8 value, u8 not equal: sets the condition from the last read
+        TestAck,                                // u8 acked: sets the condition from the last transaction's ACK
+        Jump,                                   // u32 target
+        JumpIfFalse,                            // u32 target
+        Deadline,                               // u8 deadline, u32 microseconds from now
+        Until,                                  // u8 deadline, u16 message, u32 target: jumps back while the condition is false, fails once the deadline passed
+        Assert,                                 // u16 message: fails unless the condition holds
+        End
+    };
+
+    std::vector<unsigned char> code;
+    std::vector<I2CTransaction> transactions;
+    std::vector<CH341Transfer> transfers;       // Every transaction encoded as a stream transfer at its own speed
+    std::vector<RetryPolicy> retries;           // Of the command run, off for plain reads/writes
+    QStringList names;                          // Command name of every transaction, empty for plain reads/writes
+    QStringList labels;                         // Shown with every transaction's result, e.g. "Line 3: read 1001000"
+    std::vector<int> lines;                     // Source line of every transaction
+    QStringList messages;                       // Failure messages of Until and Assert
+    std::size_t counters = 0;                   // Loop counter and deadline slots needed
+    std::size_t deadlines = 0;
+};
+
+namespace Sequences {
+
+// Sequences saved alongside a command library, by name
+using Map = std::map<QString, QString>;
+
+extern const char* const suffix;
+
+struct Error {
+    int line = 0;                               // 1 based, 0 if not tied to a line
+    QString message;
+};
+
+// One statement per line, '#' starts a comment. Addresses, bytes, masks and
+// values are written as in the main window (binary, 0x hex or 0d decimal),
+// counts, indices and times in decimal.
+//
+//   speed 0-3 | 20k | 100k | 400k | 750k    bus speed of the following reads/writes (100k to begin with)
+//   run NAME                                runs a saved command, retrying it as the command says
+//   write ADDRESS [BYTES...]                an address probe without bytes
+//   read ADDRESS COUNT [BYTES...]           the bytes are written first (e.g. a register address)
+//   delay TIME                              TIME is a number followed by us, ms or s
+//   loop COUNT ... end
+//   if CONDITION ... [else ...] end
+//   wait TIME ... until CONDITION           repeats the body until CONDITION holds, NACKs inside are not failures
+//   assert CONDITION
+//
+// A CONDITION is "ack", "nack" or "[INDEX] [& MASK] ==|!= VALUE" on the last
+// read, INDEX defaulting to 0. Commands are resolved by name when compiling.
+bool compile(const QString& source, const CommandModel& commands, SequenceProgram& program, Error* error = nullptr);
+
+// The sequence file saved next to a library, e.g. "init.csv" -> "init.ch341seq"
+QString sidecarPath(const QString& libraryPath);
+
+// Every sequence starts with a "[NAME]" line, followed by its source
+bool load(const QString& path, Map& sequences, QString* error = nullptr);
+bool save(const QString& path, const Map& sequences);
+
+}
+
+#endif // SEQUENCES_H
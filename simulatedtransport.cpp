@@ -0,0 +1,421 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "simulatedtransport.h"
+
+#include <algorithm>
+#include <deque>
+#include <thread>
+
+// SIMULATED EEPROM
+SimulatedEEPROM::SimulatedEEPROM(std::size_t size, std::size_t pageSize, int addressBytes, std::chrono::nanoseconds writeCycle)
+    : cells(size, 0xFF), pageSize(pageSize), addressBytes(addressBytes), writeCycle(writeCycle)
+{
+}
+
+bool SimulatedEEPROM::start(bool read, std::chrono::nanoseconds now)
+{
+    if(now < this->busyUntil) // Busy with the internal write cycle
+        return false;
+
+    if(!read)
+        this->addressReceived = 0;
+
+    return true;
+}
+
+bool SimulatedEEPROM::write(unsigned char byte)
+{
+    if(this->addressReceived < this->addressBytes) {
+        if(this->addressReceived == 0)
+            this->pointer = 0;
+
+        this->pointer = ((this->pointer << 8) | byte) % this->cells.size();
+        ++this->addressReceived;
+
+        return true;
+    }
+
+    std::size_t pageStart = this->pointer - this->pointer % this->pageSize; // Writes wrap within the page
+    this->pending.emplace_back(this->pointer, byte);
+    this->pointer = pageStart + (this->pointer + 1 - pageStart) % this->pageSize;
+
+    return true;
+}
+
+unsigned char SimulatedEEPROM::read()
+{
+    unsigned char byte = this->cells[this->pointer];
+    this->pointer = (this->pointer + 1) % this->cells.size();
+
+    return byte;
+}
+
+void SimulatedEEPROM::stop(std::chrono::nanoseconds now)
+{
+    if(this->pending.empty())
+        return;
+
+    for(std::pair<std::size_t, unsigned char>& cell : this->pending)
+        this->cells[cell.first] = cell.second;
+
+    this->pending.clear();
+    this->busyUntil = now + this->writeCycle;
+}
+
+// SIMULATED REGISTER FILE
+SimulatedRegisterFile::SimulatedRegisterFile(std::size_t registerCount, bool autoIncrement)
+    : cells(registerCount, 0x00), autoIncrement(autoIncrement)
+{
+}
+
+bool SimulatedRegisterFile::start(bool read, std::chrono::nanoseconds now)
+{
+    (void)now;
+
+    if(!read)
+        this->pointerReceived = false;
+
+    return true;
+}
+
+bool SimulatedRegisterFile::write(unsigned char byte)
+{
+    if(!this->pointerReceived) {
+        if(byte >= this->cells.size())
+            return false;
+
+        this->pointer = byte;
+        this->pointerReceived = true;
+
+        return true;
+    }
+
+    this->cells[this->pointer] = byte;
+
+    if(this->autoIncrement)
+        this->pointer = (this->pointer + 1) % this->cells.size();
+
+    return true;
+}
+
+unsigned char SimulatedRegisterFile::read()
+{
+    unsigned char byte = this->cells[this->pointer];
+
+    if(this->autoIncrement)
+        this->pointer = (this->pointer + 1) % this->cells.size();
+
+    return byte;
+}
+
+// SIMULATED TRANSPORT
+SimulatedTransport::SimulatedTransport(const SimulatedTiming& timing)
+    : timingConfig(timing)
+{
+}
+
+bool SimulatedTransport::open(unsigned long deviceNum)
+{
+    if(std::chrono::steady_clock::now().time_since_epoch().count() < this->pluggedInAt.load())
+        return false;
+
+    this->unplugged.store(false);
+    this->device = deviceNum;
+    this->devicePath = "simulated";
+    this->opened = true;
+    this->streamMode = -1;
+    this->usbRoundTrip();
+
+    return true;
+}
+
+void SimulatedTransport::close()
+{
+    this->opened = false;
+    this->streamMode = -1;
+}
+
+std::string SimulatedTransport::locationOf(unsigned long deviceNum) const
+{
+    (void)deviceNum;
+
+    // Every number reaches the same bus, once it is plugged back in
+    if(std::chrono::steady_clock::now().time_since_epoch().count() < this->pluggedInAt.load())
+        return std::string();
+
+    return "simulated";
+}
+
+bool SimulatedTransport::isAttached() const
+{
+    return this->opened && !this->unplugged.load();
+}
+
+void SimulatedTransport::unplug(std::chrono::nanoseconds downtime)
+{
+    std::chrono::steady_clock::time_point back = std::chrono::steady_clock::now() + downtime;
+
+    this->pluggedInAt.store(std::chrono::duration_cast<std::chrono::steady_clock::duration>(back.time_since_epoch()).count());
+    this->unplugged.store(true);
+}
+
+I2CTransport* SimulatedTransport::createSibling() const
+{
+    SimulatedTransport* transport = static_cast<SimulatedTransport*>(I2CTransport::create(true));
+    transport->timing() = this->timingConfig;
+
+    return transport;
+}
+
+void SimulatedTransport::addTarget(unsigned char address, SimulatedTarget* target)
+{
+    this->targets[address & 0x7F].reset(target);
+}
+
+SimulatedTarget* SimulatedTransport::target(unsigned char address) const
+{
+    auto it = this->targets.find(address & 0x7F);
+
+    return it == this->targets.end() ? nullptr : it->second.get();
+}
+
+void SimulatedTransport::resetStatistics()
+{
+    this->now = std::chrono::nanoseconds(0);
+    this->wallStart = std::chrono::steady_clock::now();
+    this->transfers = 0;
+    this->bytes = 0;
+}
+
+void SimulatedTransport::advance(std::chrono::nanoseconds duration)
+{
+    if(this->timingConfig.realTime) {
+        std::chrono::steady_clock::time_point wall = std::chrono::steady_clock::now();
+
+        // While nobody talks to the bus the wall clock runs ahead of the modeled one,
+        // catch up so this duration is still slept in full
+        if(this->wallStart + this->now < wall)
+            this->wallStart = wall - this->now;
+
+        this->now += duration;
+        std::this_thread::sleep_until(this->wallStart + this->now);
+    }
+    else
+        this->now += duration;
+}
+
+void SimulatedTransport::advanceBits(std::size_t bits)
+{
+    unsigned long long clock = this->timingConfig.busClock[this->speedMode & 0x03];
+
+    this->advance(std::chrono::nanoseconds(bits * 1000000000ULL / clock));
+}
+
+void SimulatedTransport::usbRoundTrip()
+{
+    ++this->transfers;
+    this->advance(this->timingConfig.usbRoundTrip);
+}
+
+bool SimulatedTransport::setStream(unsigned long speedMode)
+{
+    if(!this->isAttached())
+        return false;
+
+    this->speedMode = speedMode & 0x03;
+    this->streamMode = this->speedMode;
+    this->usbRoundTrip();
+
+    return true;
+}
+
+void SimulatedTransport::busStart()
+{
+    this->advanceBits(1);
+    this->expectAddress = true;
+}
+
+bool SimulatedTransport::busWrite(unsigned char byte)
+{
+    this->advanceBits(9);
+    ++this->bytes;
+
+    if(this->expectAddress) {
+        this->expectAddress = false;
+        this->active = this->target(byte >> 1);
+        this->addressAcked = this->active && this->active->start(byte & 1, this->now);
+
+        return this->addressAcked;
+    }
+
+    return this->addressAcked && this->active->write(byte);
+}
+
+unsigned char SimulatedTransport::busRead()
+{
+    this->advanceBits(9);
+    ++this->bytes;
+
+    return this->addressAcked ? this->active->read() : 0xFF; // Released bus reads back as 1s
+}
+
+void SimulatedTransport::busStop()
+{
+    this->advanceBits(1);
+
+    if(this->active)
+        this->active->stop(this->now);
+
+    this->active = nullptr;
+    this->addressAcked = false;
+}
+
+bool SimulatedTransport::streamI2C(std::size_t writeLength, const unsigned char* writeBuffer,
+                                   std::size_t readLength, unsigned char* readBuffer)
+{
+    if(!this->isAttached() || writeLength == 0)
+        return false;
+
+    this->usbRoundTrip();
+
+    bool acked = true;
+
+    // WRITE PHASE (also taken for a bare address probe)
+    if(writeLength > 1 || readLength == 0) {
+        this->busStart();
+        acked = this->busWrite(writeBuffer[0] & 0xFE);
+
+        for(std::size_t i = 1; i < writeLength; ++i)
+            acked = this->busWrite(writeBuffer[i]) && acked;
+    }
+
+    // READ PHASE
+    if(readLength != 0) {
+        this->busStart();
+        acked = this->busWrite(writeBuffer[0] | 1) && acked;
+
+        for(std::size_t i = 0; i < readLength; ++i)
+            readBuffer[i] = this->busRead();
+    }
+
+    this->busStop();
+
+    return acked;
+}
+
+bool SimulatedTransport::writeRead(const CH341Transfer& transfer, unsigned char* readBuffer)
+{
+    if(!this->isAttached())
+        return false;
+
+    this->usbRoundTrip();
+
+    return this->runStream(transfer, readBuffer);
+}
+
+std::size_t SimulatedTransport::writeReadQueued(const CH341Transfer* transfers, unsigned char* const* readBuffers, std::size_t count)
+{
+    if(!this->isAttached())
+        return 0;
+
+    std::chrono::nanoseconds halfTrip = this->timingConfig.usbRoundTrip / 2;
+    std::size_t depth = std::max<std::size_t>(this->timingConfig.queueDepth, 1);
+
+    std::deque<std::chrono::nanoseconds> inFlight; // When the read back of each submitted transfer arrives
+    std::chrono::nanoseconds submitted = this->now;
+    std::size_t completed = 0;
+
+    for(; completed < count; ++completed) {
+        if(inFlight.size() == depth) { // Wait for the oldest one to free its slot
+            submitted = std::max(submitted, inFlight.front());
+            inFlight.pop_front();
+        }
+
+        // The bus works through the transfers in order
+        this->advance(std::max(submitted + halfTrip, this->now) - this->now);
+        ++this->transfers;
+
+        bool ok = this->runStream(transfers[completed], readBuffers[completed]);
+        inFlight.push_back(this->now + halfTrip);
+
+        if(!ok)
+            break;
+    }
+
+    if(!inFlight.empty())
+        this->advance(inFlight.back() - this->now);
+
+    return completed;
+}
+
+bool SimulatedTransport::runStream(const CH341Transfer& transfer, unsigned char* readBuffer)
+{
+    const std::vector<unsigned char>& out = transfer.out;
+    std::size_t inPosition = 0;
+
+    for(std::size_t packet = 0; packet < out.size(); packet += CH341_PACKET_LENGTH) {
+        std::size_t end = std::min(packet + CH341_PACKET_LENGTH, out.size());
+
+        if(out[packet] != CH341_CMD_I2C_STREAM)
+            return false;
+
+        for(std::size_t i = packet + 1; i < end;) {
+            unsigned char command = out[i++];
+
+            if(command == CH341_STM_END)
+                break;
+            else if(command == CH341_STM_STA)
+                this->busStart();
+            else if(command == CH341_STM_STO)
+                this->busStop();
+            else if((command & 0xF0) == CH341_STM_SET)
+                this->speedMode = command & 0x03;
+            else if((command & 0xF0) == CH341_STM_US)
+                this->advance(std::chrono::microseconds(command & 0x0F));
+            else if((command & 0xC0) == CH341_STM_OUT) {
+                std::size_t length = command & 0x3F;
+
+                if(length == 0) { // Single byte with ACK status
+                    if(i >= end || inPosition >= transfer.inLength)
+                        return false;
+
+                    readBuffer[inPosition++] = this->busWrite(out[i++]) ? 0x00 : CH341_STATUS_NACK;
+                }
+                else {
+                    if(i + length > end)
+                        return false;
+
+                    for(std::size_t j = 0; j < length; ++j)
+                        this->busWrite(out[i++]);
+                }
+            }
+            else if((command & 0xC0) == CH341_STM_IN) {
+                std::size_t length = std::max<std::size_t>(command & 0x3F, 1);
+
+                if(inPosition + length > transfer.inLength)
+                    return false;
+
+                for(std::size_t j = 0; j < length; ++j)
+                    readBuffer[inPosition++] = this->busRead();
+            }
+            else
+                return false;
+        }
+    }
+
+    return inPosition == transfer.inLength;
+}
@@ -0,0 +1,173 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SIMULATEDTRANSPORT_H
+#define SIMULATEDTRANSPORT_H
+
+#include "i2ctransport.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+// A virtual I2C target sitting on the simulated bus. The bus hands every
+// target the simulated time so timing dependent behaviour (e.g. EEPROM write
+// cycles) follows the modeled clock rather than the wall clock.
+class SimulatedTarget
+{
+public:
+    virtual ~SimulatedTarget() = default;
+
+    // Called on every (repeated) START addressed to this target, returns false to NACK the address byte
+    virtual bool start(bool read, std::chrono::nanoseconds now) { (void)read; (void)now; return true; }
+    // Returns false to NACK the byte
+    virtual bool write(unsigned char byte) = 0;
+    virtual unsigned char read() = 0;
+    virtual void stop(std::chrono::nanoseconds now) { (void)now; }
+};
+
+// 24Cxx style EEPROM: 1 or 2 address bytes, page buffered writes that wrap
+// within the page, and NACKs its address while the write cycle is in progress
+class SimulatedEEPROM : public SimulatedTarget
+{
+public:
+    SimulatedEEPROM(std::size_t size, std::size_t pageSize, int addressBytes,
+                    std::chrono::nanoseconds writeCycle = std::chrono::milliseconds(5));
+
+    bool start(bool read, std::chrono::nanoseconds now) override;
+    bool write(unsigned char byte) override;
+    unsigned char read() override;
+    void stop(std::chrono::nanoseconds now) override;
+
+    std::vector<unsigned char>& memory() { return this->cells; }
+
+private:
+    std::vector<unsigned char> cells;
+    std::vector<std::pair<std::size_t, unsigned char>> pending;
+    std::size_t pageSize;
+    int addressBytes;
+    std::chrono::nanoseconds writeCycle;
+    std::chrono::nanoseconds busyUntil{0};
+
+    std::size_t pointer = 0;
+    int addressReceived = 0;
+};
+
+// Register file sensor: the first written byte selects the register, further
+// writes/reads access consecutive registers if auto increment is enabled
+class SimulatedRegisterFile : public SimulatedTarget
+{
+public:
+    explicit SimulatedRegisterFile(std::size_t registerCount = 256, bool autoIncrement = true);
+
+    bool start(bool read, std::chrono::nanoseconds now) override;
+    bool write(unsigned char byte) override;
+    unsigned char read() override;
+
+    std::vector<unsigned char>& registers() { return this->cells; }
+
+private:
+    std::vector<unsigned char> cells;
+    bool autoIncrement;
+
+    std::size_t pointer = 0;
+    bool pointerReceived = false;
+};
+
+struct SimulatedTiming {
+    std::chrono::nanoseconds usbRoundTrip = std::chrono::microseconds(1000); // Full speed USB, one frame per bulk round trip
+    unsigned long busClock[4] = { 20000, 100000, 400000, 750000 };           // Hz, indexed by speed mode
+    bool realTime = true;                                                    // Sleep for the modeled time instead of only accounting for it
+    std::size_t queueDepth = 4;                                              // Transfers kept in flight by writeReadQueued, as the libusb backend does
+};
+
+class SimulatedTransport : public I2CTransport
+{
+public:
+    explicit SimulatedTransport(const SimulatedTiming& timing = SimulatedTiming());
+
+    const char* name() const override { return "Simulated"; }
+    // Another bus with the default targets and the same timing
+    I2CTransport* createSibling() const override;
+
+    bool open(unsigned long deviceNum) override;
+    void close() override;
+    std::string locationOf(unsigned long deviceNum) const override;
+    bool isAttached() const override;
+
+    // Thread safe. Drops the adapter off the bus as if its cable was pulled:
+    // transfers fail from now on, it cannot be opened again until downtime
+    // (wall clock) has passed, and only a new open() brings it back.
+    void unplug(std::chrono::nanoseconds downtime);
+
+    bool setStream(unsigned long speedMode) override;
+    bool streamI2C(std::size_t writeLength, const unsigned char* writeBuffer,
+                   std::size_t readLength, unsigned char* readBuffer) override;
+    bool writeRead(const CH341Transfer& transfer, unsigned char* readBuffer) override;
+    // Models the host keeping timing().queueDepth transfers submitted: each one
+    // reaches the bus half a round trip after it was submitted and its read
+    // back arrives half a round trip after the bus finished it
+    std::size_t writeReadQueued(const CH341Transfer* transfers, unsigned char* const* readBuffers, std::size_t count) override;
+
+    unsigned long driverVersion() const override { return 1; }
+    unsigned long libraryVersion() const override { return 1; }
+
+    // Takes ownership of the target
+    void addTarget(unsigned char address, SimulatedTarget* target);
+    SimulatedTarget* target(unsigned char address) const;
+
+    SimulatedTiming& timing() { return this->timingConfig; }
+
+    // Modeled time spent on USB round trips and bus activity since the last reset
+    std::chrono::nanoseconds elapsed() const { return this->now; }
+    std::size_t usbTransfers() const { return this->transfers; }
+    std::size_t busBytes() const { return this->bytes; }
+    void resetStatistics();
+
+private:
+    SimulatedTiming timingConfig;
+    std::map<unsigned char, std::unique_ptr<SimulatedTarget>> targets;
+    unsigned long speedMode = 1;
+
+    std::chrono::nanoseconds now{0};
+    std::chrono::steady_clock::time_point wallStart = std::chrono::steady_clock::now();  // Wall clock time of now == 0, moved up after idling
+    std::size_t transfers = 0;
+    std::size_t bytes = 0;
+
+    std::atomic<bool> unplugged{false};
+    std::atomic<std::int64_t> pluggedInAt{0};   // steady_clock nanoseconds
+
+    // Bus state between START and STOP
+    SimulatedTarget* active = nullptr;
+    bool expectAddress = false;
+    bool addressAcked = false;
+
+    void advance(std::chrono::nanoseconds duration);
+    void advanceBits(std::size_t bits);
+    void usbRoundTrip();
+    // Interprets the stream commands of a transfer on the bus
+    bool runStream(const CH341Transfer& transfer, unsigned char* readBuffer);
+
+    void busStart();
+    bool busWrite(unsigned char byte);
+    unsigned char busRead();
+    void busStop();
+};
+
+#endif // SIMULATEDTRANSPORT_H
@@ -0,0 +1,72 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Lock-free bounded queue for exactly one producer thread and one consumer
+// thread. Slots are allocated up front and items are moved in and out.
+template<typename T, std::size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() : buffer(Capacity) {}
+
+    // Producer only, returns false if the queue is full
+    bool push(T&& item) {
+        std::size_t head = this->head.load(std::memory_order_relaxed);
+
+        if(head - this->tail.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        this->buffer[head & (Capacity - 1)] = std::move(item);
+        this->head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer only, returns false if the queue is empty
+    bool pop(T& item) {
+        std::size_t tail = this->tail.load(std::memory_order_relaxed);
+
+        if(tail == this->head.load(std::memory_order_acquire))
+            return false;
+
+        item = std::move(this->buffer[tail & (Capacity - 1)]);
+        this->tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Only a snapshot when called while the other side is active
+    std::size_t size() const {
+        return this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_acquire);
+    }
+
+private:
+    alignas(64) std::atomic<std::size_t> head{0};
+    alignas(64) std::atomic<std::size_t> tail{0};
+    std::vector<T> buffer;
+};
+
+#endif // SPSCQUEUE_H
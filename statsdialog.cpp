@@ -0,0 +1,169 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "statsdialog.h"
+#include "ui_statsdialog.h"
+
+#include <filesystem>
+#include <fstream>
+#include <QDebug>
+#include <QDir>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QTableWidgetItem>
+
+namespace {
+
+const int refreshInterval = 500; // Milliseconds
+
+QString latencyText(std::uint64_t nanoseconds)
+{
+    return nanoseconds >= 10000000 ? QString::number(nanoseconds / 1000000.0, 'f', 1) + " ms"
+                                   : QString::number(nanoseconds / 1000.0, 'f', 1) + " us";
+}
+
+QString throughputText(double bytesPerSecond)
+{
+    return bytesPerSecond >= 1024 ? QString::number(bytesPerSecond / 1024, 'f', 1) + " KiB/s"
+                                  : QString::number(bytesPerSecond, 'f', 0) + " B/s";
+}
+
+}
+
+StatsDialog::StatsDialog(std::shared_ptr<TransactionStats> stats, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::StatsDialog),
+    stats(std::move(stats))
+{
+    ui->setupUi(this);
+    this->setWindowTitle("Transaction Statistics");
+
+    ui->statsTableWidget->setColumnCount(ColumnCount);
+    ui->statsTableWidget->setHorizontalHeaderLabels({ "Group", "Name", "Transactions", "Errors", "Retries", "Waited", "p50", "p99", "Max", "Throughput" });
+    ui->statsTableWidget->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    ui->statsTableWidget->horizontalHeader()->setSectionResizeMode(NameColumn, QHeaderView::Stretch);
+    ui->statsTableWidget->verticalHeader()->setVisible(false);
+
+    this->refreshTimer.setInterval(refreshInterval);
+    connect(&this->refreshTimer, &QTimer::timeout, this, &StatsDialog::refresh);
+}
+
+StatsDialog::~StatsDialog()
+{
+    delete ui;
+}
+
+void StatsDialog::showEvent(QShowEvent* event)
+{
+    QDialog::showEvent(event);
+
+    this->refresh();
+    this->refreshTimer.start();
+}
+
+void StatsDialog::hideEvent(QHideEvent* event)
+{
+    this->refreshTimer.stop();
+
+    QDialog::hideEvent(event);
+}
+
+void StatsDialog::on_resetButton_clicked()
+{
+    this->stats->reset();
+    this->refresh();
+}
+
+void StatsDialog::on_exportButton_clicked()
+{
+    QString filePath = QFileDialog::getSaveFileName(this, "Export statistics", QDir::homePath(),
+                                                    "Comma separated values (*.csv);;JSON (*.json)");
+
+    if(filePath.isEmpty())
+        return;
+
+    std::ofstream file(std::filesystem::path(filePath.toStdU16String()));
+
+    if(!file.is_open()) {
+        qDebug().nospace() << "Failed to export to " << filePath << "!";
+        QMessageBox::warning(this, " ", "Failed to export to \"" + filePath + "\"!");
+        return;
+    }
+
+    std::vector<TransactionStats::Row> rows = this->stats->rows();
+
+    if(QFileInfo(filePath).suffix().toLower() == "json")
+        TransactionStats::writeJson(file, rows);
+    else
+        TransactionStats::writeCsv(file, rows);
+
+    file.close();
+
+    qDebug().nospace() << "EXPORTED " << rows.size() << " STATISTICS ROWS TO " << filePath << "!\n";
+    QMessageBox::information(this, " ", "Exported " + QString::number(rows.size()) + " row(s) to \"" + filePath + "\"!");
+}
+
+void StatsDialog::refresh()
+{
+    std::vector<TransactionStats::Row> rows = this->stats->rows();
+
+    // Rows are only ever added, so existing items are updated in place
+    if(ui->statsTableWidget->rowCount() != (int)rows.size()) {
+        ui->statsTableWidget->setRowCount((int)rows.size());
+
+        for(int row = 0; row < (int)rows.size(); ++row) {
+            for(int column = 0; column < ColumnCount; ++column) {
+                if(ui->statsTableWidget->item(row, column))
+                    continue;
+
+                QTableWidgetItem* item = new QTableWidgetItem();
+                item->setTextAlignment(column <= NameColumn ? Qt::AlignLeft | Qt::AlignVCenter : Qt::AlignRight | Qt::AlignVCenter);
+
+                ui->statsTableWidget->setItem(row, column, item);
+            }
+        }
+    }
+
+    std::uint64_t transactions = 0, errors = 0;
+
+    for(int row = 0; row < (int)rows.size(); ++row) {
+        const LatencyHistogram::Snapshot& data = rows[row].data;
+        QString texts[ColumnCount] = {
+            TransactionStats::dimensionName(rows[row].dimension),
+            rows[row].key,
+            QString::number(data.count),
+            QString::number(data.errors),
+            QString::number(data.retries),
+            latencyText(data.waited),
+            latencyText(data.quantile(0.5)),
+            latencyText(data.quantile(0.99)),
+            latencyText(data.max),
+            throughputText(data.bytesPerSecond())
+        };
+
+        for(int column = 0; column < ColumnCount; ++column)
+            ui->statsTableWidget->item(row, column)->setText(texts[column]);
+
+        if(rows[row].dimension == TransactionStats::ByDevice) { // Every transaction is in exactly one device row
+            transactions += data.count;
+            errors += data.errors;
+        }
+    }
+
+    ui->statusLabel->setText(QString::number(transactions) + " transaction(s), " + QString::number(errors) + " error(s)");
+}
@@ -0,0 +1,59 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef STATSDIALOG_H
+#define STATSDIALOG_H
+
+#include <memory>
+#include <QDialog>
+#include <QTimer>
+
+#include "transactionstats.h"
+
+namespace Ui {
+class StatsDialog;
+}
+
+// Latency percentiles, throughput and error counts of every transaction run
+// so far, per command, bus speed and device. Refreshes itself while shown.
+class StatsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit StatsDialog(std::shared_ptr<TransactionStats> stats, QWidget *parent = nullptr);
+    ~StatsDialog();
+
+protected:
+    void showEvent(QShowEvent* event) override;
+    void hideEvent(QHideEvent* event) override;
+
+private slots:
+    void on_resetButton_clicked();
+
+    void on_exportButton_clicked();
+
+    void refresh();
+
+private:
+    enum Column { GroupColumn, NameColumn, CountColumn, ErrorsColumn, RetriesColumn, WaitedColumn, P50Column, P99Column, MaxColumn, ThroughputColumn, ColumnCount };
+
+    Ui::StatsDialog *ui;
+    std::shared_ptr<TransactionStats> stats;
+    QTimer refreshTimer;
+};
+
+#endif // STATSDIALOG_H
@@ -0,0 +1,185 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "streamscheduler.h"
+
+#include <algorithm>
+
+#include "i2ctransport.h"
+
+StreamScheduler::StreamScheduler(I2CTransport* transport)
+    : transport(transport)
+{
+}
+
+bool StreamScheduler::setSpeed(unsigned long speedMode, ScheduleReport* report)
+{
+    if(report)
+        ++report->commands;
+
+    if(this->transport->currentStreamMode() == (long)speedMode) {
+        if(report)
+            ++report->saved;
+
+        return true;
+    }
+
+    if(report) {
+        ++report->reconfigurations;
+        ++report->transfers;
+    }
+
+    return this->transport->setStream(speedMode);
+}
+
+std::vector<std::size_t> StreamScheduler::groupBySpeed(const std::vector<I2CTransaction>& transactions,
+                                                       const std::vector<std::size_t>& barriers, long speedMode)
+{
+    std::vector<std::size_t> order(transactions.size());
+    for(std::size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+
+    std::vector<std::size_t> bounds = barriers;
+    bounds.push_back(0);
+    bounds.push_back(transactions.size());
+    std::sort(bounds.begin(), bounds.end());
+    bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+    for(std::size_t i = 0; i + 1 < bounds.size(); ++i) {
+        if(bounds[i + 1] > transactions.size())
+            break;
+
+        // The group already matching the device goes first, the others follow
+        // in mode order. Stable, so commands of the same speed keep their order.
+        long first = speedMode;
+        auto rank = [&](std::size_t index) {
+            long mode = (long)transactions[index].speedMode;
+            return mode == first ? -1 : mode;
+        };
+
+        std::stable_sort(order.begin() + bounds[i], order.begin() + bounds[i + 1],
+                         [&](std::size_t a, std::size_t b) { return rank(a) < rank(b); });
+
+        if(bounds[i + 1] != bounds[i])
+            speedMode = (long)transactions[order[bounds[i + 1] - 1]].speedMode;
+    }
+
+    return order;
+}
+
+std::size_t StreamScheduler::countReconfigurations(const std::vector<I2CTransaction>& transactions,
+                                                   const std::vector<std::size_t>& order, long speedMode)
+{
+    std::size_t count = 0;
+
+    for(std::size_t index : order) {
+        if((long)transactions[index].speedMode != speedMode) {
+            speedMode = transactions[index].speedMode;
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+std::vector<I2CTransaction> StreamScheduler::mergeWrites(const std::vector<I2CTransaction>& transactions,
+                                                         const std::vector<std::size_t>& barriers,
+                                                         const std::bitset<128>& autoIncrement, std::vector<std::size_t>& burst)
+{
+    std::vector<bool> barrier(transactions.size(), false);
+    for(std::size_t index : barriers) {
+        if(index < barrier.size())
+            barrier[index] = true;
+    }
+
+    auto isRegisterWrite = [&](const I2CTransaction& transaction) {
+        return transaction.readLength == 0 && transaction.write.size() >= 2 && autoIncrement[transaction.address & 0x7F];
+    };
+
+    std::vector<I2CTransaction> bursts;
+    bursts.reserve(transactions.size());
+    burst.resize(transactions.size());
+
+    for(std::size_t i = 0; i < transactions.size(); ++i) {
+        const I2CTransaction& transaction = transactions[i];
+
+        if(!bursts.empty() && !barrier[i] && isRegisterWrite(transaction) && isRegisterWrite(bursts.back())) {
+            I2CTransaction& last = bursts.back();
+            std::size_t next = last.write[0] + last.write.size() - 1; // Register after the last one written, never wraps past 0xFF
+
+            if(last.address == transaction.address && last.speedMode == transaction.speedMode && transaction.write[0] == next &&
+               last.write.size() + transaction.write.size() - 1 <= StreamScheduler::maxBurstLength) {
+                last.write.insert(last.write.end(), transaction.write.begin() + 1, transaction.write.end());
+                burst[i] = bursts.size() - 1;
+                continue;
+            }
+        }
+
+        burst[i] = bursts.size();
+        bursts.push_back(transaction);
+    }
+
+    return bursts;
+}
+
+bool StreamScheduler::runBatch(const std::vector<I2CTransaction>& transactions, const std::vector<std::size_t>& barriers,
+                               bool reorder, std::vector<I2CResult>& results, ScheduleReport& report,
+                               const std::bitset<128>& autoIncrement)
+{
+    long speedMode = this->transport->currentStreamMode();
+
+    std::vector<std::size_t> order;
+    if(reorder)
+        order = StreamScheduler::groupBySpeed(transactions, barriers, speedMode);
+    else {
+        order.resize(transactions.size());
+        for(std::size_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+    }
+
+    report.commands += transactions.size();
+    std::size_t reconfigurations = StreamScheduler::countReconfigurations(transactions, order, speedMode);
+    report.reconfigurations += reconfigurations;
+    report.saved += transactions.size() - reconfigurations;
+
+    std::vector<I2CTransaction> scheduled;
+    scheduled.reserve(transactions.size());
+    for(std::size_t index : order)
+        scheduled.push_back(transactions[index]);
+
+    // Reordering keeps every command within its barriers, so they stand at the same positions in scheduled
+    std::vector<std::size_t> burst;
+    if(autoIncrement.any()) {
+        scheduled = StreamScheduler::mergeWrites(scheduled, barriers, autoIncrement, burst);
+        report.merged += order.size() - scheduled.size();
+    }
+
+    std::vector<I2CResult> scheduledResults;
+    std::size_t transfers = 0;
+
+    bool ok = this->transport->transferBatch(scheduled, scheduledResults, &transfers);
+    report.transfers += transfers;
+
+    results.assign(transactions.size(), I2CResult());
+    for(std::size_t i = 0; i < order.size(); ++i) {
+        if(burst.empty() && i < scheduledResults.size())
+            results[order[i]] = std::move(scheduledResults[i]);
+        else if(!burst.empty() && burst[i] < scheduledResults.size())
+            results[order[i]] = scheduledResults[burst[i]]; // Bursts are writes, there is no read data to copy
+    }
+
+    return ok;
+}
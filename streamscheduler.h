@@ -0,0 +1,75 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef STREAMSCHEDULER_H
+#define STREAMSCHEDULER_H
+
+#include <bitset>
+#include <cstddef>
+#include <vector>
+
+#include "ch341stream.h"
+
+class I2CTransport;
+
+struct ScheduleReport {
+    std::size_t commands = 0;
+    std::size_t reconfigurations = 0;   // Speed changes actually sent
+    std::size_t saved = 0;              // Compared to reprogramming the bus speed before every command
+    std::size_t transfers = 0;
+    std::size_t merged = 0;             // Register writes folded into the burst of the write before them
+};
+
+// Decides when the bus speed has to be reprogrammed. Tracks the mode the
+// device is in (through the transport) and, when allowed, reorders the
+// commands between ordering barriers so commands of the same speed run
+// back to back. Consecutive writes to consecutive registers of devices that
+// auto increment their register pointer are sent as a single burst.
+class StreamScheduler
+{
+public:
+    explicit StreamScheduler(I2CTransport* transport);
+
+    // Only reprograms the bus when the device is not already in speedMode
+    bool setSpeed(unsigned long speedMode, ScheduleReport* report = nullptr);
+
+    // barriers holds the indices of the commands no command may be moved across
+    // (a command at a barrier index starts a new group), nor merged across.
+    // autoIncrement holds the 7 bit addresses whose register writes may be merged.
+    // Results are returned in the original order, merged writes share the result of their burst.
+    bool runBatch(const std::vector<I2CTransaction>& transactions, const std::vector<std::size_t>& barriers,
+                  bool reorder, std::vector<I2CResult>& results, ScheduleReport& report,
+                  const std::bitset<128>& autoIncrement = std::bitset<128>());
+
+    // Returns order[i] = index of the transaction that runs i-th
+    static std::vector<std::size_t> groupBySpeed(const std::vector<I2CTransaction>& transactions,
+                                                 const std::vector<std::size_t>& barriers, long speedMode);
+    static std::size_t countReconfigurations(const std::vector<I2CTransaction>& transactions,
+                                             const std::vector<std::size_t>& order, long speedMode);
+    // A register write (register byte, then data) continuing where the previous one ended, on the same device
+    // and speed, is appended to it as long as the burst stays within maxBurstLength write bytes.
+    // Returns the bursts, burst[i] = index of the burst transaction i went into.
+    static std::vector<I2CTransaction> mergeWrites(const std::vector<I2CTransaction>& transactions,
+                                                   const std::vector<std::size_t>& barriers,
+                                                   const std::bitset<128>& autoIncrement, std::vector<std::size_t>& burst);
+
+    static const std::size_t maxBurstLength = 1022; // Same limit as a single command
+
+private:
+    I2CTransport* transport;
+};
+
+#endif // STREAMSCHEDULER_H
@@ -0,0 +1,262 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "tracelog.h"
+
+#include <algorithm>
+#include <cstring>
+#include <QDateTime>
+
+const char* const TraceWriter::suffix = "ch341trc";
+
+namespace {
+
+const char magic[8] = { 'C', 'H', '3', '4', '1', 'T', 'R', 'C' };
+
+const std::size_t headerLength = 32;
+const std::size_t recordHeaderLength = 16;
+const std::size_t growth = 16 * 1024 * 1024;   // Preallocated at a time
+
+enum RecordFlag { Acked = 0x01, Ran = 0x02 };
+
+std::uint16_t get16(const unsigned char* p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+std::uint64_t get64(const unsigned char* p)
+{
+    std::uint64_t value = 0;
+    for(int i = 7; i >= 0; --i)
+        value = (value << 8) | p[i];
+
+    return value;
+}
+
+void put16(unsigned char* p, std::uint16_t value)
+{
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+}
+
+void put64(unsigned char* p, std::uint64_t value)
+{
+    for(int i = 0; i < 8; ++i)
+        p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+bool fail(QString* error, const QString& message)
+{
+    if(error)
+        *error = message;
+
+    return false;
+}
+
+}
+
+// TRACE WRITER
+TraceWriter::~TraceWriter()
+{
+    this->close();
+}
+
+bool TraceWriter::open(const QString& path, QString* error)
+{
+    this->close();
+    this->file.setFileName(path);
+
+    if(!this->file.open(QIODevice::ReadWrite | QIODevice::Truncate))
+        return fail(error, this->file.errorString());
+
+    this->count = 0;
+    this->used = 0;
+    this->started = std::chrono::steady_clock::now();
+
+    if(!this->reserve(0)) {
+        QString message = this->file.errorString();
+        this->file.close();
+
+        return fail(error, message);
+    }
+
+    std::memcpy(this->data, magic, sizeof(magic));
+    put16(this->data + 8, version);
+    put16(this->data + 10, headerLength);
+    put64(this->data + 16, (std::uint64_t)QDateTime::currentMSecsSinceEpoch());
+    put64(this->data + 24, 0);
+
+    return true;
+}
+
+void TraceWriter::close()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if(!this->file.isOpen())
+        return;
+
+    if(this->data)
+        this->file.unmap(this->data);
+
+    this->data = nullptr;
+    this->capacity = 0;
+
+    this->file.resize(headerLength + this->used.load());
+    this->file.close();
+}
+
+bool TraceWriter::reserve(std::size_t length)
+{
+    std::size_t needed = headerLength + this->used.load(std::memory_order_relaxed) + length;
+
+    if(this->data && needed <= this->capacity)
+        return true;
+
+    // GROW THE FILE AND MAP IT AGAIN, the header and records written so far stay where they are
+    std::size_t capacity = std::max(this->capacity + growth, needed + growth);
+
+    if(this->data)
+        this->file.unmap(this->data);
+
+    this->data = nullptr;
+    this->capacity = 0;
+
+    if(!this->file.resize(capacity))
+        return false;
+
+    this->data = this->file.map(0, capacity);
+    this->capacity = this->data ? capacity : 0;
+
+    return this->data != nullptr;
+}
+
+void TraceWriter::append(unsigned long deviceNum, const I2CTransaction& transaction, const I2CResult& result)
+{
+    std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->started).count();
+    bool ran = result.batched != 0;
+    std::size_t readLength = ran ? std::min(result.read.size(), transaction.readLength) : 0;
+    std::size_t length = recordHeaderLength + transaction.write.size() + (ran ? transaction.readLength : 0);
+
+    if(transaction.write.size() > 0xFFFF || transaction.readLength > 0xFFFF) // Far beyond anything a CH341 command carries
+        return;
+
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    if(!this->file.isOpen() || !this->reserve(length))
+        return;
+
+    unsigned char* record = this->data + headerLength + this->used.load(std::memory_order_relaxed);
+
+    put64(record, (std::uint64_t)std::max<std::int64_t>(0, now - result.elapsed));
+    put16(record + 8, transaction.write.size());
+    put16(record + 10, transaction.readLength);
+    record[12] = deviceNum & 0xFF;
+    record[13] = transaction.address & 0x7F;
+    record[14] = transaction.speedMode & 0x03;
+    record[15] = (result.acked ? Acked : 0) | (ran ? Ran : 0);
+
+    unsigned char* read = record + recordHeaderLength + transaction.write.size();
+    std::memcpy(record + recordHeaderLength, transaction.write.data(), transaction.write.size());
+    std::memcpy(read, result.read.data(), readLength);
+
+    // Short reads (a failed transfer) are padded, so the record length follows from its header alone
+    if(ran)
+        std::memset(read + readLength, 0xFF, transaction.readLength - readLength);
+
+    this->used.store(this->used.load(std::memory_order_relaxed) + length, std::memory_order_relaxed);
+    this->count.fetch_add(1, std::memory_order_relaxed);
+
+    put64(this->data + 24, this->used.load(std::memory_order_relaxed));
+}
+
+// TRACE READER
+bool TraceReader::open(const QString& path, QString* error)
+{
+    this->file.setFileName(path);
+    this->rewind();
+
+    if(!this->file.open(QIODevice::ReadOnly))
+        return fail(error, this->file.errorString());
+
+    std::size_t size = this->file.size();
+    this->data = size >= headerLength ? this->file.map(0, size) : nullptr;
+
+    if(!this->data || !std::equal(magic, magic + sizeof(magic), this->data))
+        return fail(error, "Not a transaction trace");
+
+    if(get16(this->data + 8) != TraceWriter::version)
+        return fail(error, "Unsupported trace version " + QString::number(get16(this->data + 8)));
+
+    std::size_t header = get16(this->data + 10);
+    std::uint64_t used = get64(this->data + 24);
+
+    if(header < headerLength || header > size || used > size - header)
+        return fail(error, "Damaged trace header");
+
+    this->startedAt = (std::int64_t)get64(this->data + 16);
+    this->data += header;
+    this->length = used;
+
+    return true;
+}
+
+bool TraceReader::next(TraceRecord& record)
+{
+    this->broken = false;
+
+    if(this->position == this->length)
+        return false;
+
+    const unsigned char* p = this->data + this->position;
+    std::size_t left = this->length - this->position;
+
+    if(left < recordHeaderLength) {
+        this->broken = true;
+        return false;
+    }
+
+    std::size_t writeLength = get16(p + 8);
+    std::size_t readLength = get16(p + 10);
+    bool ran = p[15] & Ran;
+    std::size_t length = recordHeaderLength + writeLength + (ran ? readLength : 0);
+
+    if(left < length) {
+        this->broken = true;
+        return false;
+    }
+
+    record.timestamp = (std::int64_t)get64(p);
+    record.deviceNum = p[12];
+    record.transaction.address = p[13];
+    record.transaction.speedMode = p[14];
+    record.transaction.readLength = readLength;
+    record.transaction.write.assign(p + recordHeaderLength, p + recordHeaderLength + writeLength);
+
+    record.result.acked = p[15] & Acked;
+    record.result.batched = ran ? 1 : 0;
+    record.result.elapsed = 0;
+
+    if(ran)
+        record.result.read.assign(p + recordHeaderLength + writeLength, p + length);
+    else
+        record.result.read.clear();
+
+    this->position += length;
+    ++this->index;
+
+    return true;
+}
@@ -0,0 +1,111 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TRACELOG_H
+#define TRACELOG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <QFile>
+#include <QString>
+
+#include "ch341stream.h"
+
+struct TraceRecord {
+    std::int64_t timestamp = 0;         // Nanoseconds since the trace started, when the USB call carrying it began
+    unsigned long deviceNum = 0;
+    I2CTransaction transaction = { 0, {}, 0, 1 };
+    I2CResult result = { false, {} };   // batched is 1 if it went over the bus, the read data is only kept then
+};
+
+// Binary transaction trace (*.ch341trc). Records are appended to a memory
+// mapped file that is preallocated in large steps, so appending is a copy
+// into the mapping. All numbers are little endian.
+//
+//   Header   magic "CH341TRC", version, header size, start (milliseconds
+//            since the epoch) and the length of the records written so far,
+//            updated with every record so a trace survives a crash
+//   Records  timestamp (8), write length (2), read length (2), device (1),
+//            address (1), speed mode (1), flags (1: ACK, 2: ran), then the
+//            written bytes and, if it ran, the read bytes
+class TraceWriter
+{
+public:
+    static const char* const suffix;
+    static const std::uint16_t version = 1;
+
+    TraceWriter() = default;
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+    ~TraceWriter();
+
+    bool open(const QString& path, QString* error = nullptr);
+    // Trims the preallocated space off the file
+    void close();
+    QString path() const { return this->file.fileName(); }
+
+    // Thread safe. Transactions that never ran (result.batched == 0) are kept too, without read data.
+    void append(unsigned long deviceNum, const I2CTransaction& transaction, const I2CResult& result);
+
+    // Thread safe
+    std::uint64_t records() const { return this->count.load(std::memory_order_relaxed); }
+    std::uint64_t bytes() const { return this->used.load(std::memory_order_relaxed); }
+
+private:
+    QFile file;
+    unsigned char* data = nullptr;
+    std::size_t capacity = 0;
+    std::chrono::steady_clock::time_point started;
+
+    std::mutex lock;
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::uint64_t> used{0};         // Record bytes after the header
+
+    bool reserve(std::size_t length);
+};
+
+class TraceReader
+{
+public:
+    TraceReader() = default;
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    bool open(const QString& path, QString* error = nullptr);
+    QString path() const { return this->file.fileName(); }
+
+    std::int64_t started() const { return this->startedAt; } // Milliseconds since the epoch
+
+    // Returns false at the end of the trace, or at a damaged record (see damaged())
+    bool next(TraceRecord& record);
+    void rewind() { this->position = 0; this->index = 0; }
+    bool damaged() const { return this->position < this->length && this->broken; }
+    std::size_t read() const { return this->index; } // Records returned by next() so far
+
+private:
+    QFile file;
+    const unsigned char* data = nullptr;
+    std::size_t length = 0;                     // Record bytes after the header
+    std::size_t position = 0;
+    std::size_t index = 0;
+    std::int64_t startedAt = 0;
+    bool broken = false;
+};
+
+#endif // TRACELOG_H
@@ -0,0 +1,141 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "tracereplay.h"
+
+#include <thread>
+
+#include "i2ctransport.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const std::size_t batchLength = 64;            // Transactions per batch as fast as possible, several full transfers
+const Clock::duration spinTime = std::chrono::milliseconds(2); // Sleeps overshoot, the rest is busy waited
+
+}
+
+TraceReplay::TraceReplay(I2CTransport* transport)
+    : transport(transport)
+{
+}
+
+bool TraceReplay::matches(const TraceRecord& recorded, const I2CResult& replayed)
+{
+    if(recorded.result.acked != replayed.acked)
+        return false;
+
+    // Whatever a NACKed read returns is just the released bus
+    return !recorded.result.acked || recorded.result.read == replayed.read;
+}
+
+bool TraceReplay::run(TraceReader& trace, Timing timing, const Mismatch& mismatch)
+{
+    this->lastError.clear();
+    this->state = TraceReplayReport();
+
+    trace.rewind();
+
+    std::vector<TraceRecord> records;
+    std::vector<std::size_t> indices;
+    TraceRecord record;
+    std::int64_t first = -1, last = 0;
+    Clock::time_point start = Clock::now();
+
+    while(trace.next(record)) {
+        if(record.result.batched == 0) {
+            ++this->state.skipped;
+            continue;
+        }
+
+        if(first < 0)
+            first = record.timestamp;
+
+        last = record.timestamp;
+
+        if(timing == OriginalTiming) {
+            Clock::time_point due = start + std::chrono::nanoseconds(record.timestamp - first);
+
+            if(due - Clock::now() > spinTime)
+                std::this_thread::sleep_until(due - spinTime);
+
+            while(Clock::now() < due)
+                ;
+        }
+
+        records.push_back(std::move(record));
+        indices.push_back(trace.read() - 1);
+
+        if((timing == OriginalTiming || records.size() == batchLength) && !this->replay(records, indices, mismatch))
+            return false;
+    }
+
+    if(!this->replay(records, indices, mismatch))
+        return false;
+
+    this->state.elapsed = Clock::now() - start;
+    this->state.recorded = std::chrono::nanoseconds(first < 0 ? 0 : last - first);
+
+    if(trace.damaged())
+        return this->fail("Damaged trace after record " + QString::number(trace.read()));
+
+    return true;
+}
+
+bool TraceReplay::replay(std::vector<TraceRecord>& records, std::vector<std::size_t>& indices, const Mismatch& mismatch)
+{
+    if(records.empty())
+        return true;
+
+    std::vector<I2CTransaction> transactions;
+    transactions.reserve(records.size());
+
+    for(const TraceRecord& record : records)
+        transactions.push_back(record.transaction);
+
+    std::vector<I2CResult> results;
+    std::size_t transfers = 0;
+
+    if(!this->transport->transferBatch(transactions, results, &transfers))
+        return this->fail("Transfer failed at record " + QString::number(indices.front()));
+
+    this->state.transfers += transfers;
+
+    for(std::size_t i = 0; i < records.size(); ++i) {
+        ++this->state.transactions;
+
+        if(TraceReplay::matches(records[i], results[i]))
+            continue;
+
+        ++this->state.mismatches;
+
+        if(mismatch)
+            mismatch(indices[i], records[i], results[i]);
+    }
+
+    records.clear();
+    indices.clear();
+
+    return true;
+}
+
+bool TraceReplay::fail(const QString& error)
+{
+    this->lastError = error;
+
+    return false;
+}
@@ -0,0 +1,69 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TRACEREPLAY_H
+#define TRACEREPLAY_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include <QString>
+
+#include "tracelog.h"
+
+class I2CTransport;
+
+struct TraceReplayReport {
+    std::size_t transactions = 0;       // Replayed, records that never went over the bus are skipped
+    std::size_t skipped = 0;
+    std::size_t mismatches = 0;         // ACK or read back differs from the recording
+    std::size_t transfers = 0;
+    std::chrono::nanoseconds elapsed{0};
+    std::chrono::nanoseconds recorded{0}; // From the first to the last replayed record, as recorded
+};
+
+// Runs the transactions of a trace again on the calling thread and compares
+// every ACK and read back with the recorded one. As fast as possible packs
+// the transactions into full transfers, original timing starts each one at
+// its recorded offset from the first.
+class TraceReplay
+{
+public:
+    enum Timing { AsFastAsPossible, OriginalTiming };
+
+    // Called for every replayed transaction that differs from the recording, record counts from 0
+    using Mismatch = std::function<void(std::size_t record, const TraceRecord& recorded, const I2CResult& replayed)>;
+
+    explicit TraceReplay(I2CTransport* transport);
+
+    bool run(TraceReader& trace, Timing timing, const Mismatch& mismatch = Mismatch());
+
+    static bool matches(const TraceRecord& recorded, const I2CResult& replayed);
+
+    const QString& error() const { return this->lastError; }
+    const TraceReplayReport& report() const { return this->state; }
+
+private:
+    I2CTransport* transport;
+    QString lastError;
+    TraceReplayReport state;
+
+    bool replay(std::vector<TraceRecord>& records, std::vector<std::size_t>& indices, const Mismatch& mismatch);
+    bool fail(const QString& error);
+};
+
+#endif // TRACEREPLAY_H
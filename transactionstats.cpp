@@ -0,0 +1,187 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "transactionstats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+const char* const speedNames[] = { "20 kHz", "100 kHz", "400 kHz", "750 kHz" };
+
+std::string csvField(const QString& text)
+{
+    std::string field = text.toStdString();
+
+    if(field.find_first_of(",\"\r\n") == std::string::npos)
+        return field;
+
+    std::string quoted = "\"";
+    for(char c : field)
+        quoted += c == '"' ? std::string("\"\"") : std::string(1, c);
+
+    return quoted + '"';
+}
+
+std::string jsonString(const QString& text)
+{
+    std::ostringstream escaped;
+    escaped << '"';
+
+    for(unsigned char c : text.toStdString()) {
+        if(c == '"' || c == '\\')
+            escaped << '\\' << c;
+        else if(c < 0x20)
+            escaped << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+        else
+            escaped << c;
+    }
+
+    escaped << '"';
+    return escaped.str();
+}
+
+double microseconds(std::uint64_t nanoseconds)
+{
+    return nanoseconds / 1000.0;
+}
+
+}
+
+// TRANSACTION STATS
+LatencyHistogram* TransactionStats::histogram(Dimension dimension, const QString& key)
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    LatencyHistogram*& histogram = this->index[{ dimension, key }];
+
+    if(!histogram) {
+        this->histograms.emplace_back();
+        histogram = &this->histograms.back();
+    }
+
+    return histogram;
+}
+
+std::vector<TransactionStats::Row> TransactionStats::rows() const
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    std::vector<Row> rows;
+    rows.reserve(this->index.size());
+
+    for(const auto& entry : this->index)
+        rows.push_back({ (Dimension)entry.first.first, entry.first.second, entry.second->snapshot() });
+
+    return rows;
+}
+
+void TransactionStats::reset()
+{
+    std::lock_guard<std::mutex> guard(this->lock);
+
+    for(LatencyHistogram& histogram : this->histograms)
+        histogram.reset();
+}
+
+QString TransactionStats::dimensionName(Dimension dimension)
+{
+    switch(dimension) {
+        case ByCommand: return "Command";
+        case BySpeed:   return "Speed";
+        default:        return "Device";
+    }
+}
+
+void TransactionStats::writeCsv(std::ostream& out, const std::vector<Row>& rows)
+{
+    out << "Group,Name,Transactions,Errors,Retries,Waited (us),Bytes,p50 (us),p99 (us),Max (us),Bytes/s";
+
+    for(const Row& row : rows) {
+        const LatencyHistogram::Snapshot& data = row.data;
+
+        out << "\n" << csvField(TransactionStats::dimensionName(row.dimension)) << "," << csvField(row.key) << ","
+            << data.count << "," << data.errors << "," << data.retries << "," << microseconds(data.waited) << "," << data.bytes << ","
+            << microseconds(data.quantile(0.5)) << "," << microseconds(data.quantile(0.99)) << "," << microseconds(data.max) << ","
+            << std::llround(data.bytesPerSecond());
+    }
+
+    out << "\n";
+}
+
+void TransactionStats::writeJson(std::ostream& out, const std::vector<Row>& rows)
+{
+    out << "[";
+
+    for(std::size_t i = 0; i < rows.size(); ++i) {
+        const LatencyHistogram::Snapshot& data = rows[i].data;
+
+        out << (i ? ",\n " : "\n ") << "{\"group\":" << jsonString(TransactionStats::dimensionName(rows[i].dimension).toLower())
+            << ",\"name\":" << jsonString(rows[i].key) << ",\"transactions\":" << data.count << ",\"errors\":" << data.errors
+            << ",\"retries\":" << data.retries << ",\"waited_us\":" << microseconds(data.waited)
+            << ",\"bytes\":" << data.bytes << ",\"p50_us\":" << microseconds(data.quantile(0.5))
+            << ",\"p99_us\":" << microseconds(data.quantile(0.99)) << ",\"max_us\":" << microseconds(data.max)
+            << ",\"bytes_per_s\":" << std::llround(data.bytesPerSecond()) << "}";
+    }
+
+    out << "\n]\n";
+}
+
+// TRANSACTION RECORDER
+TransactionRecorder::TransactionRecorder(std::shared_ptr<TransactionStats> stats)
+    : stats(std::move(stats))
+{
+}
+
+void TransactionRecorder::record(unsigned long deviceNum, const I2CTransaction& transaction, const I2CResult& result, const QString& name)
+{
+    if(!this->stats || result.batched == 0)
+        return;
+
+    std::uint64_t latency = (std::uint64_t)std::max<std::int64_t>(0, result.elapsed);
+    std::uint64_t busy = latency / result.batched;
+    std::size_t bytes = transaction.busBytes();
+    std::uint64_t retries = result.retries;
+    std::uint64_t waited = (std::uint64_t)std::max<std::int64_t>(0, result.waited);
+
+    // DEVICE
+    if(!this->device || this->deviceNum != deviceNum) {
+        this->device = this->stats->histogram(TransactionStats::ByDevice, "#" + QString::number(deviceNum));
+        this->deviceNum = deviceNum;
+    }
+
+    this->device->record(latency, busy, bytes, result.acked, retries, waited);
+
+    // SPEED
+    LatencyHistogram*& speed = this->speeds[transaction.speedMode & 0x03];
+
+    if(!speed)
+        speed = this->stats->histogram(TransactionStats::BySpeed, speedNames[transaction.speedMode & 0x03]);
+
+    speed->record(latency, busy, bytes, result.acked, retries, waited);
+
+    // COMMAND (transactions typed in by hand go by their address)
+    QString key = name.isEmpty() ? "Address 0x" + QString::number(transaction.address, 16).rightJustified(2, '0').toUpper() : name;
+    LatencyHistogram*& command = this->commands[key];
+
+    if(!command)
+        command = this->stats->histogram(TransactionStats::ByCommand, key);
+
+    command->record(latency, busy, bytes, result.acked, retries, waited);
+}
@@ -0,0 +1,86 @@
+// This file is part of CH341-I2C-Tool
+// Copyright (C) 2023  Derek Meng
+
+// CH341-I2C-Tool is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// CH341-I2C-Tool is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+
+// You should have received a copy of the GNU Lesser General Public License
+// along with CH341-I2C-Tool.  If not, see <https://www.gnu.org/licenses/>.
+
+#ifndef TRANSACTIONSTATS_H
+#define TRANSACTIONSTATS_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include <QHash>
+#include <QString>
+
+#include "ch341stream.h"
+#include "latencyhistogram.h"
+
+// Latency histograms of every transaction run, kept per command name, per
+// bus speed and per device. Shared by every device thread that runs
+// transactions, read from the GUI thread.
+class TransactionStats
+{
+public:
+    enum Dimension { ByCommand, BySpeed, ByDevice };
+
+    struct Row {
+        Dimension dimension;
+        QString key;
+        LatencyHistogram::Snapshot data;
+    };
+
+    // Thread safe. The histogram stays valid as long as the stats, reset() only clears it.
+    LatencyHistogram* histogram(Dimension dimension, const QString& key);
+
+    // Ordered by dimension, then key
+    std::vector<Row> rows() const;
+    void reset();
+
+    static QString dimensionName(Dimension dimension);
+
+    // Latencies in microseconds, throughput in bytes per second
+    static void writeCsv(std::ostream& out, const std::vector<Row>& rows);
+    static void writeJson(std::ostream& out, const std::vector<Row>& rows);
+
+private:
+    mutable std::mutex lock;
+    std::deque<LatencyHistogram> histograms;
+    std::map<std::pair<int, QString>, LatencyHistogram*> index;
+};
+
+// One per device thread. Caches the histograms it records into, so the stats
+// lock is only taken the first time a command, speed or device shows up.
+class TransactionRecorder
+{
+public:
+    explicit TransactionRecorder(std::shared_ptr<TransactionStats> stats = nullptr);
+
+    bool isEnabled() const { return this->stats != nullptr; }
+
+    // Results without a USB call (result.batched == 0) were never run and are skipped
+    void record(unsigned long deviceNum, const I2CTransaction& transaction, const I2CResult& result, const QString& name);
+
+private:
+    std::shared_ptr<TransactionStats> stats;
+
+    LatencyHistogram* device = nullptr;
+    unsigned long deviceNum = 0;
+    LatencyHistogram* speeds[4] = {};
+    QHash<QString, LatencyHistogram*> commands;
+};
+
+#endif // TRANSACTIONSTATS_H